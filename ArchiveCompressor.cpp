@@ -31,9 +31,14 @@
 #include <fcntl.h>
 #include <cstring>
 #endif
+#include <algorithm>
+#include <array>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <type_traits>
+#include <unordered_map>
 #ifdef RADYX_RANDOM_TEST
 #include <random>
 #endif
@@ -41,12 +46,16 @@
 #include "ArchiveCompressor.h"
 #include "Strings.h"
 #include "IoException.h"
+#include "Profiler.h"
+#include "StagingReader.h"
+#include "ArchiveVerifier.h"
+#include "Journal.h"
 #include "fast-lzma2/fl2_errors.h"
 
 namespace Radyx {
 
 #ifdef RADYX_RANDOM_TEST
-extern uint_least64_t g_testSize = 256U << 20;
+uint_least64_t g_testSize = 256U << 20;
 #endif
 
 const _TCHAR ArchiveCompressor::extensions[] =
@@ -82,7 +91,7 @@ _T("\0exe\0dll\0ocx\0vbx\0sfx\0sys\0awx\0com\0out\0");
 
 #ifdef _WIN32
 
-ArchiveCompressor::FileReader::FileReader(const FileInfo& fi, bool share_deny_none)
+ArchiveCompressor::FileReader::FileReader(const FileInfo& fi, bool share_deny_none, bool drop_cache)
 {
 	std::array<_TCHAR, MAX_PATH> path;
 	const _TCHAR* p = path.data();
@@ -103,7 +112,7 @@ ArchiveCompressor::FileReader::FileReader(const FileInfo& fi, bool share_deny_no
 		FILE_SHARE_READ | (share_deny_none ? FILE_SHARE_WRITE : 0),
 		NULL,
 		OPEN_EXISTING,
-		FILE_ATTRIBUTE_NORMAL,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
 		NULL);
 }
 
@@ -129,8 +138,11 @@ void ArchiveCompressor::FileReader::GetAttributes(FileInfo& fi, bool get_creatio
 
 #else
 
-ArchiveCompressor::FileReader::FileReader(const FileInfo& fi, bool share_deny_none)
-	: fd(-1)
+ArchiveCompressor::FileReader::FileReader(const FileInfo& fi, bool share_deny_none, bool drop_cache_)
+	: fd(-1),
+	drop_cache(drop_cache_),
+	read_pos(0),
+	drop_pos(0)
 {
 	std::array<char, PATH_MAX> path;
 	if (fi.dir.length() + fi.name.length() < path.size()) {
@@ -141,12 +153,20 @@ ArchiveCompressor::FileReader::FileReader(const FileInfo& fi, bool share_deny_no
 		if(fd < 0 && O_NOATIME) {
 			fd = open(path.data(), O_RDONLY);
 		}
+#ifdef POSIX_FADV_SEQUENTIAL
+		if (fd >= 0) {
+			posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		}
+#endif
 	}
 }
 
 ArchiveCompressor::FileReader::~FileReader()
 {
 	if (fd >= 0) {
+		if (drop_cache) {
+			DropBehind(true);
+		}
 		close(fd);
 	}
 }
@@ -164,8 +184,14 @@ void ArchiveCompressor::FileReader::GetAttributes(FileInfo& fi, bool get_creatio
 
 #endif // _WIN32
 
-ArchiveCompressor::ArchiveCompressor()
-	: initial_total_bytes(0)
+ArchiveCompressor::ArchiveCompressor(const Cancellation& cancel_, Tostream& messages_)
+	: cancel(cancel_),
+	messages(messages_),
+	source(nullptr),
+	initial_total_bytes(0)
+#ifdef RADYX_RANDOM_TEST
+	, test_seed(0)
+#endif
 {
 	assert(GetExtensionIndex(_T("out")) != 0);
 }
@@ -184,16 +210,24 @@ void ArchiveCompressor::Add(const _TCHAR* path, size_t root, uint_least64_t size
 	initial_total_bytes += size;
 }
 
-static bool CompareFileInfo(const ArchiveCompressor::FileInfo& first, const ArchiveCompressor::FileInfo& second)
+void ArchiveCompressor::AddFromSource(FileSource& source_)
 {
-	if (first.ext_index != second.ext_index) {
-		return first.ext_index < second.ext_index;
-	}
-	ptrdiff_t comp = first.name.FsCompare(first.ext, std::string::npos, second.name, second.ext, std::string::npos);
-	if (comp == 0) {
-		return first.name.FsCompare(second.name) < 0;
+	source = &source_;
+	FileSource::Entry entry;
+	while (source->Next(entry)) {
+		if (cancel.IsSet()) {
+			throw std::runtime_error(Strings::kBreakSignaled);
+		}
+		Path name(entry.name);
+		name.ConvertSeparators();
+		size_t name_pos = name.GetNamePos();
+		const Path& dir = *path_set.emplace(name.c_str(), name_pos).first;
+		file_list.push_back(FileInfo(dir, name.c_str() + name_pos, 0, entry.size));
+		if (entry.mod_time != 0) {
+			file_list.back().mod_time.Set(entry.mod_time);
+		}
+		initial_total_bytes += entry.size;
 	}
-	return comp < 0;
 }
 
 void ArchiveCompressor::PrepareFileList(const RadyxOptions& options)
@@ -203,7 +237,7 @@ void ArchiveCompressor::PrepareFileList(const RadyxOptions& options)
 
 #ifdef RADYX_RANDOM_TEST
     for (auto it = file_list.begin(); it != file_list.end(); ) {
-        FileReader reader(*it, options.share_deny_none);
+        FileReader reader(*it, options.share_deny_none, options.drop_cache);
         auto old_it = it;
         ++it;
         if (!reader.IsValid())
@@ -217,11 +251,7 @@ void ArchiveCompressor::PrepareFileList(const RadyxOptions& options)
             fi.root = 0;
         }
     }
-    else {
-        DetectCollisions();
-    }
-    // Sort the file list by extension index then name
-    file_list.sort(CompareFileInfo);
+    SortFileList();
 }
 
 #ifdef RADYX_RANDOM_TEST
@@ -262,9 +292,14 @@ static void SetRandomOptions(std::mt19937& gen, Lzma2Options& lzma2)
 
 uint_least64_t ArchiveCompressor::Compress(FastLzma2& enc,
 	const RadyxOptions& options,
-	OutputStream& out_stream)
+	OutputStream& out_stream,
+	Telemetry* telemetry,
+	Journal* journal,
+	UnitVerifier* verifier,
+	Progress::Listener* listener)
 {
 	if (file_list.size() == 0) {
+		file_list.splice(file_list.begin(), kept_list);
 		return 0;
 	}
 #ifdef RADYX_RANDOM_TEST
@@ -274,10 +309,22 @@ uint_least64_t ArchiveCompressor::Compress(FastLzma2& enc,
         file_vec.push_back(&fi);
         fi.include = false;
     }
-    LARGE_INTEGER li;
-    QueryPerformanceCounter(&li);
-    std::Tcerr << "Seed: " << li.LowPart << std::endl;
-    std::mt19937 gen(li.LowPart);
+    // Each pass is seeded from the one before, so setting RADYX_TEST_SEED to
+    // the seed of a failed pass repeats it and the passes after it
+    if (test_seed == 0) {
+        const char* seed_env = getenv("RADYX_TEST_SEED");
+        if (seed_env != nullptr)
+            test_seed = static_cast<unsigned>(strtoul(seed_env, nullptr, 10));
+        else
+            test_seed = std::random_device()();
+    }
+    else {
+        test_seed = static_cast<unsigned>(std::mt19937(test_seed)());
+    }
+    if (test_seed == 0)
+        test_seed = 1;
+    messages << "Seed: " << test_seed << std::endl;
+    std::mt19937 gen(test_seed);
     Lzma2Options lzma2;
     SetRandomOptions(gen, lzma2);
     enc.SetOptions(lzma2);
@@ -305,20 +352,44 @@ uint_least64_t ArchiveCompressor::Compress(FastLzma2& enc,
 	DataUnit unit;
 	unit.out_file_pos = out_stream.tellp();
 	uint_least64_t packed_size = 0;
-	std::Tcerr << Strings::kFound_ << file_list.size();
-	std::Tcerr << (file_list.size() > 1 ? Strings::k_files : Strings::k_file) << std::endl;
+	messages << Strings::kFound_ << file_list.size();
+	messages << (file_list.size() > 1 ? Strings::k_files : Strings::k_file) << std::endl;
 	unsigned exe_group = GetExtensionIndex(_T("exe"));
-    enc.Begin(options.bcj_filter && it->ext_index >= exe_group);
+	// Per-class encoder settings, applied when each unit begins. The sizes the
+	// encoder was allocated for are pinned so a class's compression level
+	// can't bring in its preset dictionary and force a reallocation.
+	Lzma2Options profiles[kContentClassCount];
+	if (options.group_profiles) {
+		Lzma2Options main_options = options.lzma2;
+		main_options.dictionary_size = enc.GetDictionarySize();
+		main_options.match_buffer_log = enc.GetBufferLog();
+		for (unsigned i = 0; i < kContentClassCount; ++i) {
+			profiles[i] = main_options;
+			ApplyProfile(static_cast<ContentClass>(i), profiles[i]);
+		}
+		enc.SetOptions(profiles[GetContentClass(it->ext_index)]);
+	}
+    enc.Begin(options.bcj_filter && it->ext_index >= exe_group, GetUnitSizeHint(it, file_list.end(), options));
 	Progress progress(initial_total_bytes);
+	progress.SetTelemetry(telemetry);
+	progress.SetVisible(options.show_progress);
+	progress.SetListener(listener);
+	// Units kept from an existing archive are not counted in progress reports
+	size_t kept_units = unit_list.size();
+	std::unique_ptr<StagingReader> staging;
+	if (options.staged_read && source == nullptr) {
+		staging.reset(new StagingReader(file_list, options));
+	}
+	enc.CapturePackedData(verifier != nullptr && verifier->NeedsPackedData());
     for (;;) {
 		unsigned ext_index = it->ext_index;
-		if(!AddFile(*it, enc, options, progress, out_stream)) {
+		if(!AddFile(*it, staging.get(), enc, options, progress, out_stream)) {
 			auto old_it = it;
 			++it;
 			//Delete it from the file list if not read
 			file_list.erase(old_it);
 		}
-		else if (!g_break) {
+		else if (!cancel.IsSet()) {
 			// Only added to the unit if not empty
 			if (it->size != 0) {
 				unit.unpack_size += it->size;
@@ -338,12 +409,7 @@ uint_least64_t ArchiveCompressor::Compress(FastLzma2& enc,
             throw std::runtime_error(Strings::kBreakSignaled);
         }
 		// Criteria for ending the solid unit and maybe starting a new one
-		if (unit.unpack_size >= options.solid_unit_size
-			|| unit.file_count >= options.solid_file_count
-			|| it == file_list.end()
-			|| (options.bcj_filter && ext_index < exe_group && it->ext_index >= exe_group)
-			|| (options.solid_by_extension && ext_index != it->ext_index))
-		{
+		if (IsUnitEnd(unit.unpack_size, unit.file_count, ext_index, it, file_list.end(), options)) {
 			// If any data was added, compress what remains and add the unit to the list
 			if (unit.unpack_size != 0) {
 				progress.Show();
@@ -358,152 +424,491 @@ uint_least64_t ArchiveCompressor::Compress(FastLzma2& enc,
 				unit.pack_size = out_file_pos - unit.out_file_pos;
 				// Add the unit
 				unit_list.push_back(unit);
+				RADYX_STATS_COUNT(kUnitsWritten, 1);
+				progress.FinishUnit(unit_list.size() - 1 - kept_units, unit.unpack_size, unit.pack_size);
+				if (verifier != nullptr) {
+					// The verifier reads the unit back from the archive, and
+					// records it in the journal once verified
+					out_stream.flush();
+					verifier->Submit(unit_list.back(), unit_list.size() - 1, enc.TakePackedData());
+				}
+				else if (journal != nullptr) {
+					journal->AddUnit(unit_list.back());
+				}
 				// Starting pos for the next unit
 				unit.out_file_pos = out_file_pos;
 			}
 			if (it == file_list.end()) {
 				break;
 			}
+			if (options.group_profiles) {
+				enc.SetOptions(profiles[GetContentClass(it->ext_index)]);
+			}
 			// Reset the unit compressor, turning on BCJ if adding executables
-            enc.Begin(options.bcj_filter && it->ext_index >= exe_group);
+            enc.Begin(options.bcj_filter && it->ext_index >= exe_group, GetUnitSizeHint(it, file_list.end(), options));
             progress.AddUnit(unit.unpack_size);
             unit.file_count = 0;
 			unit.unpack_size = 0;
 		}
 	}
     progress.Erase();
+	progress.ReportDone();
+	enc.CapturePackedData(false);
+	if (verifier != nullptr) {
+		verifier->Finish();
+		if (!options.quiet_mode) {
+			messages << Strings::kVerified_ << verifier->GetUnitCount() << std::endl;
+		}
+	}
 	// Warn if any files couldn't be read
-	if (!g_break && !file_warnings.empty()) {
+	if (!cancel.IsSet() && !file_warnings.empty()) {
 		if (!options.quiet_mode && !file_list.empty()) {
-			std::Tcerr << std::endl << Strings::kWarningsForFiles << std::endl;
+			messages << std::endl << Strings::kWarningsForFiles << std::endl;
 			for (auto& msg : file_warnings) {
-				std::Tcerr << msg << std::endl;
+				messages << msg << std::endl;
 			}
 		}
-		std::Tcerr << std::endl
+		messages << std::endl
 			<< Strings::kWarningCouldntOpen_
 			<< file_warnings.size()
 			<< (file_warnings.size() > 1 ? Strings::k_files : Strings::k_file)
 			<< std::endl;
 	}
+	// Kept units precede the new ones in the archive
+	file_list.splice(file_list.begin(), kept_list);
     return packed_size;
 }
 
-void ArchiveCompressor::EliminateDuplicates()
+void ArchiveCompressor::Update(const ArchiveReader& reader, const RadyxOptions& options)
 {
-	file_list.sort([](const ArchiveCompressor::FileInfo& first, const ArchiveCompressor::FileInfo& second)
-	{
-		if (&first.dir == &second.dir) {
-			return first.name.FsCompare(second.name) < 0;
+	FileMap on_disk = MapFileNames();
+	const auto& entries = reader.GetEntries();
+	const auto& units = reader.GetUnits();
+	// A unit is compressed again if any of its files changed
+	std::vector<bool> unit_changed(units.size(), false);
+	for (auto& entry : entries) {
+		if (entry.unit != ArchiveReader::kNoUnit && !unit_changed[entry.unit]) {
+			auto found = on_disk.find(entry.name);
+			if (found != on_disk.end() && IsChanged(*found->second, entry, options)) {
+				unit_changed[entry.unit] = true;
+			}
 		}
-		ptrdiff_t comp = first.dir.FsCompare(second.dir);
-		if (comp == 0) {
-			return first.name.FsCompare(second.name) < 0;
+	}
+	// Files in kept units are stored in unit order, followed by empty files.
+	// Files no longer on disk stay in the archive unless their unit changed.
+	std::list<FileInfo> kept_empty;
+	size_t current_unit = ArchiveReader::kNoUnit;
+	for (auto& entry : entries) {
+		auto found = on_disk.find(entry.name);
+		if (entry.unit != ArchiveReader::kNoUnit && unit_changed[entry.unit]) {
+			if (found == on_disk.end()) {
+				messages << Strings::kRemoving_ << entry.name << std::endl;
+			}
+			continue;
 		}
-		return comp < 0;
-	});
-	auto it = file_list.begin();
-	auto prev = it;
-	for (++it; it != file_list.end();) {
-		auto next = std::next(it);
-		if ((&it->dir == &prev->dir || it->dir.FsCompare(prev->dir) == 0)
-			&& it->name.FsCompare(prev->name) == 0)
-		{
-			file_list.erase(it);
+		if (found != on_disk.end()) {
+			if (entry.unit == ArchiveReader::kNoUnit) {
+				// Empty files are added again from disk
+				continue;
+			}
+			DropFile(on_disk, found);
 		}
-		else prev = it;
-		it = next;
+		if (entry.unit == ArchiveReader::kNoUnit) {
+			AddKeptFile(entry, kept_empty);
+			continue;
+		}
+		// Units stay at their position in the existing archive until copied
+		AddKeptUnitFile(entry, units[entry.unit], entry.unit != current_unit);
+		current_unit = entry.unit;
 	}
+	kept_list.splice(kept_list.end(), kept_empty);
 }
 
-void ArchiveCompressor::DetectCollisions()
+uint_least64_t ArchiveCompressor::CopyKeptUnits(OutputFile& out_file, const Path& source)
 {
-	file_list.sort([](const ArchiveCompressor::FileInfo& first, const ArchiveCompressor::FileInfo& second)
-	{
-		if (&first.dir == &second.dir) {
-			return first.name.FsCompare(second.name) < 0;
+	uint_least64_t copied = 0;
+	auto it = unit_list.begin();
+	while (it != unit_list.end()) {
+		// Units which are consecutive in the source are copied together
+		uint_least64_t source_pos = it->out_file_pos;
+		uint_least64_t out_pos = out_file.tellp();
+		uint_least64_t count = 0;
+		for (; it != unit_list.end() && it->out_file_pos == source_pos + count; ++it) {
+			it->out_file_pos = out_pos + count;
+			count += it->pack_size;
 		}
-		ptrdiff_t comp = first.dir.FsCompare(first.root, second.dir, second.root);
-		if (comp == 0) {
-			return first.name.FsCompare(second.name) < 0;
+		out_file.CopyFrom(source.c_str(), source_pos, count, cancel);
+		if (cancel.IsSet()) {
+			throw std::runtime_error(Strings::kBreakSignaled);
 		}
-		return comp < 0;
-	});
-	auto it = file_list.begin();
-	auto prev = it;
-	for (++it; it != file_list.end();) {
-		auto next = std::next(it);
-		if ((&it->dir == &prev->dir || it->dir.FsCompare(it->root, prev->dir, prev->root) == 0)
-			&& it->name.FsCompare(prev->name) == 0)
+		if (out_file.fail()) {
+			throw IoException(Strings::kCannotWriteArchive,
+				out_file.GetFailedError(),
+				out_file.GetFailedName().c_str());
+		}
+		copied += count;
+	}
+	if (!unit_list.empty()) {
+		messages << Strings::kKeptUnits_ << unit_list.size() << std::endl;
+	}
+	return copied;
+}
+
+uint_least64_t ArchiveCompressor::Resume(const Journal& journal, const RadyxOptions& options)
+{
+	FileMap on_disk = MapFileNames();
+	const auto& entries = journal.GetEntries();
+	const auto& units = journal.GetUnits();
+	// Units are stored in the order they were written, so a changed file
+	// discards its unit and all those after it
+	size_t unit_count = units.size();
+	for (auto& entry : entries) {
+		auto found = on_disk.find(entry.name);
+		if (found != on_disk.end() && IsChanged(*found->second, entry, options)) {
+			unit_count = entry.unit;
+			break;
+		}
+	}
+	for (auto& entry : entries) {
+		if (entry.unit >= unit_count) {
+			break;
+		}
+		auto found = on_disk.find(entry.name);
+		if (found != on_disk.end()) {
+			DropFile(on_disk, found);
+		}
+		// Units are already in place in the archive
+		AddKeptUnitFile(entry, units[entry.unit], entry.unit == unit_list.size());
+	}
+	if (unit_list.empty()) {
+		return 0;
+	}
+	messages << Strings::kResumedUnits_ << unit_list.size() << std::endl;
+	return unit_list.back().out_file_pos + unit_list.back().pack_size;
+}
+
+// Size and modification time decide whether a file must be compressed again
+bool ArchiveCompressor::IsChanged(FileInfo& fi, const ArchiveReader::Entry& entry, const RadyxOptions& options)
+{
+	FileReader reader(fi, options.share_deny_none, false);
+	if (!reader.IsValid()) {
+		return true;
+	}
+	reader.GetAttributes(fi, options.store_creation_time);
+	return fi.size != entry.size
+		|| !fi.mod_time.IsSet()
+		|| !entry.mod_time.IsSet()
+		|| fi.mod_time.Get() != entry.mod_time.Get();
+}
+
+ArchiveCompressor::FileMap ArchiveCompressor::MapFileNames()
+{
+	FileMap on_disk;
+	on_disk.reserve(file_list.size());
+	for (auto it = file_list.begin(); it != file_list.end(); ++it) {
+		on_disk.emplace(FsString(it->dir.c_str() + it->root) + it->name, it);
+	}
+	return on_disk;
+}
+
+void ArchiveCompressor::DropFile(FileMap& on_disk, FileMap::iterator found)
+{
+	initial_total_bytes -= found->second->size;
+	file_list.erase(found->second);
+	on_disk.erase(found);
+}
+
+void ArchiveCompressor::AddKeptFile(const ArchiveReader::Entry& entry, std::list<FileInfo>& list)
+{
+	size_t name_pos = Path::GetNamePos(entry.name.c_str());
+	const Path& dir = *path_set.emplace(entry.name.c_str(), name_pos).first;
+	list.push_back(FileInfo(dir, entry.name.c_str() + name_pos, 0, entry.size));
+	FileInfo& fi = list.back();
+	fi.creat_time = entry.creat_time;
+	fi.mod_time = entry.mod_time;
+	fi.attributes = entry.attributes;
+	fi.crc32 = Crc32(entry.crc32);
+}
+
+void ArchiveCompressor::AddKeptUnitFile(const ArchiveReader::Entry& entry, const ArchiveReader::Unit& source, bool first_in_unit)
+{
+	AddKeptFile(entry, kept_list);
+	if (first_in_unit) {
+		DataUnit unit;
+		unit.out_file_pos = source.pack_pos;
+		unit.pack_size = source.pack_size;
+		unit.coder_info = source.coder_info;
+		unit.bcj_info = source.bcj_info;
+		unit.used_bcj = source.used_bcj;
+		unit.in_file_first = std::prev(kept_list.end());
+		unit_list.push_back(unit);
+	}
+	DataUnit& unit = unit_list.back();
+	unit.unpack_size += entry.size;
+	++unit.file_count;
+	unit.in_file_last = std::prev(kept_list.end());
+}
+
+// Removes all but the first instance of each full path, leaving the list
+// order unchanged. Files are hashed on an id for the directory and the name
+// into an open addressing table.
+void ArchiveCompressor::EliminateDuplicates()
+{
+	// Directories are already unique in path_set, but on Windows two entries
+	// may differ only in case
+	std::unordered_map<const Path*, size_t> dir_ids;
+	std::unordered_map<FsString, size_t> folded_ids;
+	for (const auto& dir : path_set) {
+		FsString folded(dir);
+		for (auto& c : folded) {
+			c = Path::FsFold(c);
+		}
+		dir_ids[&dir] = folded_ids.emplace(folded, folded_ids.size()).first->second;
+	}
+	size_t table_size = 16;
+	while (table_size < file_list.size() * 2) {
+		table_size <<= 1;
+	}
+	// Each slot holds the file and its directory id
+	std::vector<std::pair<const FileInfo*, size_t>> table(table_size, std::make_pair(nullptr, 0));
+	for (auto it = file_list.begin(); it != file_list.end();) {
+		size_t dir_id = dir_ids[&it->dir];
+		size_t slot = (HashName(it->name) ^ (dir_id * 0x9E3779B9U)) & (table_size - 1);
+		bool duplicate = false;
+		for (; table[slot].first != nullptr; slot = (slot + 1) & (table_size - 1)) {
+			if (table[slot].second == dir_id && table[slot].first->name.FsCompare(it->name) == 0) {
+				duplicate = true;
+				break;
+			}
+		}
+		if (duplicate) {
+			it = file_list.erase(it);
+		}
+		else {
+			table[slot] = std::make_pair(&*it, dir_id);
+			++it;
+		}
+	}
+}
+
+// FNV-1a over the characters as FsCompare sees them
+size_t ArchiveCompressor::HashName(const Path& name)
+{
+	typedef std::make_unsigned<_TCHAR>::type UChar;
+	uint_least32_t hash = 2166136261U;
+	for (_TCHAR c : name) {
+		hash = (hash ^ static_cast<UChar>(Path::FsFold(c))) * 16777619U;
+	}
+	return hash;
+}
+
+// Sorts the file list by extension index, extension, name and stored path.
+// Duplicates are already removed, so any files with the same stored path are
+// adjacent and collide.
+void ArchiveCompressor::SortFileList()
+{
+	std::vector<SortKey> keys(file_list.size());
+	size_t seq = 0;
+	for (auto it = file_list.begin(); it != file_list.end(); ++it, ++seq) {
+		SortKey& key = keys[seq];
+		key.words[0] = it->ext_index;
+		key.words[1] = PackPrefix(it->name, it->ext);
+		// If the extension fills its prefix the names can't be compared
+		// until the extensions are compared in full
+		key.words[2] = it->name.length() - it->ext < kPrefixChars ? PackPrefix(it->name, 0) : 0;
+		key.seq = seq;
+		key.it = it;
+	}
+	std::vector<SortKey> temp(keys.size());
+	RadixSort(keys, temp, 0, keys.size(), 0);
+	const FileInfo* prev = nullptr;
+	for (const auto& key : keys) {
+		const FileInfo& fi = *key.it;
+		if (prev != nullptr
+			&& fi.name.FsCompare(prev->name) == 0
+			&& fi.dir.FsCompare(fi.root, prev->dir, prev->root) == 0)
 		{
-			std::Tcerr << Strings::kNameCollision_ << (it->dir.c_str() + it->root) << it->name << std::endl;
+			messages << Strings::kNameCollision_ << (fi.dir.c_str() + fi.root) << fi.name << std::endl;
 			throw std::invalid_argument("");
 		}
-		else prev = it;
-		it = next;
+		// Moving each file to the end in turn leaves the list in key order
+		file_list.splice(file_list.end(), file_list, key.it);
+		prev = &fi;
+	}
+}
+
+uint_least64_t ArchiveCompressor::PackPrefix(const Path& str, size_t pos)
+{
+	typedef std::make_unsigned<_TCHAR>::type UChar;
+	uint_least64_t value = 0;
+	for (size_t i = 0; i < kPrefixChars; ++i, ++pos) {
+		value <<= sizeof(_TCHAR) * 8;
+		if (pos < str.length()) {
+			value |= static_cast<UChar>(Path::FsFold(str[pos]));
+		}
 	}
+	return value;
+}
+
+bool ArchiveCompressor::CompareSortKeys(const SortKey& first, const SortKey& second)
+{
+	if (first.words != second.words) {
+		return first.words < second.words;
+	}
+	const FileInfo& fi = *first.it;
+	const FileInfo& fi_2 = *second.it;
+	ptrdiff_t comp = fi.name.FsCompare(fi.ext, std::string::npos, fi_2.name, fi_2.ext, std::string::npos);
+	if (comp == 0) {
+		comp = fi.name.FsCompare(fi_2.name);
+	}
+	if (comp == 0 && &fi.dir != &fi_2.dir) {
+		comp = fi.dir.FsCompare(fi.root, fi_2.dir, fi_2.root);
+	}
+	if (comp == 0) {
+		return first.seq < second.seq;
+	}
+	return comp < 0;
+}
+
+// MSD radix sort on the key bytes, most significant first. Ranges which are
+// small or equal in every byte are finished by CompareSortKeys.
+void ArchiveCompressor::RadixSort(std::vector<SortKey>& keys,
+	std::vector<SortKey>& temp,
+	size_t first,
+	size_t last,
+	unsigned digit)
+{
+	for (; digit < kSortKeyBytes && last - first > kRadixSortThreshold; ++digit) {
+		size_t word = digit / sizeof(uint_least64_t);
+		unsigned shift = (sizeof(uint_least64_t) - 1 - digit % sizeof(uint_least64_t)) * 8;
+		std::array<size_t, 257> bounds;
+		bounds.fill(0);
+		for (size_t i = first; i < last; ++i) {
+			++bounds[((keys[i].words[word] >> shift) & 0xFF) + 1];
+		}
+		// Skip bytes which are the same in all keys, such as the high bytes
+		// of the extension index
+		if (bounds[((keys[first].words[word] >> shift) & 0xFF) + 1] == last - first) {
+			continue;
+		}
+		for (size_t i = 1; i < bounds.size(); ++i) {
+			bounds[i] += bounds[i - 1];
+		}
+		for (size_t i = first; i < last; ++i) {
+			temp[first + bounds[(keys[i].words[word] >> shift) & 0xFF]++] = keys[i];
+		}
+		std::copy(temp.begin() + first, temp.begin() + last, keys.begin() + first);
+		// Each bound is now the end of its bucket
+		size_t start = first;
+		for (size_t i = 0; i < 256; ++i) {
+			size_t end = first + bounds[i];
+			if (end - start > 1) {
+				RadixSort(keys, temp, start, end, digit + 1);
+			}
+			start = end;
+		}
+		return;
+	}
+	std::sort(keys.begin() + first, keys.begin() + last, CompareSortKeys);
 }
 
 bool ArchiveCompressor::AddFile(FileInfo& fi,
+    StagingReader* staging,
     FastLzma2& enc,
     const RadyxOptions& options,
 	Progress& progress,
 	OutputStream& out_stream)
 {
 	uint_least64_t initial_size = fi.size;
-	FileReader reader(fi, options.share_deny_none);
-	if (!reader.IsValid()) {
-		const _TCHAR* os_msg = IoException::GetOsMessage();
+	// Without staging the file is read directly into the dictionary buffer
+	std::unique_ptr<FileReader> reader;
+	std::unique_ptr<FileSource::Reader> source_reader;
+	bool opened;
+	if (staging != nullptr) {
+		opened = staging->Open(fi);
+	}
+	else if (source != nullptr) {
+		source_reader = source->Open(fi.dir + fi.name);
+		opened = source_reader != nullptr;
+	}
+	else {
+		reader.reset(new FileReader(fi, options.share_deny_none, options.drop_cache));
+		opened = reader->IsValid();
+	}
+	if (!opened) {
+		const _TCHAR* os_msg = staging != nullptr ? staging->GetOsMessage()
+			: source != nullptr ? Strings::kUnknownError : IoException::GetOsMessage();
 		std::unique_lock<std::mutex> lock(progress.GetMutex());
 		progress.RewindLocked();
 		file_warnings.emplace_back(Strings::kCannotOpen_ + fi.dir + fi.name + _T(" : ") + os_msg);
-		std::Tcerr << file_warnings.back() << std::endl;
+		messages << file_warnings.back() << std::endl;
 		progress.Adjust(-static_cast<int_least64_t>(initial_size));
 		return false;
 	}
-	reader.GetAttributes(fi, options.store_creation_time);
+	if (reader) {
+		reader->GetAttributes(fi, options.store_creation_time);
+	}
 	// Size may have changed if open for writing
 	if (fi.size != initial_size) {
 		progress.Adjust(fi.size - initial_size);
 		initial_size = fi.size;
 	}
+	progress.SetCurrentFile(fi.dir, fi.root, fi.name);
+	RADYX_STATS_COUNT(kFilesRead, 1);
 	if (!options.quiet_mode) {
 		std::unique_lock<std::mutex> lock(progress.GetMutex());
 		progress.RewindLocked();
-		std::Tcerr << Strings::kAdding_ << (fi.dir.c_str() + fi.root) << fi.name.c_str() << std::endl;
+		messages << Strings::kAdding_ << (fi.dir.c_str() + fi.root) << fi.name.c_str() << std::endl;
 	}
 	fi.size = 0;
 	bool did_read = false;
-	while (!g_break) {
+	while (!cancel.IsSet()) {
         unsigned long size;
         uint8_t* dst = enc.GetAvailableBuffer(size);
         unsigned long read_count;
-		if (!reader.Read(dst, size, read_count)) {
+		bool read_ok;
+		{
+			Profiler::ScopedTimer timer(Profiler::kFileRead);
+			if (source_reader) {
+				size_t source_count = 0;
+				read_ok = source_reader->Read(dst, size, source_count);
+				read_count = static_cast<unsigned long>(source_count);
+			}
+			else {
+				read_ok = staging != nullptr ? staging->Read(dst, size, read_count) : reader->Read(dst, size, read_count);
+			}
+		}
+		if (!read_ok) {
 			// Read failure
 			if (did_read) {
 				// Can't recover if some of the file was compressed to the output
 				throw IoException(Strings::kUnrecoverableErrorReading, fi.name.c_str());
 			}
-			const _TCHAR* os_msg = IoException::GetOsMessage();
+			const _TCHAR* os_msg = staging != nullptr ? staging->GetOsMessage()
+				: source != nullptr ? Strings::kUnknownError : IoException::GetOsMessage();
 			file_warnings.emplace_back(Strings::kCannotRead_ + fi.dir + fi.name + _T(" : ") + os_msg);
-			std::Tcerr << file_warnings.back() << std::endl;
+			messages << file_warnings.back() << std::endl;
 			return false;
 		}
 		if (read_count == 0)
 			break;
-        if (g_break)
+        if (cancel.IsSet())
             return true;
         // Update the CRC
-		fi.crc32.Add(dst, read_count);
+		{
+			Profiler::ScopedTimer timer(Profiler::kCrc32);
+			fi.crc32.Add(dst, read_count);
+		}
 		// Update file size and the unit compressor's buffer pos
 		fi.size += read_count;
+		RADYX_STATS_COUNT(kBytesRead, read_count);
 
         enc.AddByteCount(read_count, out_stream, &progress);
 
         did_read = true;
 	}
 	// Adjust the total bytes to add if the size was different from when it was opened
-	if (!g_break && fi.size != initial_size) {
+	if (!cancel.IsSet() && fi.size != initial_size) {
 		progress.Adjust(fi.size - initial_size);
 	}
 	return true;
@@ -525,6 +930,91 @@ unsigned ArchiveCompressor::GetExtensionIndex(const _TCHAR* ext)
 	return 0;
 }
 
+// Criteria for ending the solid unit after adding a file
+bool ArchiveCompressor::IsUnitEnd(uint_least64_t unpack_size,
+	uint_least64_t file_count,
+	unsigned ext_index,
+	std::list<FileInfo>::const_iterator next,
+	std::list<FileInfo>::const_iterator end,
+	const RadyxOptions& options)
+{
+	static const unsigned exe_group = GetExtensionIndex(_T("exe"));
+	return unpack_size >= options.solid_unit_size
+		|| file_count >= options.solid_file_count
+		|| next == end
+		|| (options.bcj_filter && ext_index < exe_group && next->ext_index >= exe_group)
+		|| (options.solid_by_extension && ext_index != next->ext_index)
+		|| (options.group_profiles && GetContentClass(ext_index) != GetContentClass(next->ext_index));
+}
+
+// The size of the unit beginning at this file if all files are read as
+// listed. Only needs to be exact up to the small unit limit of the encoder.
+uint_least64_t ArchiveCompressor::GetUnitSizeHint(std::list<FileInfo>::const_iterator it,
+	std::list<FileInfo>::const_iterator end,
+	const RadyxOptions& options)
+{
+	uint_least64_t unpack_size = 0;
+	uint_least64_t file_count = 0;
+	while (it != end) {
+		unsigned ext_index = it->ext_index;
+		if (it->size != 0) {
+			unpack_size += it->size;
+			++file_count;
+		}
+		++it;
+		if (unpack_size > FastLzma2::kSmallUnitSize
+			|| IsUnitEnd(unpack_size, file_count, ext_index, it, end, options))
+		{
+			break;
+		}
+	}
+	return unpack_size;
+}
+
+// The class of content expected for files in this extension group. Depends on
+// the order of the extensions table.
+ArchiveCompressor::ContentClass ArchiveCompressor::GetContentClass(unsigned ext_index)
+{
+	static const unsigned text_first = GetExtensionIndex(_T("inl"));
+	static const unsigned text_end = GetExtensionIndex(_T("abf"));
+	static const unsigned media_first = GetExtensionIndex(_T("3gp"));
+	static const unsigned exe_first = GetExtensionIndex(_T("obj"));
+	if (ext_index >= exe_first) {
+		return kContentExecutable;
+	}
+	if (ext_index >= media_first) {
+		return kContentMedia;
+	}
+	if (ext_index >= text_first && ext_index < text_end) {
+		return kContentText;
+	}
+	return kContentOther;
+}
+
+// Modify the settings for the class of content. Media and archives are
+// mostly incompressible so the fastest settings are used, and LZMA2 stores
+// chunks that don't compress.
+void ArchiveCompressor::ApplyProfile(ContentClass content, Lzma2Options& lzma2)
+{
+	switch (content) {
+	case kContentText:
+		lzma2.lc = 3;
+		lzma2.lp = 0;
+		lzma2.pb = 0;
+		break;
+	case kContentMedia:
+		lzma2.compress_level = 1;
+		lzma2.encoder_mode = Lzma2Options::kFastMode;
+		break;
+	case kContentExecutable:
+		lzma2.lp = 0;
+		lzma2.pb = 2;
+		break;
+	default:
+		break;
+	}
+}
+
 // The number of empty files
 size_t ArchiveCompressor::GetEmptyFileCount() const
 {
@@ -26,8 +26,11 @@
 #ifndef RADYX_ARCHIVE_COMPRESSOR_H
 #define RADYX_ARCHIVE_COMPRESSOR_H
 
+#include <array>
 #include <list>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include "common.h"
 #include "OutputFile.h"
 #include "Path.h"
@@ -35,10 +38,16 @@
 #include "Crc32.h"
 #include "CoderInfo.h"
 #include "FastLzma2.h"
+#include "ArchiveReader.h"
+#include "Cancellation.h"
+#include "FileSource.h"
 
 namespace Radyx {
 
 class RadyxOptions;
+class StagingReader;
+class Journal;
+class UnitVerifier;
 
 class ArchiveCompressor
 {
@@ -67,10 +76,11 @@ public:
 			creat_time(0),
 			mod_time(0),
 			attributes(0),
+			ext_index(GetExtensionIndex(name_ + ext))
 #ifdef RADYX_RANDOM_TEST
-            include(false),
+			, include(false)
 #endif
-        ext_index(GetExtensionIndex(name_ + ext)) {}
+		{}
 		bool IsEmpty() const { return size == 0; }
 		FileInfo& operator=(const FileInfo&) = delete;
 	};
@@ -94,10 +104,20 @@ public:
 			used_bcj(false) {}
 	};
 
+	// Broad classes of content used to select a compression profile
+	enum ContentClass
+	{
+		kContentOther,
+		kContentText,
+		kContentMedia,
+		kContentExecutable,
+		kContentClassCount
+	};
+
 	class FileReader
 	{
 	public:
-		FileReader(const FileInfo& fi, bool share_deny_none);
+		FileReader(const FileInfo& fi, bool share_deny_none, bool drop_cache);
 		~FileReader();
 		inline bool IsValid() const;
 		inline bool Read(void* buffer, uint_fast32_t byte_count, unsigned long& bytes_read);
@@ -106,46 +126,133 @@ public:
 #ifdef _WIN32
 		HANDLE handle;
 #else
+		// Interval at which data already read is dropped from the page cache
+		static const uint_fast32_t kDropBehindSize = UINT32_C(8) << 20;
+
+		inline void DropBehind(bool all);
+
 		int fd;
+		bool drop_cache;
+		off_t read_pos;
+		off_t drop_pos;
 #endif
 		FileReader(const FileReader&) = delete;
 		FileReader& operator=(const FileReader&) = delete;
 	};
 
-	ArchiveCompressor();
+	// Stops with an exception once cancel is set. Notices and warnings are
+	// written to messages.
+	ArchiveCompressor(const Cancellation& cancel_, Tostream& messages_);
     void PrepareFileList(const RadyxOptions& options);
 	void Add(const _TCHAR* path, size_t root, uint_least64_t size);
+	// Adds every entry in the source, which is read from instead of the disk
+	// when compressing. The source must outlive Compress.
+	void AddFromSource(FileSource& source_);
+	bool IsCancelled() const { return cancel.IsSet(); }
 	uint_least64_t Compress(FastLzma2& enc,
 		const RadyxOptions& options,
-		OutputStream& out_stream);
+		OutputStream& out_stream,
+		Telemetry* telemetry,
+		Journal* journal,
+		UnitVerifier* verifier,
+		Progress::Listener* listener);
+	// Keeps the units of an existing archive in which no file has changed on
+	// disk and removes their files from the list to compress. Call after
+	// PrepareFileList.
+	void Update(const ArchiveReader& reader, const RadyxOptions& options);
+	// Copies the packed data of the kept units from the existing archive.
+	// Must precede Compress.
+	uint_least64_t CopyKeptUnits(OutputFile& out_file, const Path& source);
+	// Keeps the units recorded in the journal of an interrupted archive, up
+	// to the first in which a file has changed, and removes their files from
+	// the list to compress. Returns the archive size to continue from, or 0
+	// if no units were kept. Call after PrepareFileList.
+	uint_least64_t Resume(const Journal& journal, const RadyxOptions& options);
 	const std::list<FileInfo>& GetFileList() const { return file_list; }
 	const std::list<DataUnit>& GetUnitList() const { return unit_list; }
 	size_t GetEmptyFileCount() const;
 	size_t GetNameLengthTotal() const;
+	// Bytes of the files left to compress
+	uint_least64_t GetTotalBytes() const { return initial_total_bytes; }
 #ifdef RADYX_RANDOM_TEST
     void RestoreFileList();
+    unsigned GetTestSeed() const { return test_seed; }
 #endif
 
 private:
+	// Sort order of a file computed once before sorting. The prefixes are
+	// packed with the first character in the high bits so integer order
+	// matches Path::FsCompare. Keys equal in all words are compared in full.
+	struct SortKey
+	{
+		std::array<uint_least64_t, 3> words;
+		size_t seq;
+		std::list<FileInfo>::iterator it;
+	};
+
 	static const _TCHAR extensions[];
+	static const size_t kPrefixChars = sizeof(uint_least64_t) / sizeof(_TCHAR);
+	static const unsigned kSortKeyBytes = 3 * sizeof(uint_least64_t);
+	// Ranges this small are finished with a comparison sort
+	static const size_t kRadixSortThreshold = 32;
 
 	void EliminateDuplicates();
-	void DetectCollisions();
+	void SortFileList();
+	static size_t HashName(const Path& name);
+	static uint_least64_t PackPrefix(const Path& str, size_t pos);
+	static bool CompareSortKeys(const SortKey& first, const SortKey& second);
+	static void RadixSort(std::vector<SortKey>& keys,
+		std::vector<SortKey>& temp,
+		size_t first,
+		size_t last,
+		unsigned digit);
     bool AddFile(FileInfo& fi,
+        StagingReader* staging,
         FastLzma2& enc,
 		const RadyxOptions& options,
 		Progress& progress,
 		OutputStream& out_stream);
+	// Files to compress by the name they would be stored under
+	typedef std::unordered_map<FsString, std::list<FileInfo>::iterator> FileMap;
+
+	static bool IsChanged(FileInfo& fi, const ArchiveReader::Entry& entry, const RadyxOptions& options);
+	FileMap MapFileNames();
+	// Removes a file from the list to compress when it is kept
+	void DropFile(FileMap& on_disk, FileMap::iterator found);
+	void AddKeptFile(const ArchiveReader::Entry& entry, std::list<FileInfo>& list);
+	// Adds a file of a kept unit, starting a new unit from source at the
+	// unit's first file
+	void AddKeptUnitFile(const ArchiveReader::Entry& entry, const ArchiveReader::Unit& source, bool first_in_unit);
+	static bool IsUnitEnd(uint_least64_t unpack_size,
+		uint_least64_t file_count,
+		unsigned ext_index,
+		std::list<FileInfo>::const_iterator next,
+		std::list<FileInfo>::const_iterator end,
+		const RadyxOptions& options);
+	static uint_least64_t GetUnitSizeHint(std::list<FileInfo>::const_iterator it,
+		std::list<FileInfo>::const_iterator end,
+		const RadyxOptions& options);
 	static unsigned GetExtensionIndex(const _TCHAR* ext);
+	static ContentClass GetContentClass(unsigned ext_index);
+	static void ApplyProfile(ContentClass content, Lzma2Options& lzma2);
 #ifdef RADYX_RANDOM_TEST
     std::list<FileInfo> file_list_copy;
 #endif
 
 	std::list<FileInfo> file_list;
+	// Files of an updated archive which are not compressed again. They are
+	// moved to the front of file_list once compression is done.
+	std::list<FileInfo> kept_list;
 	std::list<DataUnit> unit_list;
 	std::unordered_set<Path, std::hash<FsString>> path_set;
 	std::list<FsString> file_warnings;
+	const Cancellation& cancel;
+	Tostream& messages;
+	FileSource* source;
 	uint_least64_t initial_total_bytes;
+#ifdef RADYX_RANDOM_TEST
+	unsigned test_seed;
+#endif
 
 	ArchiveCompressor(const ArchiveCompressor&) = delete;
 	ArchiveCompressor& operator=(const ArchiveCompressor&) = delete;
@@ -166,6 +273,7 @@ bool ArchiveCompressor::FileReader::Read(void* buffer, uint_fast32_t byte_count,
 #else
 
 #include <unistd.h>
+#include <fcntl.h>
 
 bool ArchiveCompressor::FileReader::IsValid() const
 {
@@ -180,10 +288,28 @@ bool ArchiveCompressor::FileReader::Read(void* buffer, uint_fast32_t byte_count,
 	}
 	else {
 		bytes_read = static_cast<unsigned long>(nread);
+		read_pos += nread;
+		if (drop_cache && read_pos - drop_pos >= static_cast<off_t>(kDropBehindSize)) {
+			DropBehind(false);
+		}
 		return true;
 	}
 }
 
+// Tell the OS the data behind the read position won't be needed again
+void ArchiveCompressor::FileReader::DropBehind(bool all)
+{
+#ifdef POSIX_FADV_DONTNEED
+	off_t end = all ? read_pos : read_pos & ~static_cast<off_t>(kDropBehindSize - 1);
+	if (end > drop_pos) {
+		posix_fadvise(fd, drop_pos, end - drop_pos, POSIX_FADV_DONTNEED);
+		drop_pos = end;
+	}
+#else
+	(void)all;
+#endif
+}
+
 #endif
 
 }
@@ -0,0 +1,559 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: ArchiveReader
+//        Reads the database of an existing archive written by Radyx
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include <memory>
+#include <string>
+#if (defined __GNUC__ && __GNUC__ >= 5) || (defined __clang_major__ && (__clang_major__ * 100 + __clang_minor__) >= 303)
+#define HAVE_CODECVT
+#include <codecvt>
+#include <locale>
+#elif !defined(_UNICODE)
+#include "../utf8cpp/source/utf8.h" // https://github.com/nemtrif/utfcpp
+#endif
+#include "ArchiveReader.h"
+#include "CompressedUint64.h"
+#include "Crc32.h"
+#include "IoException.h"
+#include "Strings.h"
+#include "fast-lzma2/fast-lzma2.h"
+#include "fast-lzma2/fl2_errors.h"
+
+namespace Radyx {
+
+const size_t ArchiveReader::kNoUnit;
+
+ArchiveReader::ArchiveReader(const Path& archive_path_)
+	: archive_path(archive_path_),
+	header_pos(0)
+{
+	in_file.open(archive_path.c_str(), std::ios_base::in | std::ios_base::binary);
+	if (!in_file) {
+		throw IoException(Strings::kCannotReadArchive, archive_path.c_str());
+	}
+	uint8_t sig_header[kSignatureHeaderSize];
+	ReadArchive(0, sig_header, kSignatureHeaderSize);
+	static const uint8_t kSignature[6] = { '7', 'z', 0xBC, 0xAF, 0x27, 0x1C };
+	if (memcmp(sig_header, kSignature, sizeof(kSignature)) != 0 || sig_header[6] != 0) {
+		Unsupported();
+	}
+	Crc32 start_crc;
+	start_crc.Add(sig_header + 12, 20);
+	header.assign(sig_header + 8, sig_header + kSignatureHeaderSize);
+	if (ReadUint32() != start_crc) {
+		Unsupported();
+	}
+	uint_least64_t next_offset = ReadUint64();
+	uint_least64_t next_size = ReadUint64();
+	uint_fast32_t next_crc = ReadUint32();
+	if (next_size == 0 || next_size > kMaxHeaderSize) {
+		Unsupported();
+	}
+	header.resize(static_cast<size_t>(next_size));
+	ReadArchive(kSignatureHeaderSize + next_offset, header.data(), header.size());
+	Crc32 crc32;
+	crc32.Add(header.data(), header.size());
+	if (crc32 != next_crc) {
+		Unsupported();
+	}
+	header_pos = 0;
+	uint_least64_t id = ReadNumber();
+	if (id == kEncodedHeader) {
+		DecodeHeader();
+		id = ReadNumber();
+	}
+	if (id != kHeader) {
+		Unsupported();
+	}
+	std::vector<uint_least64_t> stream_sizes;
+	std::vector<uint_fast32_t> stream_crcs;
+	id = ReadNumber();
+	if (id == kMainStreamsInfo) {
+		ReadStreamsInfo(stream_sizes, stream_crcs);
+		id = ReadNumber();
+	}
+	if (id == kFilesInfo) {
+		ReadFilesInfo(stream_sizes, stream_crcs);
+		id = ReadNumber();
+	}
+	else if (!stream_sizes.empty()) {
+		Unsupported();
+	}
+	if (id != kEnd) {
+		Unsupported();
+	}
+	header.clear();
+	header.shrink_to_fit();
+	in_file.close();
+}
+
+void ArchiveReader::ReadArchive(uint_least64_t pos, uint8_t* buffer, size_t count)
+{
+	in_file.seekg(pos);
+	in_file.read(reinterpret_cast<char*>(buffer), count);
+	if (!in_file) {
+		throw IoException(Strings::kCannotReadArchive, archive_path.c_str());
+	}
+}
+
+// The header is one LZMA2 unit described by a streams info block
+void ArchiveReader::DecodeHeader()
+{
+	std::vector<uint_least64_t> stream_sizes;
+	std::vector<uint_fast32_t> stream_crcs;
+	ReadStreamsInfo(stream_sizes, stream_crcs);
+	if (units.size() != 1 || units[0].used_bcj || units[0].coder_info.props.empty()
+		|| units[0].unpack_size > kMaxHeaderSize || units[0].pack_size > kMaxHeaderSize)
+	{
+		Unsupported();
+	}
+	Unit unit = units[0];
+	units.clear();
+	std::vector<uint8_t> packed(static_cast<size_t>(unit.pack_size));
+	ReadArchive(unit.pack_pos, packed.data(), packed.size());
+	header.assign(static_cast<size_t>(unit.unpack_size), 0);
+	header_pos = 0;
+
+	std::unique_ptr<FL2_DStream, size_t(*)(FL2_DStream*)> fds(FL2_createDStream(), FL2_freeDStream);
+	if (!fds) {
+		throw std::bad_alloc();
+	}
+	if (FL2_isError(FL2_initDStream_withProp(fds.get(), unit.coder_info.props[0]))) {
+		Unsupported();
+	}
+	FL2_inBuffer input = { packed.data(), packed.size(), 0 };
+	FL2_outBuffer output = { header.data(), header.size(), 0 };
+	for (;;) {
+		size_t prev_out = output.pos;
+		size_t prev_in = input.pos;
+		size_t res = FL2_decompressStream(fds.get(), &output, &input);
+		if (FL2_isError(res)) {
+			Unsupported();
+		}
+		if (res == 0) {
+			break;
+		}
+		if (output.pos == prev_out && input.pos == prev_in) {
+			// Truncated or longer than declared
+			Unsupported();
+		}
+	}
+	if (output.pos != header.size()) {
+		Unsupported();
+	}
+}
+
+void ArchiveReader::ReadStreamsInfo(std::vector<uint_least64_t>& stream_sizes, std::vector<uint_fast32_t>& stream_crcs)
+{
+	uint_least64_t pack_pos = 0;
+	std::vector<uint_least64_t> pack_sizes;
+	bool have_substreams = false;
+	for (;;) {
+		uint_least64_t id = ReadNumber();
+		if (id == kEnd) {
+			break;
+		}
+		switch (id) {
+		case kPackInfo:
+			pack_pos = ReadNumber();
+			ReadPackInfo(pack_sizes);
+			break;
+		case kUnpackInfo:
+			ReadUnpackInfo();
+			break;
+		case kSubStreamsInfo:
+			ReadSubStreamsInfo(stream_sizes, stream_crcs);
+			have_substreams = true;
+			break;
+		default:
+			Unsupported();
+		}
+	}
+	// Radyx writes one packed stream per unit, stored in order
+	if (pack_sizes.size() != units.size()) {
+		Unsupported();
+	}
+	pack_pos += kSignatureHeaderSize;
+	for (size_t i = 0; i < units.size(); ++i) {
+		units[i].pack_pos = pack_pos;
+		units[i].pack_size = pack_sizes[i];
+		pack_pos += pack_sizes[i];
+	}
+	if (!have_substreams) {
+		for (auto& unit : units) {
+			stream_sizes.push_back(unit.unpack_size);
+		}
+	}
+}
+
+void ArchiveReader::ReadPackInfo(std::vector<uint_least64_t>& pack_sizes)
+{
+	size_t count = static_cast<size_t>(ReadNumber());
+	for (;;) {
+		uint_least64_t id = ReadNumber();
+		if (id == kEnd) {
+			break;
+		}
+		if (id == kSize) {
+			pack_sizes.resize(count);
+			for (auto& size : pack_sizes) {
+				size = ReadNumber();
+			}
+		}
+		else if (id == kCRC) {
+			std::vector<bool> defined;
+			ReadDefined(count, defined);
+			for (bool d : defined) {
+				if (d) {
+					ReadUint32();
+				}
+			}
+		}
+		else {
+			Unsupported();
+		}
+	}
+}
+
+void ArchiveReader::ReadUnpackInfo()
+{
+	if (ReadNumber() != kFolder) {
+		Unsupported();
+	}
+	size_t count = static_cast<size_t>(ReadNumber());
+	if (count > header.size() || ReadByte() != 0) {
+		Unsupported();
+	}
+	units.resize(count);
+	for (auto& unit : units) {
+		uint_least64_t coder_count = ReadNumber();
+		if (coder_count != 1 && coder_count != 2) {
+			Unsupported();
+		}
+		ReadCoder(unit.coder_info);
+		if (unit.coder_info.method_id.method_id != kLzma2MethodId) {
+			Unsupported();
+		}
+		if (coder_count == 2) {
+			ReadCoder(unit.bcj_info);
+			// Bind pair from the encoder to BCJ
+			if (unit.bcj_info.method_id.method_id != kBcjMethodId || ReadNumber() != 1 || ReadNumber() != 0) {
+				Unsupported();
+			}
+			unit.used_bcj = true;
+		}
+	}
+	if (ReadNumber() != kCodersUnpackSize) {
+		Unsupported();
+	}
+	for (auto& unit : units) {
+		unit.unpack_size = ReadNumber();
+		if (unit.used_bcj && ReadNumber() != unit.unpack_size) {
+			Unsupported();
+		}
+	}
+	if (ReadNumber() != kEnd) {
+		Unsupported();
+	}
+}
+
+void ArchiveReader::ReadCoder(CoderInfo& coder_info)
+{
+	uint8_t flags = ReadByte();
+	// Alternative methods and reserved bits
+	if ((flags & 0xC0) != 0) {
+		Unsupported();
+	}
+	uint_least64_t method_id = 0;
+	for (unsigned i = flags & 0xF; i > 0; --i) {
+		method_id = (method_id << 8) | ReadByte();
+	}
+	if ((flags & 0x10) != 0 && (ReadNumber() != 1 || ReadNumber() != 1)) {
+		Unsupported();
+	}
+	std::basic_string<uint8_t> props;
+	if ((flags & 0x20) != 0) {
+		uint_least64_t size = ReadNumber();
+		if (size > header.size() - header_pos) {
+			Unsupported();
+		}
+		props.assign(header.data() + header_pos, static_cast<size_t>(size));
+		header_pos += static_cast<size_t>(size);
+	}
+	coder_info = CoderInfo(props.data(), static_cast<unsigned>(props.length()), method_id, 1, 1);
+}
+
+void ArchiveReader::ReadSubStreamsInfo(std::vector<uint_least64_t>& stream_sizes, std::vector<uint_fast32_t>& stream_crcs)
+{
+	uint_least64_t id = ReadNumber();
+	if (id == kNumUnpackStream) {
+		for (auto& unit : units) {
+			unit.file_count = ReadNumber();
+			if (unit.file_count == 0) {
+				Unsupported();
+			}
+		}
+		id = ReadNumber();
+	}
+	bool have_sizes = id == kSize;
+	for (auto& unit : units) {
+		uint_least64_t remaining = unit.unpack_size;
+		if (unit.file_count > 1 && !have_sizes) {
+			Unsupported();
+		}
+		// The last size is what remains of the unit
+		for (uint_least64_t i = 1; i < unit.file_count; ++i) {
+			uint_least64_t size = ReadNumber();
+			if (size > remaining) {
+				Unsupported();
+			}
+			stream_sizes.push_back(size);
+			remaining -= size;
+		}
+		stream_sizes.push_back(remaining);
+	}
+	if (have_sizes) {
+		id = ReadNumber();
+	}
+	for (; id != kEnd; id = ReadNumber()) {
+		if (id != kCRC) {
+			Unsupported();
+		}
+		std::vector<bool> defined;
+		ReadDefined(stream_sizes.size(), defined);
+		for (bool d : defined) {
+			// Radyx records the CRC of every file
+			if (!d) {
+				Unsupported();
+			}
+			stream_crcs.push_back(ReadUint32());
+		}
+	}
+	if (stream_crcs.size() != stream_sizes.size()) {
+		Unsupported();
+	}
+}
+
+void ArchiveReader::ReadFilesInfo(const std::vector<uint_least64_t>& stream_sizes, const std::vector<uint_fast32_t>& stream_crcs)
+{
+	size_t file_count = static_cast<size_t>(ReadNumber());
+	if (file_count > header.size()) {
+		Unsupported();
+	}
+	entries.resize(file_count);
+	std::vector<bool> empty_stream(file_count, false);
+	std::vector<bool> empty_file;
+	size_t empty_count = 0;
+	for (;;) {
+		uint_least64_t id = ReadNumber();
+		if (id == kEnd) {
+			break;
+		}
+		uint_least64_t size = ReadNumber();
+		switch (id) {
+		case kEmptyStream:
+			ReadBits(file_count, empty_stream);
+			empty_count = 0;
+			for (bool e : empty_stream) {
+				empty_count += e;
+			}
+			empty_file.assign(empty_count, false);
+			break;
+		case kEmptyFile:
+			ReadBits(empty_count, empty_file);
+			break;
+		case kAnti:
+			Unsupported();
+			break;
+		case kName:
+			ReadNames(size);
+			break;
+		case kCTime:
+			ReadOptionalAttribute(&Entry::creat_time, [this]() { return ReadUint64(); });
+			break;
+		case kMTime:
+			ReadOptionalAttribute(&Entry::mod_time, [this]() { return ReadUint64(); });
+			break;
+		case kWinAttributes:
+			ReadOptionalAttribute(&Entry::attributes, [this]() { return ReadUint32(); });
+			break;
+		default:
+			Skip(size);
+			break;
+		}
+	}
+	// Streams are assigned to the files with data in order
+	size_t stream = 0;
+	size_t unit = 0;
+	uint_least64_t unit_streams = 0;
+	size_t empty_index = 0;
+	for (size_t i = 0; i < file_count; ++i) {
+		Entry& entry = entries[i];
+		if (empty_stream[i]) {
+			// Radyx doesn't store directories
+			if (!empty_file[empty_index++]) {
+				Unsupported();
+			}
+			continue;
+		}
+		if (stream == stream_sizes.size()) {
+			Unsupported();
+		}
+		while (unit_streams == units[unit].file_count) {
+			++unit;
+			unit_streams = 0;
+		}
+		entry.size = stream_sizes[stream];
+		entry.crc32 = stream_crcs[stream];
+		entry.unit = unit;
+		++unit_streams;
+		++stream;
+	}
+	if (stream != stream_sizes.size()) {
+		Unsupported();
+	}
+}
+
+void ArchiveReader::ReadNames(uint_least64_t size)
+{
+	if (size == 0 || size > header.size() - header_pos || ReadByte() != 0) {
+		Unsupported();
+	}
+	std::u16string utf16name;
+	for (auto& entry : entries) {
+		utf16name.clear();
+		for (;;) {
+			if (header.size() - header_pos < 2) {
+				Unsupported();
+			}
+			char16_t c = static_cast<char16_t>(header[header_pos] | (header[header_pos + 1] << 8));
+			header_pos += 2;
+			if (c == 0) {
+				break;
+			}
+			utf16name.push_back(c);
+		}
+#ifdef _UNICODE
+		entry.name.assign(utf16name.begin(), utf16name.end());
+#elif defined HAVE_CODECVT
+		std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> converter;
+		entry.name = converter.to_bytes(utf16name);
+#else
+		entry.name.clear();
+		utf8::utf16to8(utf16name.begin(), utf16name.end(), std::back_inserter(entry.name));
+#endif
+	}
+}
+
+template<typename T, typename ReadFunc>
+void ArchiveReader::ReadOptionalAttribute(OptionalSetting<T> Entry::*member, ReadFunc read_func)
+{
+	std::vector<bool> defined;
+	ReadDefined(entries.size(), defined);
+	// External data
+	if (ReadByte() != 0) {
+		Unsupported();
+	}
+	for (size_t i = 0; i < entries.size(); ++i) {
+		if (defined[i]) {
+			(entries[i].*member).Set(static_cast<T>(read_func()));
+		}
+	}
+}
+
+void ArchiveReader::ReadBits(size_t count, std::vector<bool>& bits)
+{
+	bits.resize(count);
+	uint8_t mask = 0;
+	uint8_t value = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (mask == 0) {
+			value = ReadByte();
+			mask = 0x80;
+		}
+		bits[i] = (value & mask) != 0;
+		mask >>= 1;
+	}
+}
+
+void ArchiveReader::ReadDefined(size_t count, std::vector<bool>& defined)
+{
+	if (ReadByte() != 0) {
+		defined.assign(count, true);
+	}
+	else {
+		ReadBits(count, defined);
+	}
+}
+
+uint8_t ArchiveReader::ReadByte()
+{
+	if (header_pos >= header.size()) {
+		Unsupported();
+	}
+	return header[header_pos++];
+}
+
+uint_least64_t ArchiveReader::ReadNumber()
+{
+	CompressedUint64 value(header.data() + header_pos, header.size() - header_pos);
+	if (value.CheckEof()) {
+		Unsupported();
+	}
+	header_pos += value.GetSize();
+	return value;
+}
+
+uint_fast32_t ArchiveReader::ReadUint32()
+{
+	uint_fast32_t value = 0;
+	for (unsigned i = 0; i < 4; ++i) {
+		value |= static_cast<uint_fast32_t>(ReadByte()) << (8 * i);
+	}
+	return value;
+}
+
+uint_least64_t ArchiveReader::ReadUint64()
+{
+	uint_least64_t value = 0;
+	for (unsigned i = 0; i < 8; ++i) {
+		value |= static_cast<uint_least64_t>(ReadByte()) << (8 * i);
+	}
+	return value;
+}
+
+void ArchiveReader::Skip(uint_least64_t count)
+{
+	if (count > header.size() - header_pos) {
+		Unsupported();
+	}
+	header_pos += static_cast<size_t>(count);
+}
+
+void ArchiveReader::Unsupported() const
+{
+	throw IoException(Strings::kUnsupportedArchive, archive_path.c_str());
+}
+
+}
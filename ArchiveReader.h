@@ -0,0 +1,157 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: ArchiveReader
+//        Reads the database of an existing archive written by Radyx
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_ARCHIVE_READER_H
+#define RADYX_ARCHIVE_READER_H
+
+#include <fstream>
+#include <vector>
+#include "common.h"
+#include "CharType.h"
+#include "Path.h"
+#include "OptionalSetting.h"
+#include "CoderInfo.h"
+
+namespace Radyx {
+
+// Only the layout Radyx itself writes is accepted: a single volume, LZMA2
+// units with an optional BCJ filter, and no directories. Anything else
+// throws an IoException.
+class ArchiveReader
+{
+public:
+	struct Entry
+	{
+		FsString name;
+		uint_least64_t size;
+		OptionalSetting<uint_least64_t> creat_time;
+		OptionalSetting<uint_least64_t> mod_time;
+		OptionalSetting<uint_fast32_t> attributes;
+		uint_fast32_t crc32;
+		// Index of the unit holding the data, or kNoUnit if empty
+		size_t unit;
+		Entry()
+			: size(0),
+			creat_time(0),
+			mod_time(0),
+			attributes(0),
+			crc32(0),
+			unit(kNoUnit) {}
+	};
+
+	struct Unit
+	{
+		// Position of the packed stream in the archive file
+		uint_least64_t pack_pos;
+		uint_least64_t pack_size;
+		uint_least64_t unpack_size;
+		uint_least64_t file_count;
+		CoderInfo coder_info;
+		CoderInfo bcj_info;
+		bool used_bcj;
+		Unit()
+			: pack_pos(0),
+			pack_size(0),
+			unpack_size(0),
+			file_count(1),
+			used_bcj(false) {}
+	};
+
+	static const size_t kNoUnit = SIZE_MAX;
+
+	explicit ArchiveReader(const Path& archive_path_);
+	const Path& GetPath() const { return archive_path; }
+	const std::vector<Entry>& GetEntries() const { return entries; }
+	const std::vector<Unit>& GetUnits() const { return units; }
+
+private:
+	enum PropertyId
+	{
+		kEnd,
+		kHeader,
+		kArchiveProperties,
+		kAdditionalStreamsInfo,
+		kMainStreamsInfo,
+		kFilesInfo,
+		kPackInfo,
+		kUnpackInfo,
+		kSubStreamsInfo,
+		kSize,
+		kCRC,
+		kFolder,
+		kCodersUnpackSize,
+		kNumUnpackStream,
+		kEmptyStream,
+		kEmptyFile,
+		kAnti,
+		kName,
+		kCTime,
+		kATime,
+		kMTime,
+		kWinAttributes,
+		kComment,
+		kEncodedHeader,
+		kStartPos
+	};
+
+	static const unsigned kSignatureHeaderSize = 32;
+	static const uint_least64_t kLzma2MethodId = 0x21;
+	static const uint_least64_t kBcjMethodId = 0x3030103;
+	static const size_t kMaxHeaderSize = size_t(1) << 30;
+
+	void ReadArchive(uint_least64_t pos, uint8_t* buffer, size_t count);
+	void DecodeHeader();
+	void ReadStreamsInfo(std::vector<uint_least64_t>& stream_sizes, std::vector<uint_fast32_t>& stream_crcs);
+	void ReadPackInfo(std::vector<uint_least64_t>& pack_sizes);
+	void ReadUnpackInfo();
+	void ReadCoder(CoderInfo& coder_info);
+	void ReadSubStreamsInfo(std::vector<uint_least64_t>& stream_sizes, std::vector<uint_fast32_t>& stream_crcs);
+	void ReadFilesInfo(const std::vector<uint_least64_t>& stream_sizes, const std::vector<uint_fast32_t>& stream_crcs);
+	void ReadNames(uint_least64_t size);
+	template<typename T, typename ReadFunc>
+	void ReadOptionalAttribute(OptionalSetting<T> Entry::*member, ReadFunc read_func);
+	void ReadBits(size_t count, std::vector<bool>& bits);
+	void ReadDefined(size_t count, std::vector<bool>& defined);
+	uint8_t ReadByte();
+	uint_least64_t ReadNumber();
+	uint_fast32_t ReadUint32();
+	uint_least64_t ReadUint64();
+	void Skip(uint_least64_t count);
+	void Unsupported() const;
+
+	Path archive_path;
+	std::ifstream in_file;
+	std::vector<Entry> entries;
+	std::vector<Unit> units;
+	// Header bytes being parsed
+	std::vector<uint8_t> header;
+	size_t header_pos;
+
+	ArchiveReader(const ArchiveReader&) = delete;
+	ArchiveReader& operator=(const ArchiveReader&) = delete;
+};
+
+}
+
+#endif // RADYX_ARCHIVE_READER_H
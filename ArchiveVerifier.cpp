@@ -0,0 +1,307 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: ArchiveVerifier
+//        Decodes the units of a newly written archive and checks file CRCs
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include "ArchiveVerifier.h"
+#include "ThreadPool.h"
+#include "BcjX86.h"
+#include "VolumeWriter.h"
+#include "Journal.h"
+#include "RadyxOptions.h"
+#include "IoException.h"
+#include "Strings.h"
+#include "fast-lzma2/fl2_errors.h"
+
+namespace Radyx {
+
+ArchiveVerifier::ArchiveVerifier(const Path& archive_path_, uint_least64_t volume_size_, Tostream& messages_)
+	: archive_path(archive_path_),
+	volume_size(volume_size_),
+	messages(messages_),
+	volume_index(SIZE_MAX),
+	fds(FL2_createDStream()),
+	in_buffer(kInBufferSize),
+	out_buffer(kOutBufferSize),
+	unpacked_size(0)
+{
+	if (fds == nullptr) {
+		throw std::bad_alloc();
+	}
+}
+
+ArchiveVerifier::~ArchiveVerifier()
+{
+	FL2_freeDStream(fds);
+}
+
+bool ArchiveVerifier::Verify(const ArchiveCompressor& ar_comp)
+{
+	bool ok = true;
+	size_t index = 0;
+	for (auto& unit : ar_comp.GetUnitList()) {
+		ok &= VerifyUnit(unit, index++, nullptr);
+	}
+	return ok;
+}
+
+void ArchiveVerifier::ReadArchive(uint_least64_t pos, uint8_t* buffer, size_t count)
+{
+	while (count != 0) {
+		size_t index = volume_size != 0 ? static_cast<size_t>(pos / volume_size) : 0;
+		uint_least64_t volume_pos = pos - index * volume_size;
+		if (index != volume_index) {
+			in_file.close();
+			in_file.clear();
+			in_file.open(VolumeWriter::GetVolumeName(archive_path, volume_size, index).c_str(), std::ios_base::in | std::ios_base::binary);
+			volume_index = index;
+		}
+		size_t to_read = count;
+		if (volume_size != 0) {
+			to_read = static_cast<size_t>(std::min<uint_least64_t>(count, volume_size - volume_pos));
+		}
+		in_file.seekg(volume_pos);
+		in_file.read(reinterpret_cast<char*>(buffer), to_read);
+		if (!in_file) {
+			volume_index = SIZE_MAX;
+			throw IoException(Strings::kCannotReadArchive, archive_path.c_str());
+		}
+		pos += to_read;
+		buffer += to_read;
+		count -= to_read;
+	}
+}
+
+bool ArchiveVerifier::VerifyUnit(const ArchiveCompressor::DataUnit& unit, size_t index, const std::vector<uint8_t>& packed)
+{
+	return VerifyUnit(unit, index, &packed);
+}
+
+bool ArchiveVerifier::VerifyUnit(const ArchiveCompressor::DataUnit& unit, size_t index)
+{
+	return VerifyUnit(unit, index, nullptr);
+}
+
+bool ArchiveVerifier::VerifyUnit(const ArchiveCompressor::DataUnit& unit, size_t index, const std::vector<uint8_t>* packed)
+{
+	if (FL2_isError(FL2_initDStream_withProp(fds, unit.coder_info.props[0]))) {
+		messages << Strings::kDataErrorInUnit_ << index << std::endl;
+		return false;
+	}
+	BcjX86 bcj;
+	// Files are counted rather than compared with the entry after
+	// in_file_last, which the compressor may erase while this runs
+	auto file_it = unit.in_file_first;
+	uint_least64_t files_left = unit.file_count;
+	while (file_it->size == 0) {
+		++file_it;
+	}
+	uint_least64_t file_remaining = file_it->size;
+	Crc32 crc32;
+	bool ok = true;
+
+	uint_least64_t in_pos = unit.out_file_pos;
+	const uint_least64_t in_end = in_pos + unit.pack_size;
+	FL2_inBuffer input = { in_buffer.data(), 0, 0 };
+	if (packed != nullptr) {
+		// All input is available at once
+		input.src = packed->data();
+		input.size = packed->size();
+		in_pos = in_end;
+	}
+	FL2_outBuffer output = { out_buffer.data(), out_buffer.size(), 0 };
+	uint_least64_t unit_unpacked = 0;
+	for (;;) {
+		if (input.pos == input.size && in_pos < in_end) {
+			size_t count = static_cast<size_t>(std::min<uint_least64_t>(in_buffer.size(), in_end - in_pos));
+			ReadArchive(in_pos, in_buffer.data(), count);
+			in_pos += count;
+			input.size = count;
+			input.pos = 0;
+		}
+		size_t prev_out = output.pos;
+		size_t prev_in = input.pos;
+		size_t res = FL2_decompressStream(fds, &output, &input);
+		if (FL2_isError(res)) {
+			messages << Strings::kDataErrorInUnit_ << index << std::endl;
+			return false;
+		}
+		bool done = res == 0;
+		if (!done && output.pos == prev_out && input.pos == prev_in && in_pos == in_end) {
+			// Truncated stream
+			messages << Strings::kDataErrorInUnit_ << index << std::endl;
+			return false;
+		}
+		size_t avail = output.pos;
+		size_t ready = avail;
+		// Up to kMaxUnprocessed bytes at the end are held back until more data
+		// arrives, the same as when the filter was applied
+		if (unit.used_bcj && avail > BcjTransform::kMaxUnprocessed) {
+			size_t trim = bcj.Transform(out_buffer.data(), avail, false);
+			if (!done) {
+				ready -= trim;
+			}
+		}
+		else if (unit.used_bcj && !done) {
+			ready = 0;
+		}
+		// Check the CRC of each file as it completes
+		const uint8_t* data = out_buffer.data();
+		size_t remaining = ready;
+		unit_unpacked += ready;
+		while (remaining != 0 && files_left != 0) {
+			size_t count = static_cast<size_t>(std::min<uint_least64_t>(remaining, file_remaining));
+			crc32.Add(data, count);
+			data += count;
+			remaining -= count;
+			file_remaining -= count;
+			if (file_remaining == 0) {
+				if (crc32 != file_it->crc32) {
+					messages << Strings::kCrcFailed_ << file_it->dir << file_it->name << std::endl;
+					ok = false;
+				}
+				crc32 = Crc32();
+				if (--files_left != 0) {
+					do {
+						++file_it;
+					} while (file_it->size == 0);
+					file_remaining = file_it->size;
+				}
+			}
+		}
+		memmove(out_buffer.data(), out_buffer.data() + ready, avail - ready);
+		output.pos = avail - ready;
+		if (done) {
+			break;
+		}
+	}
+	unpacked_size += unit_unpacked;
+	if (unit_unpacked != unit.unpack_size || files_left != 0) {
+		messages << Strings::kDataErrorInUnit_ << index << std::endl;
+		return false;
+	}
+	return ok;
+}
+
+const size_t UnitVerifier::kMaxPending;
+
+UnitVerifier::UnitVerifier(Tostream& messages_, const Path& archive_path_, uint_least64_t volume_size_, Journal* journal_)
+	: messages(messages_),
+	archive_path(archive_path_),
+	volume_size(volume_size_),
+	journal(journal_),
+	unit_count(0)
+{
+}
+
+UnitVerifier::~UnitVerifier()
+{
+	// The tasks refer to the file list
+	for (auto& result : pending) {
+		result.wait();
+	}
+}
+
+void UnitVerifier::Submit(const ArchiveCompressor::DataUnit& unit, size_t index, std::vector<uint8_t>&& packed)
+{
+	// Results already available are taken so a failure stops compression
+	// as soon as possible
+	while (!pending.empty() && (pending.size() >= kMaxPending
+		|| pending.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready)) {
+		WaitOldest();
+	}
+	auto data = std::make_shared<std::vector<uint8_t>>(std::move(packed));
+	pending.push_back(ThreadPool::GetShared().SubmitFuture([this, unit, index, data]() {
+		return VerifyUnit(unit, index, *data);
+	}));
+	pending_units.push_back(unit);
+	++unit_count;
+}
+
+// Runs on the pool. Decoders are created only when none is free, so there
+// are never more than kMaxPending.
+std::pair<bool, FsString> UnitVerifier::VerifyUnit(const ArchiveCompressor::DataUnit& unit, size_t index, const std::vector<uint8_t>& packed)
+{
+	std::unique_ptr<Decoder> decoder;
+	{
+		std::lock_guard<std::mutex> lock(decoders_mtx);
+		if (!decoders.empty()) {
+			decoder = std::move(decoders.back());
+			decoders.pop_back();
+		}
+	}
+	if (!decoder) {
+		decoder.reset(new Decoder(archive_path, volume_size));
+	}
+	decoder->errors.str(FsString());
+	bool unit_ok;
+	try {
+		unit_ok = NeedsPackedData() ? decoder->verifier.VerifyUnit(unit, index, packed) : decoder->verifier.VerifyUnit(unit, index);
+	}
+	catch (IoException& e) {
+		decoder->errors << Strings::kErrorCol_ << e.Twhat() << std::endl;
+		unit_ok = false;
+	}
+	std::pair<bool, FsString> result(unit_ok, decoder->errors.str());
+	std::lock_guard<std::mutex> lock(decoders_mtx);
+	decoders.push_back(std::move(decoder));
+	return result;
+}
+
+void UnitVerifier::WaitOldest()
+{
+	auto result = std::move(pending.front());
+	pending.pop_front();
+	ArchiveCompressor::DataUnit unit = pending_units.front();
+	pending_units.pop_front();
+	auto unit_result = result.get();
+	messages << unit_result.second;
+	if (!unit_result.first) {
+		throw std::runtime_error(Strings::kVerifyFailed);
+	}
+	if (journal != nullptr) {
+		journal->AddUnit(unit);
+	}
+}
+
+void UnitVerifier::Finish()
+{
+	while (!pending.empty()) {
+		WaitOldest();
+	}
+}
+
+uint_least64_t UnitVerifier::GetCaptureUsage(const RadyxOptions& options, uint_least64_t total_bytes)
+{
+	uint_least64_t unit_size = std::min(options.solid_unit_size, total_bytes);
+	if (unit_size > UINT64_MAX / (kMaxPending + 1)) {
+		return UINT64_MAX;
+	}
+	return unit_size * (kMaxPending + 1);
+}
+
+}
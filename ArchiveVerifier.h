@@ -0,0 +1,137 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: ArchiveVerifier
+//        Decodes the units of a newly written archive and checks file CRCs
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_ARCHIVE_VERIFIER_H
+#define RADYX_ARCHIVE_VERIFIER_H
+
+#include <deque>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <utility>
+#include <vector>
+#include "common.h"
+#include "Path.h"
+#include "ArchiveCompressor.h"
+#include "fast-lzma2/fast-lzma2.h"
+
+namespace Radyx {
+
+class Journal;
+
+class ArchiveVerifier
+{
+public:
+	ArchiveVerifier(const Path& archive_path_, uint_least64_t volume_size_, Tostream& messages_);
+	~ArchiveVerifier();
+	// Decodes every unit in the archive and compares the file CRCs against those
+	// recorded while compressing. Errors are printed to messages and false is
+	// returned.
+	bool Verify(const ArchiveCompressor& ar_comp);
+	// Decodes one unit from its packed data in memory
+	bool VerifyUnit(const ArchiveCompressor::DataUnit& unit, size_t index, const std::vector<uint8_t>& packed);
+	// Decodes one unit from the archive
+	bool VerifyUnit(const ArchiveCompressor::DataUnit& unit, size_t index);
+	uint_least64_t GetUnpackedSize() const { return unpacked_size; }
+
+private:
+	static const size_t kInBufferSize = 1U << 20;
+	static const size_t kOutBufferSize = 4U << 20;
+
+	// Reads the packed data from the archive if packed is nullptr
+	bool VerifyUnit(const ArchiveCompressor::DataUnit& unit, size_t index, const std::vector<uint8_t>* packed);
+	void ReadArchive(uint_least64_t pos, uint8_t* buffer, size_t count);
+
+	Path archive_path;
+	uint_least64_t volume_size;
+	Tostream& messages;
+	std::ifstream in_file;
+	size_t volume_index;
+	FL2_DStream* fds;
+	std::vector<uint8_t> in_buffer;
+	std::vector<uint8_t> out_buffer;
+	uint_least64_t unpacked_size;
+
+	ArchiveVerifier(const ArchiveVerifier&) = delete;
+	ArchiveVerifier& operator=(const ArchiveVerifier&) = delete;
+};
+
+// Verifies units on the shared thread pool while the next ones are compressed.
+// The files of each unit must stay in the list until Finish returns. Units
+// which pass are recorded in the journal, if any, in order.
+class UnitVerifier
+{
+public:
+	// Units are read back from the archive, which must be flushed up to the
+	// end of each unit before it is submitted. If archive_path is empty, as
+	// for a sink, the packed data is passed to Submit and held in memory.
+	UnitVerifier(Tostream& messages_, const Path& archive_path_, uint_least64_t volume_size_, Journal* journal_);
+	~UnitVerifier();
+	bool NeedsPackedData() const { return archive_path.empty(); }
+	// Throws on the first unit found to be bad, once its errors are printed
+	void Submit(const ArchiveCompressor::DataUnit& unit, size_t index, std::vector<uint8_t>&& packed);
+	// Waits for all units, and throws if any is bad
+	void Finish();
+	size_t GetUnitCount() const { return unit_count; }
+	// Most memory taken by the packed data of the units in progress when it
+	// is held in memory, for total_bytes of input
+	static uint_least64_t GetCaptureUsage(const RadyxOptions& options, uint_least64_t total_bytes);
+
+private:
+	// Units verified at once. One more is captured while they run.
+	static const size_t kMaxPending = 2;
+
+	// A decoder and its buffers, kept for the next unit once a task is done
+	struct Decoder
+	{
+		std::basic_ostringstream<_TCHAR> errors;
+		ArchiveVerifier verifier;
+		Decoder(const Path& archive_path, uint_least64_t volume_size)
+			: verifier(archive_path, volume_size, errors) {}
+	};
+
+	void WaitOldest();
+	std::pair<bool, FsString> VerifyUnit(const ArchiveCompressor::DataUnit& unit, size_t index, const std::vector<uint8_t>& packed);
+
+	// Each task returns its result and any errors it printed, which are
+	// written to messages in unit order by the compressing thread
+	std::deque<std::future<std::pair<bool, FsString>>> pending;
+	std::deque<ArchiveCompressor::DataUnit> pending_units;
+	Tostream& messages;
+	Path archive_path;
+	uint_least64_t volume_size;
+	Journal* journal;
+	size_t unit_count;
+	std::mutex decoders_mtx;
+	std::vector<std::unique_ptr<Decoder>> decoders;
+
+	UnitVerifier(const UnitVerifier&) = delete;
+	UnitVerifier& operator=(const UnitVerifier&) = delete;
+};
+
+}
+
+#endif // RADYX_ARCHIVE_VERIFIER_H
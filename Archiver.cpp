@@ -0,0 +1,435 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: Archiver
+//        Creates or updates archives with one encoder, for the console
+//        program and for use as a library
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <cstdio>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#ifdef RADYX_RANDOM_TEST
+#include <chrono>
+#endif
+#include "winlean.h"
+#include "Archiver.h"
+#include "ArchiveCompressor.h"
+#include "ArchiveReader.h"
+#include "Container7z.h"
+#include "OutputFile.h"
+#include "IoException.h"
+#include "Strings.h"
+#include "Telemetry.h"
+#include "AutoTuner.h"
+#include "MemoryBudget.h"
+#include "Journal.h"
+#include "ArchiveVerifier.h"
+
+namespace Radyx {
+
+static const uint_least64_t kMinMemory = 512 * 1024 * 1024;
+
+static bool FileExists(const Path& path)
+{
+#ifdef _WIN32
+	return GetFileAttributes(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+#else
+	struct stat s;
+	return stat(path.c_str(), &s) == 0;
+#endif
+}
+
+// When updating, out_path is a temporary file which replaces the archive once complete.
+// When resuming, the existing archive is continued from resume_pos.
+static bool OpenOutputStream(const Path& archive_path,
+	const Path& out_path,
+	const RadyxOptions& options,
+	OutputFile& file_stream,
+	uint_least64_t avail_mem,
+	bool resuming,
+	uint_least64_t resume_pos)
+{
+	Tostream& messages = *options.messages;
+	bool is_dev_null = out_path.IsDevNull();
+	uint_least64_t volume_size = is_dev_null ? 0 : options.volume_size;
+	Path first_volume = VolumeWriter::GetVolumeName(out_path, volume_size, 0);
+	if (resuming) {
+		messages << Strings::kResumingArchive_ << archive_path.c_str() << std::endl;
+	}
+	else if (out_path == archive_path) {
+		if (!is_dev_null && FileExists(first_volume)) {
+			messages << Strings::kErrorCol_ << Strings::kArchiveFileExists << std::endl;
+			throw std::invalid_argument("");
+		}
+		messages << Strings::kCreatingArchive_ << archive_path.c_str() << std::endl;
+	}
+	else {
+		messages << Strings::kUpdatingArchive_ << archive_path.c_str() << std::endl;
+	}
+#ifdef _WIN32
+	bool no_caching = false;
+	if (avail_mem != 0) {
+		no_caching = (avail_mem < options.lzma2.dictionary_size ||
+			(avail_mem - options.lzma2.dictionary_size < kMinMemory));
+	}
+#else
+	(void)avail_mem;
+	bool no_caching = false;
+#endif
+	if (resuming) {
+		file_stream.Reopen(out_path.c_str(), resume_pos, no_caching);
+	}
+	else {
+		file_stream.open(out_path.c_str(), volume_size, no_caching);
+	}
+	if (file_stream.fail()) {
+		throw IoException(Strings::kCannotCreateArchive, first_volume.c_str());
+	}
+	return !is_dev_null;
+}
+
+static void RemoveArchive(const Path& archive_path, const RadyxOptions* options, OutputFile& file_stream)
+{
+	file_stream.close();
+	if (options == nullptr || options->volume_size == 0) {
+		_tremove(archive_path.c_str());
+		return;
+	}
+	for (size_t i = 0; i < file_stream.GetVolumeCount(); ++i) {
+		_tremove(VolumeWriter::GetVolumeName(archive_path, options->volume_size, i).c_str());
+	}
+}
+
+// The updated archive keeps the original's permissions and, where allowed,
+// its owner. ReplaceFile does this on Windows, including the ACL.
+static void ReplaceArchive(const Path& temp_path, const Path& archive_path)
+{
+#ifdef _WIN32
+	if (ReplaceFile(archive_path.c_str(), temp_path.c_str(), NULL, REPLACEFILE_IGNORE_MERGE_ERRORS, NULL, NULL) == FALSE
+		&& MoveFileEx(temp_path.c_str(), archive_path.c_str(), MOVEFILE_REPLACE_EXISTING) == FALSE)
+#else
+	struct stat s;
+	if (stat(archive_path.c_str(), &s) == 0) {
+		// Only root can give a file away, but the group may still be set.
+		// The mode is set afterwards because a change of owner can clear the
+		// set-id bits.
+		if (chown(temp_path.c_str(), s.st_uid, s.st_gid) != 0
+			&& chown(temp_path.c_str(), static_cast<uid_t>(-1), s.st_gid) != 0) {
+			// Left with the current user's ownership
+		}
+		chmod(temp_path.c_str(), s.st_mode & 07777);
+	}
+	if (rename(temp_path.c_str(), archive_path.c_str()) != 0)
+#endif
+	{
+		throw IoException(Strings::kCannotReplaceArchive, archive_path.c_str());
+	}
+}
+
+#ifdef RADYX_RANDOM_TEST
+
+// Decodes the archive in-process and prints the throughput for the current
+// random configuration
+static bool TestAndDeleteArchive(const Path& archive_path,
+    const RadyxOptions& options,
+    const ArchiveCompressor& ar_comp,
+    OutputFile& out_stream,
+    uint_least64_t packed,
+    std::chrono::steady_clock::time_point start)
+{
+    auto compress_end = std::chrono::steady_clock::now();
+    ArchiveVerifier verifier(archive_path, options.volume_size, *options.messages);
+    bool ok = verifier.Verify(ar_comp);
+    auto decode_end = std::chrono::steady_clock::now();
+    double unpacked_mb = verifier.GetUnpackedSize() / 1048576.0;
+    double compress_secs = std::chrono::duration<double>(compress_end - start).count();
+    double decode_secs = std::chrono::duration<double>(decode_end - compress_end).count();
+    fprintf(stderr, "Seed %u: %llu -> %llu bytes, compress %.2f MB/s, decode %.2f MB/s\n",
+        ar_comp.GetTestSeed(),
+        static_cast<unsigned long long>(verifier.GetUnpackedSize()),
+        static_cast<unsigned long long>(packed),
+        compress_secs > 0 ? unpacked_mb / compress_secs : 0.0,
+        decode_secs > 0 ? unpacked_mb / decode_secs : 0.0);
+    if (!ok) {
+        *options.messages << _T("Error") << std::endl;
+        return false;
+    }
+    RemoveArchive(archive_path, &options, out_stream);
+    return true;
+}
+
+#endif
+
+Archiver::LineBuffer::int_type Archiver::LineBuffer::overflow(int_type ch)
+{
+	if (traits_type::eq_int_type(ch, traits_type::eof())) {
+		return traits_type::not_eof(ch);
+	}
+	_TCHAR c = traits_type::to_char_type(ch);
+	if (c == '\n') {
+		listener->OnMessage(line.c_str());
+		line.clear();
+	}
+	// Carriage returns and backspaces only position text on the console
+	else if (c != '\r' && c != '\b') {
+		line.push_back(c);
+	}
+	return ch;
+}
+
+void Archiver::ProgressRelay::OnProgress(uint_least64_t done, uint_least64_t total)
+{
+	if (owner.listener != nullptr && !owner.listener->OnProgress(done, total)) {
+		owner.cancel.Set();
+	}
+}
+
+Archiver::Archiver(const RadyxOptions& options,
+	uint_least64_t memory_limit_,
+	uint_least64_t avail_mem_,
+	Listener* listener_,
+	const Cancellation* parent)
+	: encoder_options(options),
+	memory_limit(memory_limit_),
+	avail_mem(avail_mem_),
+	listener(listener_),
+	line_buffer(listener_),
+	listener_stream(&line_buffer),
+	messages(listener_ != nullptr ? &listener_stream : &std::Tcerr),
+	progress_relay(*this),
+	cancel(parent),
+	unit_comp(ApplyBudget(), cancel),
+	source(nullptr)
+{
+}
+
+RadyxOptions& Archiver::ApplyBudget()
+{
+	encoder_options.messages = messages;
+	MemoryBudget::Apply(encoder_options, memory_limit);
+	return encoder_options;
+}
+
+uint_least64_t Archiver::GetAvailableMemory()
+{
+#ifdef _WIN32
+	MEMORYSTATUSEX msx;
+	msx.dwLength = sizeof(msx);
+	if (GlobalMemoryStatusEx(&msx) == TRUE) {
+		return msx.ullAvailPhys;
+	}
+#endif
+	return 0;
+}
+
+bool Archiver::Create(RadyxOptions& options, const Path& archive_path)
+{
+	return Run(options, archive_path, nullptr);
+}
+
+bool Archiver::Create(RadyxOptions& options, OutputSink& sink)
+{
+	if (options.update || options.resume || options.volume_size != 0) {
+		*messages << Strings::kErrorCol_ << Strings::kSinkUnsupported << std::endl;
+		throw std::invalid_argument("");
+	}
+	return Run(options, Path(), &sink);
+}
+
+bool Archiver::Run(RadyxOptions& options, const Path& archive_path, OutputSink* sink)
+{
+	// The encoder was created for these
+	options.thread_count = encoder_options.thread_count;
+	options.async_read = encoder_options.async_read;
+	options.staged_read = encoder_options.staged_read;
+	options.huge_pages = encoder_options.huge_pages;
+	options.messages = messages;
+	if (listener != nullptr) {
+		options.show_progress = false;
+	}
+	if (source != nullptr) {
+		if (options.update || options.resume || options.auto_tune != RadyxOptions::kTuneOff) {
+			*messages << Strings::kErrorCol_ << Strings::kSourceUnsupported << std::endl;
+			throw std::invalid_argument("");
+		}
+		options.staged_read = false;
+	}
+	bool created_file = false;
+	Path out_path;
+	OutputFile out_stream;
+	Journal journal;
+	try {
+		unit_comp.SetOptions(options.lzma2);
+		ArchiveCompressor ar_comp(cancel, *messages);
+		if (source != nullptr) {
+			ar_comp.AddFromSource(*source);
+		}
+		else {
+			if (options.show_progress) {
+				*messages << Strings::kSearching;
+			}
+			options.GetFiles(ar_comp);
+			if (options.show_progress) {
+				for (size_t i = _tcslen(Strings::kSearching); i > 0; --i) {
+					*messages << '\b';
+				}
+			}
+		}
+		if (ar_comp.GetFileList().size() == 0) {
+			*messages << Strings::kNoFilesFound << std::endl;
+			return false;
+		}
+		ar_comp.PrepareFileList(options);
+		out_path = archive_path;
+		if (options.update && !archive_path.IsDevNull() && FileExists(archive_path)) {
+			ArchiveReader existing(archive_path);
+			ar_comp.Update(existing, options);
+			out_path += _T(".tmp");
+		}
+		// An interrupted -resume run left the archive and its journal
+		Path journal_path;
+		bool resuming = false;
+		uint_least64_t resume_pos = 0;
+		if (options.resume && !archive_path.IsDevNull()) {
+			journal_path = Journal::GetPath(archive_path);
+			if (FileExists(journal_path) && FileExists(archive_path)) {
+				// Without a usable journal the archive is treated as any
+				// existing file, and not overwritten
+				resuming = journal.Load(journal_path, archive_path);
+				if (resuming) {
+					resume_pos = ar_comp.Resume(journal, options);
+				}
+				else {
+					*messages << Strings::kIgnoringJournal_ << journal_path.c_str() << std::endl;
+				}
+			}
+		}
+		// Verifying units written to a sink keeps a copy of their packed data
+		bool capture = options.verify && (sink != nullptr || out_path.IsDevNull());
+		uint_least64_t limit = memory_limit;
+		if (capture && limit != 0) {
+			limit -= std::min(limit - 1, UnitVerifier::GetCaptureUsage(options, ar_comp.GetTotalBytes()));
+		}
+		// The options may ask for more than the limit allows
+		MemoryBudget::Fit(options, unit_comp, limit);
+		if (options.auto_tune != RadyxOptions::kTuneOff) {
+			AutoTuner tuner(options, unit_comp, limit);
+			tuner.Tune(ar_comp);
+			MemoryBudget::Fit(options, unit_comp, limit);
+		}
+		uint_least64_t output_mem = avail_mem - std::min(avail_mem, unit_comp.GetMemoryUsage());
+		Telemetry telemetry;
+		if (options.telemetry_path.length() != 0 && !telemetry.Open(options.telemetry_path.c_str(), options.telemetry_interval)) {
+			throw IoException(Strings::kCannotOpenTelemetry, options.telemetry_path.c_str());
+		}
+#ifdef RADYX_RANDOM_TEST
+		*messages << _T("Random file selector/tester") << std::endl;
+		for (int i = 0; i < 1000; ++i)
+#endif
+		{
+#ifdef RADYX_RANDOM_TEST
+			auto start = std::chrono::steady_clock::now();
+#endif
+			if (sink != nullptr) {
+				out_stream.open(*sink);
+			}
+			else {
+				created_file = OpenOutputStream(archive_path, out_path, options, out_stream, output_mem, resuming, resume_pos);
+			}
+			if (resume_pos == 0) {
+				Container7z::ReserveSignatureHeader(out_stream);
+			}
+			uint_least64_t packed = 0;
+			if (out_path != archive_path) {
+				packed += ar_comp.CopyKeptUnits(out_stream, archive_path);
+			}
+			if (journal_path.length() != 0) {
+				// Units kept from the previous run are recorded again
+				journal.Create(journal_path, out_stream, ar_comp.GetUnitList());
+			}
+			std::unique_ptr<UnitVerifier> verifier;
+			if (options.verify) {
+				verifier.reset(new UnitVerifier(*messages,
+					capture ? Path() : out_path,
+					options.volume_size,
+					journal_path.length() != 0 ? &journal : nullptr));
+			}
+			packed += ar_comp.Compress(unit_comp,
+				options,
+				out_stream,
+				telemetry.IsOpen() ? &telemetry : nullptr,
+				journal_path.length() != 0 ? &journal : nullptr,
+				verifier.get(),
+				&progress_relay);
+			if (ar_comp.GetFileList().size() == 0) {
+				// None of the files could be read
+				throw std::runtime_error("");
+			}
+			packed += Container7z::WriteDatabase(ar_comp, unit_comp, out_stream);
+			if (!created_file) {
+				*messages << "Compressed size: " << packed << " bytes" << std::endl;
+			}
+			out_stream.exceptions(std::ios_base::goodbit);
+			out_stream.close();
+			if (out_stream.fail()) {
+				throw IoException(Strings::kCannotWriteArchive,
+					out_stream.GetFailedError(),
+					out_stream.GetFailedName().c_str());
+			}
+			if (out_path != archive_path) {
+				ReplaceArchive(out_path, archive_path);
+			}
+			journal.Remove();
+			*messages << Strings::kDone << std::endl;
+#ifdef RADYX_RANDOM_TEST
+			if (!TestAndDeleteArchive(archive_path, options, ar_comp, out_stream, packed, start)) {
+				// Kept for examination
+				created_file = false;
+				throw std::runtime_error("");
+			}
+			ar_comp.RestoreFileList();
+#endif
+		}
+		return true;
+	}
+	catch (...) {
+		if (journal.GetUnitCount() != 0) {
+			// The completed units can be resumed
+			out_stream.close();
+			journal.Close();
+			*messages << Strings::kPartialArchiveKept << std::endl;
+		}
+		else if (created_file) {
+			journal.Remove();
+			RemoveArchive(out_path, &options, out_stream);
+		}
+		throw;
+	}
+}
+
+}
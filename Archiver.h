@@ -0,0 +1,137 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: Archiver
+//        Creates or updates archives with one encoder, for the console
+//        program and for use as a library
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_ARCHIVER_H
+#define RADYX_ARCHIVER_H
+
+#include <ostream>
+#include <streambuf>
+#include "common.h"
+#include "CharType.h"
+#include "Path.h"
+#include "RadyxOptions.h"
+#include "FastLzma2.h"
+#include "Progress.h"
+#include "Cancellation.h"
+#include "FileSource.h"
+#include "OutputSink.h"
+
+namespace Radyx {
+
+// The encoder is kept from one archive to the next, so an archiver may be
+// reused for many jobs but runs only one at a time.
+class Archiver
+{
+public:
+	// Called on the thread running Create
+	class Listener
+	{
+	public:
+		virtual ~Listener() {}
+		// One line of text without the line end
+		virtual void OnMessage(const _TCHAR* line) = 0;
+		// Returning false cancels the archive, which then stays cancelled
+		// until ClearCancel is called
+		virtual bool OnProgress(uint_least64_t done, uint_least64_t total) = 0;
+	};
+
+	// The encoder is created for the threads, dictionary and reading options,
+	// reduced to fit in memory_limit bytes if it is not 0. avail_mem is the
+	// free physical memory for this archiver, or 0 if unknown. Messages go to
+	// the listener if there is one, or to std::Tcerr. Setting parent cancels
+	// this archiver as well.
+	Archiver(const RadyxOptions& options,
+		uint_least64_t memory_limit_,
+		uint_least64_t avail_mem_,
+		Listener* listener_ = nullptr,
+		const Cancellation* parent = nullptr);
+	// Files are read from source instead of searching for the file specs.
+	// Pass nullptr to search again.
+	void SetSource(FileSource* source_) { source = source_; }
+	// Creates or updates an archive from the files in prepared options.
+	// Settings the encoder was created for are replaced by its own. Returns
+	// false if no files were found. Throws on error once an incomplete
+	// archive is removed, or kept if -resume recorded some of it.
+	bool Create(RadyxOptions& options, const Path& archive_path);
+	// Writes a new archive to sink
+	bool Create(RadyxOptions& options, OutputSink& sink);
+	// May be called from any thread, or from a signal handler
+	void Cancel() { cancel.Set(); }
+	void ClearCancel() { cancel.Reset(); }
+	bool IsCancelled() const { return cancel.IsSet(); }
+	// The stream messages are written to, for reporting errors in options
+	// before Create
+	Tostream& GetMessages() { return *messages; }
+	// Free physical memory, or 0 where it is not known
+	static uint_least64_t GetAvailableMemory();
+
+private:
+	// Passes messages to the listener a line at a time
+	class LineBuffer : public std::basic_streambuf<_TCHAR>
+	{
+	public:
+		explicit LineBuffer(Listener* listener_) : listener(listener_) {}
+
+	protected:
+		int_type overflow(int_type ch);
+
+	private:
+		Listener* listener;
+		FsString line;
+	};
+
+	class ProgressRelay : public Progress::Listener
+	{
+	public:
+		explicit ProgressRelay(Archiver& owner_) : owner(owner_) {}
+		void OnProgress(uint_least64_t done, uint_least64_t total);
+
+	private:
+		Archiver& owner;
+	};
+
+	// Fits the encoder options in the memory limit before the encoder is made
+	RadyxOptions& ApplyBudget();
+	bool Run(RadyxOptions& options, const Path& archive_path, OutputSink* sink);
+
+	RadyxOptions encoder_options;
+	uint_least64_t memory_limit;
+	uint_least64_t avail_mem;
+	Listener* listener;
+	LineBuffer line_buffer;
+	std::basic_ostream<_TCHAR> listener_stream;
+	Tostream* messages;
+	ProgressRelay progress_relay;
+	Cancellation cancel;
+	FastLzma2 unit_comp;
+	FileSource* source;
+
+	Archiver(const Archiver&) = delete;
+	Archiver& operator=(const Archiver&) = delete;
+};
+
+}
+
+#endif // RADYX_ARCHIVER_H
@@ -0,0 +1,254 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: AutoTuner
+//        Selects compression parameters by trial compression of a sample
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include "AutoTuner.h"
+#include "MemoryBudget.h"
+#include "Strings.h"
+#include "fast-lzma2/fl2_errors.h"
+
+namespace Radyx {
+
+#ifdef _WIN32
+static const _TCHAR kNullDevice[] = _T("nul");
+#else
+static const _TCHAR kNullDevice[] = _T("/dev/null");
+#endif
+
+// Candidate levels for the first pass. The level presets cover the dictionary
+// size, overlap and encoder strategy; the buffer log is refined afterwards.
+const unsigned AutoTuner::kLevels[] = { 1, 3, 5, 7, 9 };
+const size_t AutoTuner::kSampleSize;
+const size_t AutoTuner::kMinGroupSample;
+const size_t AutoTuner::kMaxFileSample;
+
+double AutoTuner::Trial::GetSpeed(size_t sample_size) const
+{
+	return seconds > 0.0 ? sample_size / 1048576.0 / seconds : 1e9;
+}
+
+AutoTuner::AutoTuner(RadyxOptions& options_, FastLzma2& enc_, uint_least64_t memory_limit_)
+	: options(options_),
+	enc(enc_),
+	memory_limit(memory_limit_)
+{
+}
+
+void AutoTuner::Tune(const ArchiveCompressor& ar_comp)
+{
+	ReadSample(ar_comp);
+	if (sample.empty()) {
+		return;
+	}
+	Tostream& messages = *options.messages;
+	if (options.show_progress) {
+		messages << Strings::kTuning;
+	}
+	// Pass 1: compression level
+	const Lzma2Options& base = options.lzma2;
+	for (unsigned level : kLevels) {
+		if (level > static_cast<unsigned>(FL2_maxCLevel())) {
+			break;
+		}
+		Trial trial(base);
+		trial.lzma2.compress_level = level;
+		RunTrial(trial);
+		trials.push_back(trial);
+	}
+	// Pass 2: buffer log either side of the preset for the chosen level
+	size_t best = SelectTrial();
+	if (!base.match_buffer_log.IsSet()) {
+		unsigned preset = trials[best].buffer_log;
+		for (unsigned buffer_log : { preset - 2, preset + 2 }) {
+			if (buffer_log < FL2_BUFFER_SIZE_LOG_MIN || buffer_log > FL2_BUFFER_SIZE_LOG_MAX) {
+				continue;
+			}
+			Trial trial(trials[best].lzma2);
+			trial.lzma2.match_buffer_log = buffer_log;
+			RunTrial(trial);
+			trials.push_back(trial);
+		}
+		best = SelectTrial();
+	}
+	if (options.show_progress) {
+		for (size_t i = _tcslen(Strings::kTuning); i > 0; --i) {
+			messages << '\b';
+		}
+	}
+	const Trial& chosen = trials[best];
+	options.lzma2 = chosen.lzma2;
+	enc.SetOptions(options.lzma2);
+	if (options.quiet_mode) {
+		return;
+	}
+	for (auto& trial : trials) {
+		char line[96];
+		snprintf(line, sizeof(line), "%c -mx%u -md%uk -mb%u : ratio %.3f, %.2f MB/s",
+			&trial == &chosen ? '*' : ' ',
+			trial.lzma2.compress_level,
+			static_cast<unsigned>(trial.dictionary_size >> 10),
+			trial.buffer_log,
+			trial.packed != 0 ? static_cast<double>(sample.size()) / trial.packed : 0.0,
+			trial.GetSpeed(sample.size()));
+		messages << line << std::endl;
+	}
+}
+
+void AutoTuner::ReadSample(const ArchiveCompressor& ar_comp)
+{
+	const auto& file_list = ar_comp.GetFileList();
+	uint_least64_t total = 0;
+	for (auto& fi : file_list) {
+		total += fi.size;
+	}
+	if (total == 0) {
+		return;
+	}
+	sample.reserve(static_cast<size_t>(std::min<uint_least64_t>(total, kSampleSize + kMinGroupSample * 8)));
+	// The list is sorted by extension group. Each group gets a share of the
+	// sample in proportion to its size, with a minimum so that small groups
+	// are represented.
+	auto first = file_list.begin();
+	while (first != file_list.end()) {
+		auto last = first;
+		uint_least64_t group_size = 0;
+		size_t file_count = 0;
+		for (; last != file_list.end() && last->ext_index == first->ext_index; ++last) {
+			group_size += last->size;
+			++file_count;
+		}
+		size_t budget = static_cast<size_t>(std::min<uint_least64_t>(group_size,
+			std::max<uint_least64_t>(kMinGroupSample, kSampleSize * group_size / total)));
+		AddGroupSample(first, last, file_count, group_size, budget);
+		first = last;
+	}
+}
+
+void AutoTuner::AddGroupSample(std::list<ArchiveCompressor::FileInfo>::const_iterator first,
+	std::list<ArchiveCompressor::FileInfo>::const_iterator last,
+	size_t file_count,
+	uint_least64_t group_size,
+	size_t budget)
+{
+	if (budget == 0) {
+		return;
+	}
+	// Take the start of files spread evenly through the group
+	uint_least64_t per_file = std::min<uint_least64_t>(group_size / file_count + 1, kMaxFileSample);
+	size_t wanted = static_cast<size_t>(std::max<uint_least64_t>(budget / per_file, 1));
+	size_t stride = std::max<size_t>(file_count / wanted, 1);
+	size_t index = 0;
+	for (auto it = first; it != last && budget != 0; ++it, ++index) {
+		if (index % stride != 0 || it->size == 0) {
+			continue;
+		}
+		ArchiveCompressor::FileReader reader(*it, options.share_deny_none, false);
+		if (!reader.IsValid()) {
+			continue;
+		}
+		size_t count = static_cast<size_t>(std::min<uint_least64_t>(std::min<uint_least64_t>(it->size, kMaxFileSample), budget));
+		size_t pos = sample.size();
+		sample.resize(pos + count);
+		unsigned long read_count = 0;
+		if (!reader.Read(sample.data() + pos, static_cast<uint_fast32_t>(count), read_count)) {
+			read_count = 0;
+		}
+		sample.resize(pos + read_count);
+		budget -= read_count;
+	}
+}
+
+void AutoTuner::RunTrial(Trial& trial)
+{
+	OutputFile null_out;
+	null_out.open(kNullDevice);
+	enc.SetOptions(trial.lzma2);
+	// Fitted before anything is allocated
+	MemoryBudget::Shrink(trial.lzma2, enc, memory_limit);
+	trial.dictionary_size = enc.GetDictionarySize();
+	trial.buffer_log = enc.GetBufferLog();
+	// The dictionary and tables of new options are allocated by the first
+	// Begin and buffer request, which are not timed
+	enc.Begin(false, FastLzma2::kUnknownSize);
+	unsigned long size;
+	uint8_t* dst = enc.GetAvailableBuffer(size);
+	auto start = std::chrono::steady_clock::now();
+	size_t pos = 0;
+	for (;;) {
+		size_t count = std::min<size_t>(size, sample.size() - pos);
+		memcpy(dst, sample.data() + pos, count);
+		pos += count;
+		enc.AddByteCount(count, null_out, nullptr);
+		if (pos >= sample.size()) {
+			break;
+		}
+		dst = enc.GetAvailableBuffer(size);
+	}
+	trial.packed = enc.Finalize(null_out, nullptr);
+	trial.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	null_out.close();
+}
+
+size_t AutoTuner::SelectTrial() const
+{
+	size_t best = 0;
+	if (options.auto_tune == RadyxOptions::kTuneSpeed) {
+		// Best ratio at or above the target speed, else the fastest
+		bool found = false;
+		for (size_t i = 0; i < trials.size(); ++i) {
+			bool fast_enough = trials[i].GetSpeed(sample.size()) >= options.tune_target;
+			if (fast_enough && (!found || trials[i].packed < trials[best].packed)) {
+				best = i;
+				found = true;
+			}
+			else if (!found && trials[i].GetSpeed(sample.size()) > trials[best].GetSpeed(sample.size())) {
+				best = i;
+			}
+		}
+	}
+	else {
+		// Fastest within the tolerance of the best ratio
+		uint_least64_t min_packed = trials[0].packed;
+		for (auto& trial : trials) {
+			min_packed = std::min(min_packed, trial.packed);
+		}
+		uint_least64_t limit = min_packed + min_packed * options.tune_target / 100;
+		bool found = false;
+		for (size_t i = 0; i < trials.size(); ++i) {
+			if (trials[i].packed <= limit
+				&& (!found || trials[i].GetSpeed(sample.size()) > trials[best].GetSpeed(sample.size())))
+			{
+				best = i;
+				found = true;
+			}
+		}
+	}
+	return best;
+}
+
+}
@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: AutoTuner
+//        Selects compression parameters by trial compression of a sample
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_AUTO_TUNER_H
+#define RADYX_AUTO_TUNER_H
+
+#include <vector>
+#include "common.h"
+#include "RadyxOptions.h"
+#include "ArchiveCompressor.h"
+#include "FastLzma2.h"
+
+namespace Radyx {
+
+class AutoTuner
+{
+public:
+	// Each trial's dictionary is reduced to fit in memory_limit_ if it is not 0
+	AutoTuner(RadyxOptions& options_, FastLzma2& enc_, uint_least64_t memory_limit_);
+	// Compresses a sample of the file list with each candidate configuration,
+	// then stores the one best meeting the target in options.lzma2 and applies
+	// it to the encoder
+	void Tune(const ArchiveCompressor& ar_comp);
+
+private:
+	static const size_t kSampleSize = 32U << 20;
+	static const size_t kMinGroupSample = 256U << 10;
+	static const size_t kMaxFileSample = 1U << 20;
+	static const unsigned kLevels[];
+
+	struct Trial
+	{
+		Lzma2Options lzma2;
+		size_t dictionary_size;
+		unsigned buffer_log;
+		uint_least64_t packed;
+		double seconds;
+		Trial(const Lzma2Options& lzma2_)
+			: lzma2(lzma2_),
+			dictionary_size(0),
+			buffer_log(0),
+			packed(0),
+			seconds(0.0) {}
+		double GetSpeed(size_t sample_size) const;
+	};
+
+	void ReadSample(const ArchiveCompressor& ar_comp);
+	void AddGroupSample(std::list<ArchiveCompressor::FileInfo>::const_iterator first,
+		std::list<ArchiveCompressor::FileInfo>::const_iterator last,
+		size_t file_count,
+		uint_least64_t group_size,
+		size_t budget);
+	void RunTrial(Trial& trial);
+	size_t SelectTrial() const;
+
+	RadyxOptions& options;
+	FastLzma2& enc;
+	uint_least64_t memory_limit;
+	std::vector<uint8_t> sample;
+	std::vector<Trial> trials;
+
+	AutoTuner(const AutoTuner&) = delete;
+	AutoTuner& operator=(const AutoTuner&) = delete;
+};
+
+}
+
+#endif // RADYX_AUTO_TUNER_H
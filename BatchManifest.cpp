@@ -0,0 +1,124 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: BatchManifest
+//        Reads the list of archive jobs for the b command
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include "winlean.h"
+#include "BatchManifest.h"
+#include "MappedFile.h"
+#include "IoException.h"
+#include "Strings.h"
+
+namespace Radyx {
+
+BatchManifest::BatchManifest(const _TCHAR* path)
+{
+	MappedFile in(path);
+	if (!in.IsValid()) {
+		throw IoException(Strings::kCannotOpenManifest, path);
+	}
+	const char* first = in.GetData();
+	const char* end = first + in.GetSize();
+	if (end - first >= 3 && memcmp(first, "\xEF\xBB\xBF", 3) == 0) {
+		first += 3;
+	}
+	for (size_t line = 1; first < end; ++line) {
+		const char* line_end = static_cast<const char*>(memchr(first, '\n', end - first));
+		if (line_end == nullptr) {
+			line_end = end;
+		}
+		const char* next = line_end + (line_end != end);
+		while (line_end > first && (line_end[-1] == '\r' || line_end[-1] == ' ' || line_end[-1] == '\t')) {
+			--line_end;
+		}
+		while (first < line_end && (*first == ' ' || *first == '\t')) {
+			++first;
+		}
+		if (first < line_end && *first != '#') {
+			Job job;
+			job.line = line;
+			if (!ParseLine(first, line_end, job.args)) {
+				std::Tcerr << Strings::kErrorCol_ << Strings::kBadManifestLine_ << line << std::endl;
+				throw std::invalid_argument("");
+			}
+			jobs.push_back(std::move(job));
+		}
+		first = next;
+	}
+}
+
+// Splits a line at spaces outside double quotes. Returns false if a quote is
+// not closed or an argument is not valid UTF-8.
+bool BatchManifest::ParseLine(const char* first, const char* last, std::vector<FsString>& args)
+{
+	std::string arg;
+	bool in_arg = false;
+	bool quoted = false;
+	for (; first < last; ++first) {
+		char c = *first;
+		if (c == '"') {
+			quoted = !quoted;
+			in_arg = true;
+		}
+		else if (!quoted && (c == ' ' || c == '\t')) {
+			if (in_arg && !AddArg(arg, args)) {
+				return false;
+			}
+			arg.clear();
+			in_arg = false;
+		}
+		else {
+			arg.push_back(c);
+			in_arg = true;
+		}
+	}
+	if (quoted) {
+		return false;
+	}
+	return !in_arg || AddArg(arg, args);
+}
+
+bool BatchManifest::AddArg(const std::string& arg, std::vector<FsString>& args)
+{
+#ifdef _UNICODE
+	FsString warg(arg.length() + 1, L'\0');
+	int len = MultiByteToWideChar(CP_UTF8,
+		MB_ERR_INVALID_CHARS,
+		arg.data(),
+		static_cast<int>(arg.length()),
+		&warg[0],
+		static_cast<int>(warg.length()));
+	if (len == 0 && !arg.empty()) {
+		return false;
+	}
+	warg.resize(len);
+	args.push_back(warg);
+#else
+	args.push_back(arg);
+#endif
+	return true;
+}
+
+}
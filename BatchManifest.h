@@ -0,0 +1,62 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: BatchManifest
+//        Reads the list of archive jobs for the b command
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_BATCH_MANIFEST_H
+#define RADYX_BATCH_MANIFEST_H
+
+#include <vector>
+#include "common.h"
+#include "CharType.h"
+
+namespace Radyx {
+
+// Each line of a manifest is a job written as the arguments to radyx would
+// be on the command line, e.g. a -mx9 backup.7z -r data/*. Arguments which
+// contain spaces are enclosed in double quotes. Blank lines and lines
+// beginning with '#' are skipped. The file is UTF-8.
+class BatchManifest
+{
+public:
+	struct Job
+	{
+		// Line number in the manifest
+		size_t line;
+		std::vector<FsString> args;
+	};
+
+	// Throws IoException if the file can't be read, or prints the line and
+	// throws std::invalid_argument if a line is malformed
+	explicit BatchManifest(const _TCHAR* path);
+	const std::vector<Job>& GetJobs() const { return jobs; }
+
+private:
+	static bool ParseLine(const char* first, const char* last, std::vector<FsString>& args);
+	static bool AddArg(const std::string& arg, std::vector<FsString>& args);
+
+	std::vector<Job> jobs;
+};
+
+}
+
+#endif // RADYX_BATCH_MANIFEST_H
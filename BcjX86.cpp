@@ -41,6 +41,9 @@ BcjX86::BcjX86()
 
 size_t BcjX86::Transform(uint8_t* data_block, size_t end, bool encoding)
 {
+    // The scan below assumes at least one complete instruction
+    if (end <= kMaxUnprocessed)
+        return end;
     if (encoding)
         return Transform<true>(data_block, end);
     else
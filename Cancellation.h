@@ -0,0 +1,58 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: Cancellation
+//        Flag which stops an archive job from another thread
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_CANCELLATION_H
+#define RADYX_CANCELLATION_H
+
+#include <atomic>
+
+namespace Radyx {
+
+// Each job has its own flag. A job is also stopped if its parent is set,
+// which lets the console's break signal stop every job in a batch. Set is
+// lock-free so it may be called from a signal handler.
+class Cancellation
+{
+public:
+	explicit Cancellation(const Cancellation* parent_ = nullptr)
+		: parent(parent_),
+		flag(false) {}
+	void Set() { flag.store(true); }
+	void Reset() { flag.store(false); }
+	bool IsSet() const
+	{
+		return flag.load(std::memory_order_relaxed) || (parent != nullptr && parent->IsSet());
+	}
+
+private:
+	const Cancellation* parent;
+	std::atomic<bool> flag;
+
+	Cancellation(const Cancellation&) = delete;
+	Cancellation& operator=(const Cancellation&) = delete;
+};
+
+}
+
+#endif // RADYX_CANCELLATION_H
@@ -49,13 +49,21 @@ namespace Radyx {
 #define _tcslen strlen
 #define _tcschr strchr
 #define _tcsrchr strrchr
+#define _tcscmp strcmp
 #define _tcsicmp strcasecmp
 #define _tcstoul strtoul
 #define _tcscpy_s strcpy_s
 #define _stprintf_s sprintf_s
 #define _tremove remove
+#define _tfopen fopen
 #define _T(x) x
 
 #endif // _UNICODE
 
+#include <iosfwd>
+
+namespace Radyx {
+	typedef std::basic_ostream<_TCHAR> Tostream;
+}
+
 #endif // RADYX_CHAR_TYPE
\ No newline at end of file
@@ -27,6 +27,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <array>
+#include <functional>
 #if (defined __GNUC__ && __GNUC__ >= 5) || (defined __clang_major__ && (__clang_major__ * 100 + __clang_minor__) >= 303)
 #define HAVE_CODECVT
 #include <codecvt>
@@ -38,6 +39,7 @@
 #include "CompressedUint64.h"
 #include "Crc32.h"
 #include "IoException.h"
+#include "Profiler.h"
 #include "Strings.h"
 
 namespace Radyx {
@@ -49,7 +51,7 @@ Container7z::Writer::Writer(FastLzma2& unit_comp_, OutputStream& out_stream_, bo
     out_stream(out_stream_),
     compress(compress_)
 {
-    unit_comp_.Begin(false);
+    unit_comp_.Begin(false, FastLzma2::kUnknownSize);
 }
 
 void Container7z::Writer::WriteName(const FsString& name, size_t root)
@@ -263,6 +265,7 @@ uint_least64_t Container7z::WriteDatabase(const ArchiveCompressor& arch_comp,
 	FastLzma2& unit_comp,
 	OutputStream& out_stream)
 {
+	Profiler::ScopedTimer timer(Profiler::kWriteHeader);
 	out_stream.exceptions(std::ios_base::failbit | std::ios_base::badbit);
 	uint_least64_t packed_size = 0;
 	try {
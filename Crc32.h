@@ -31,8 +31,10 @@ class Crc32
 {
 public:
 	Crc32() : crc32(0xFFFFFFFF) {}
+	// A finished value, such as one read from an archive
+	explicit Crc32(uint_fast32_t value) : crc32(value ^ 0xFFFFFFFF) {}
 	inline void Add(uint8_t byte);
-	inline void Add(uint8_t* buffer, size_t count);
+	inline void Add(const uint8_t* buffer, size_t count);
 	operator uint_fast32_t() const { return crc32 ^ 0xFFFFFFFF; }
 	static uint_fast32_t GetHash(uint8_t byte) { return crc_table[byte]; }
 
@@ -54,7 +56,7 @@ void Crc32::Add(uint8_t byte)
 	crc32 = crc_table[(crc32 ^ byte) & 0xFF] ^ (crc32 >> 8);
 }
 
-void Crc32::Add(uint8_t* buffer, size_t count)
+void Crc32::Add(const uint8_t* buffer, size_t count)
 {
 	for (size_t i = 0; i < count; ++i) {
 		Add(buffer[i]);
@@ -25,9 +25,13 @@
 #include <algorithm>
 #include <cstring>
 #include "common.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 #include "FastLzma2.h"
 #include "IoException.h"
 #include "Strings.h"
+#include "Profiler.h"
 #include "fast-lzma2/fl2_errors.h"
 
 namespace Radyx {
@@ -40,17 +44,28 @@ static unsigned ValueToLog(size_t value, unsigned min_bits)
     return bits;
 }
 
-FastLzma2::FastLzma2(RadyxOptions& options)
+const uint_least64_t FastLzma2::kUnknownSize;
+const size_t FastLzma2::kSmallUnitSize;
+const uintptr_t FastLzma2::kHugePageSize;
+
+FastLzma2::FastLzma2(RadyxOptions& options, const Cancellation& cancel_)
+    : cancel(cancel_),
+    small_fcs(nullptr),
+    timeout(0),
+    huge_pages(options.huge_pages),
+    capture(false)
 {
-    fcs = FL2_createCStreamMt(options.thread_count, options.async_read);
-    if (fcs == nullptr)
+    main_fcs = FL2_createCStreamMt(options.thread_count, options.async_read);
+    if (main_fcs == nullptr)
         throw std::bad_alloc();
+    fcs = main_fcs;
     SetOptions(options.lzma2);
 }
 
 FastLzma2::~FastLzma2()
 {
-	FL2_freeCCtx(fcs);
+	FL2_freeCCtx(main_fcs);
+	FL2_freeCCtx(small_fcs);
 }
 
 #ifdef RADYX_RANDOM_TEST
@@ -69,10 +84,10 @@ static void ReportError(size_t)
 
 #endif
 
-void FastLzma2::SetOptions(Lzma2Options & lzma2)
+static void ApplyOptions(FL2_CStream* fcs, const Lzma2Options& lzma2)
 {
-    if (lzma2.encoder_mode == 3)
-        ReportError(FL2_CStream_setParameter(fcs, FL2_p_highCompression, 1));
+    // Always set so that a new configuration can turn high compression off again
+    ReportError(FL2_CStream_setParameter(fcs, FL2_p_highCompression, lzma2.encoder_mode == 3));
     ReportError(FL2_CStream_setParameter(fcs, FL2_p_compressionLevel, lzma2.compress_level));
     if (lzma2.dictionary_size.IsSet())
         ReportError(FL2_CStream_setParameter(fcs, FL2_p_dictionarySize, lzma2.dictionary_size));
@@ -101,13 +116,63 @@ void FastLzma2::SetOptions(Lzma2Options & lzma2)
     ReportError(FL2_CStream_setParameter(fcs, FL2_p_doXXHash, 0));
 }
 
+void FastLzma2::SetOptions(Lzma2Options & lzma2)
+{
+    ApplyOptions(main_fcs, lzma2);
+    small_options = lzma2;
+    small_options.dictionary_size = kSmallUnitSize;
+    if (small_fcs != nullptr)
+        ConfigureSmall();
+}
+
+void FastLzma2::ConfigureSmall()
+{
+    ApplyOptions(small_fcs, small_options);
+    FL2_setCStreamTimeout(small_fcs, timeout);
+}
+
+size_t FastLzma2::GetMemoryUsage() const
+{
+    size_t size = FL2_estimateCStreamSize_usingCStream(main_fcs);
+    if (small_fcs != nullptr)
+        size += FL2_estimateCStreamSize_usingCStream(small_fcs);
+    return size;
+}
+
+size_t FastLzma2::EstimateMemoryUsage(const RadyxOptions& options, size_t& dictionary_size)
+{
+    FL2_CStream* probe = FL2_createCStreamMt(options.thread_count, options.async_read);
+    if (probe == nullptr)
+        throw std::bad_alloc();
+    ApplyOptions(probe, options.lzma2);
+    size_t size = FL2_estimateCStreamSize_usingCStream(probe);
+    dictionary_size = FL2_CStream_getParameter(probe, FL2_p_dictionarySize);
+    FL2_freeCStream(probe);
+    return size;
+}
+
 void FastLzma2::SetTimeout(unsigned ms)
 {
-    FL2_setCStreamTimeout(fcs, ms);
+    timeout = ms;
+    FL2_setCStreamTimeout(main_fcs, ms);
+    if (small_fcs != nullptr)
+        FL2_setCStreamTimeout(small_fcs, ms);
 }
 
-void FastLzma2::Begin(bool do_bcj)
+void FastLzma2::Begin(bool do_bcj, uint_least64_t size_hint)
 {
+    fcs = main_fcs;
+    // Initializing the multithreaded context for a large dictionary costs far
+    // more than encoding a small file, so tiny units use their own context.
+    if (size_hint <= kSmallUnitSize && GetDictionarySize() > kSmallUnitSize) {
+        if (small_fcs == nullptr) {
+            small_fcs = FL2_createCStreamMt(1, 0);
+            if (small_fcs == nullptr)
+                throw std::bad_alloc();
+            ConfigureSmall();
+        }
+        fcs = small_fcs;
+    }
 	unpack_size = 0;
 	pack_size = 0;
 	if (do_bcj) {
@@ -121,6 +186,7 @@ void FastLzma2::Begin(bool do_bcj)
 	else bcj.reset(nullptr);
     CheckError(FL2_initCStream(fcs, 0));
     CheckError(FL2_getDictionaryBuffer(fcs, &dict));
+    AdviseHugePages();
     dict_pos = 0;
     bcj_trim = 0;
 }
@@ -131,17 +197,28 @@ uint8_t* FastLzma2::GetAvailableBuffer(unsigned long& size)
     return reinterpret_cast<uint8_t*>(dict.dst) + dict_pos;
 }
 
+void FastLzma2::ReportProgress(Progress* progress)
+{
+    progress->Update(FL2_getCStreamProgress(fcs, nullptr), pack_size);
+}
+
 size_t FastLzma2::WaitAndReport(size_t res, Progress* progress)
 {
+    bool timing = progress != nullptr && progress->IsTiming() && FL2_isTimedOut(res);
+    Telemetry::Clock::time_point wait_start;
+    if (timing)
+        wait_start = Telemetry::Clock::now();
     while (FL2_isTimedOut(res)) {
-        if (g_break) {
+        if (cancel.IsSet()) {
             FL2_cancelCStream(fcs);
             throw std::runtime_error(Strings::kBreakSignaled);
         }
         if(progress)
-            progress->Update(FL2_getCStreamProgress(fcs, nullptr));
+            ReportProgress(progress);
         res = FL2_waitCStream(fcs);
     }
+    if (timing)
+        progress->AddWaitTime(std::chrono::duration_cast<std::chrono::nanoseconds>(Telemetry::Clock::now() - wait_start).count());
     CheckError(res);
     return res;
 }
@@ -151,6 +228,7 @@ void FastLzma2::AddByteCount(size_t count, OutputStream & out_stream, Progress*
     dict_pos += count;
     if (dict_pos == dict.size) {
         if (bcj) {
+            Profiler::ScopedTimer timer(Profiler::kBcj);
             uint8_t* dst = reinterpret_cast<uint8_t*>(dict.dst);
             bcj_trim = bcj->Transform(dst, dict_pos, true);
             if (bcj_trim != 0) {
@@ -159,8 +237,12 @@ void FastLzma2::AddByteCount(size_t count, OutputStream & out_stream, Progress*
             }
         }
         unpack_size += dict_pos;
-        size_t res = FL2_updateDictionary(fcs, dict_pos);
-        res = WaitAndReport(res, progress);
+        size_t res;
+        {
+            Profiler::ScopedTimer timer(Profiler::kCompress);
+            res = FL2_updateDictionary(fcs, dict_pos);
+            res = WaitAndReport(res, progress);
+        }
         if (res != 0)
             WriteBuffers(out_stream);
         if (bcj_trim != 0) {
@@ -174,6 +256,7 @@ void FastLzma2::AddByteCount(size_t count, OutputStream & out_stream, Progress*
             res = FL2_getDictionaryBuffer(fcs, &dict);
         } while (FL2_isTimedOut(res));
         CheckError(res);
+        AdviseHugePages();
         dict_pos = 0;
         if (bcj_trim != 0) {
             dict_pos = bcj_trim;
@@ -182,7 +265,22 @@ void FastLzma2::AddByteCount(size_t count, OutputStream & out_stream, Progress*
         }
     }
     if (progress)
-        progress->Update(FL2_getCStreamProgress(fcs, nullptr));
+        ReportProgress(progress);
+}
+
+// Asks for the dictionary buffer to be backed by transparent huge pages. Only
+// pages not yet touched are affected, so this is done whenever a buffer is
+// handed out and before data is read into it. Failure is harmless.
+void FastLzma2::AdviseHugePages()
+{
+#ifdef MADV_HUGEPAGE
+    if (!huge_pages)
+        return;
+    uintptr_t start = (reinterpret_cast<uintptr_t>(dict.dst) + kHugePageSize - 1) & ~(kHugePageSize - 1);
+    uintptr_t end = (reinterpret_cast<uintptr_t>(dict.dst) + dict.size) & ~(kHugePageSize - 1);
+    if (end > start)
+        madvise(reinterpret_cast<void*>(start), end - start, MADV_HUGEPAGE);
+#endif
 }
 
 void FastLzma2::CheckError(size_t res)
@@ -199,19 +297,24 @@ void FastLzma2::CheckError(size_t res)
 
 void FastLzma2::WriteBuffers(OutputStream& out_stream)
 {
+    Profiler::ScopedTimer timer(Profiler::kWriteBuffers);
     size_t csize;
     for (;;) {
         FL2_cBuffer cbuf;
         // Waits if compression in progress
         csize = FL2_getNextCStreamBuffer(fcs, &cbuf);
         CheckError(csize);
-        if (g_break)
+        if (cancel.IsSet())
             throw std::runtime_error(Strings::kBreakSignaled);
         if (csize == 0)
             break;
         out_stream.write(reinterpret_cast<const char*>(cbuf.src), cbuf.size);
         if (out_stream.fail())
             throw IoException(Strings::kCannotWriteArchive, _T(""));
+        if (capture) {
+            const uint8_t* src = static_cast<const uint8_t*>(cbuf.src);
+            captured.insert(captured.end(), src, src + cbuf.size);
+        }
         pack_size += csize;
     }
 }
@@ -226,15 +329,23 @@ uint_least64_t FastLzma2::Finalize(OutputStream& out_stream, Progress* progress)
 {
     if (dict_pos) {
         unpack_size += dict_pos;
-        if (bcj)
+        if (bcj) {
+            Profiler::ScopedTimer timer(Profiler::kBcj);
             bcj->Transform(reinterpret_cast<uint8_t*>(dict.dst), dict_pos, true);
+        }
+        Profiler::ScopedTimer timer(Profiler::kCompress);
         WaitAndReport(FL2_updateDictionary(fcs, dict_pos), progress);
     }
 
-    size_t res = FL2_endStream(fcs, nullptr);
-    res = WaitAndReport(res, progress);
+    size_t res;
+    {
+        Profiler::ScopedTimer timer(Profiler::kCompress);
+        res = FL2_endStream(fcs, nullptr);
+        res = WaitAndReport(res, progress);
+    }
     while (res) {
         WriteBuffers(out_stream);
+        Profiler::ScopedTimer timer(Profiler::kCompress);
         res = FL2_endStream(fcs, nullptr);
         res = WaitAndReport(res, progress);
     }
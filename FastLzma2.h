@@ -25,13 +25,14 @@
 #ifndef RADYX_UNIT_COMPRESSOR_H
 #define RADYX_UNIT_COMPRESSOR_H
 
+#include <vector>
 #include "common.h"
 #include "OutputFile.h"
-#include "Thread.h"
 #include "RadyxOptions.h"
 #include "BcjX86.h"
 #include "Progress.h"
 #include "ErrorCode.h"
+#include "Cancellation.h"
 #include "fast-lzma2/fast-lzma2.h"
 
 namespace Radyx {
@@ -39,11 +40,19 @@ namespace Radyx {
 class FastLzma2
 {
 public:
-	FastLzma2(RadyxOptions& options);
+	// Passed to Begin when the amount of data in the unit is not known
+	static const uint_least64_t kUnknownSize = UINT64_MAX;
+	// Largest unit encoded with the small context
+	static const size_t kSmallUnitSize = size_t(1) << FL2_DICTLOG_MIN;
+
+	// Compression stops with an exception once cancel is set
+	FastLzma2(RadyxOptions& options, const Cancellation& cancel_);
 	~FastLzma2();
     void SetOptions(Lzma2Options& lzma2);
     void SetTimeout(unsigned ms);
-	void Begin(bool do_bcj);
+	// Units no larger than the small dictionary are encoded with a separate
+	// single-threaded context, which is much cheaper to initialize
+	void Begin(bool do_bcj, uint_least64_t size_hint);
     uint8_t* GetAvailableBuffer(unsigned long& size);
     void AddByteCount(size_t count, OutputStream& out_stream, Progress* progress);
     CoderInfo GetCoderInfo();
@@ -51,24 +60,46 @@ public:
     void IncBufferCount(OutputStream& out_stream);
     void Write(OutputStream& out_stream);
     void Cancel();
+    // Keeps a copy of the packed data written, to be taken after each unit
+    void CapturePackedData(bool enable) { capture = enable; captured.clear(); }
+    std::vector<uint8_t> TakePackedData() { std::vector<uint8_t> data; data.swap(captured); return data; }
     uint_least64_t GetUnpackSize() const { return unpack_size; }
     uint_least64_t GetPackSize() const { return pack_size; }
 	bool UsedBcj() const { return bcj.get() != nullptr; }
 	CoderInfo GetBcjCoderInfo() const { return bcj->GetCoderInfo(); }
-	size_t GetMemoryUsage() const { return FL2_estimateCStreamSize_usingCStream(fcs); }
+	size_t GetMemoryUsage() const;
+	// Estimates usage for the options without allocating the dictionary
+	static size_t EstimateMemoryUsage(const RadyxOptions& options, size_t& dictionary_size);
+	size_t GetDictionarySize() const { return FL2_CStream_getParameter(main_fcs, FL2_p_dictionarySize); }
+	unsigned GetBufferLog() const { return static_cast<unsigned>(FL2_CStream_getParameter(main_fcs, FL2_p_bufferLog)); }
 
 private:
+    static const uintptr_t kHugePageSize = uintptr_t(2) << 20;
+
+    void ConfigureSmall();
+    void AdviseHugePages();
     void CheckError(size_t res);
     size_t WaitAndReport(size_t csize, Progress* progress);
+    inline void ReportProgress(Progress* progress);
     void WriteBuffers(OutputStream& out_stream);
 
+    const Cancellation& cancel;
+    // The context in use for the current unit
     FL2_CStream* fcs;
+    FL2_CStream* main_fcs;
+    // Created on the first small unit
+    FL2_CStream* small_fcs;
+    Lzma2Options small_options;
+    unsigned timeout;
+    bool huge_pages;
 	std::unique_ptr<BcjTransform> bcj;
     FL2_dictBuffer dict;
     size_t dict_pos;
     size_t bcj_trim;
     uint_least64_t unpack_size;
     uint_least64_t pack_size;
+    std::vector<uint8_t> captured;
+    bool capture;
     uint8_t bcj_cache[4];
 
 	FastLzma2(const FastLzma2&) = delete;
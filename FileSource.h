@@ -0,0 +1,72 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: FileSource
+//        Supplies the files of an archive from somewhere other than disk
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_FILE_SOURCE_H
+#define RADYX_FILE_SOURCE_H
+
+#include <memory>
+#include "common.h"
+#include "CharType.h"
+
+namespace Radyx {
+
+// All entries are listed before any is opened. Files are then opened one at
+// a time in the order they are stored, which is sorted by extension and is
+// not the order they were listed.
+class FileSource
+{
+public:
+	struct Entry
+	{
+		// Name stored in the archive. Directories may be separated with '/'
+		// on any platform, and the name is passed back to Open in the native
+		// form.
+		FsString name;
+		// Expected size, used for progress and unit planning. The file is
+		// stored with the size actually read.
+		uint_least64_t size;
+		// Modification time as a Windows FILETIME, or 0 if unknown
+		uint_least64_t mod_time;
+		Entry() : size(0), mod_time(0) {}
+	};
+
+	class Reader
+	{
+	public:
+		virtual ~Reader() {}
+		// Sets bytes_read to 0 at the end of the file. Returns false on error.
+		virtual bool Read(void* buffer, size_t byte_count, size_t& bytes_read) = 0;
+	};
+
+	virtual ~FileSource() {}
+	// Fills in entry and returns true, or returns false after the last one
+	virtual bool Next(Entry& entry) = 0;
+	// Returns nullptr if the file can't be opened. It is then left out of the
+	// archive with a warning, as a file on disk would be.
+	virtual std::unique_ptr<Reader> Open(const FsString& name) = 0;
+};
+
+}
+
+#endif // RADYX_FILE_SOURCE_H
@@ -30,7 +30,7 @@
 
 namespace Radyx {
 
-std::array<_TCHAR, 4096> IoException::msg_buffer;
+thread_local std::array<_TCHAR, 4096> IoException::msg_buffer;
 
 IoException::IoException(const _TCHAR* message, const _TCHAR* path)
 {
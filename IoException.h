@@ -46,7 +46,8 @@ private:
 
 	void Construct(const _TCHAR* message, int os_error, const _TCHAR* path);
 
-	static std::array<_TCHAR, 4096> msg_buffer;
+	// One per thread so that jobs running at once can report errors
+	static thread_local std::array<_TCHAR, 4096> msg_buffer;
 };
 
 }
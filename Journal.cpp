@@ -0,0 +1,322 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: Journal
+//        Records completed solid units so an interrupted archive can resume
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#include "winlean.h"
+#include "Journal.h"
+#include "MappedFile.h"
+#include "Crc32.h"
+#include "IoException.h"
+#include "Strings.h"
+
+namespace Radyx {
+
+// The last byte is the format version
+const char Journal::kSignature[8] = { 'R', 'd', 'x', 'J', 'r', 'n', 'l', 1 };
+
+namespace {
+
+enum FileFlags
+{
+	kHasCreatTime = 1,
+	kHasModTime = 2,
+	kHasAttributes = 4
+};
+
+// Reads the fields of one record. Any overrun clears ok.
+class RecordReader
+{
+public:
+	RecordReader(const uint8_t* pos_, const uint8_t* end_)
+		: pos(pos_),
+		end(end_),
+		ok(true) {}
+	uint_least64_t GetNumber(unsigned byte_count)
+	{
+		if (static_cast<size_t>(end - pos) < byte_count) {
+			ok = false;
+			return 0;
+		}
+		uint_least64_t value = 0;
+		for (unsigned i = 0; i < byte_count; ++i) {
+			value |= uint_least64_t(pos[i]) << (i * 8);
+		}
+		pos += byte_count;
+		return value;
+	}
+	void GetCoder(CoderInfo& coder)
+	{
+		coder.method_id = GetNumber(8);
+		coder.num_in_streams = static_cast<unsigned>(GetNumber(1));
+		coder.num_out_streams = static_cast<unsigned>(GetNumber(1));
+		size_t props_size = static_cast<size_t>(GetNumber(1));
+		if (ok && static_cast<size_t>(end - pos) >= props_size) {
+			coder.props.assign(pos, props_size);
+			pos += props_size;
+		}
+		else {
+			ok = false;
+		}
+	}
+	bool IsOk() const { return ok; }
+	bool AtEnd() const { return pos == end; }
+
+private:
+	const uint8_t* pos;
+	const uint8_t* end;
+	bool ok;
+};
+
+}
+
+Journal::Journal()
+	: archive(nullptr),
+	unit_count(0)
+{
+}
+
+Path Journal::GetPath(const Path& archive_path)
+{
+	Path journal_path(archive_path);
+	journal_path += _T(".journal");
+	return journal_path;
+}
+
+bool Journal::Load(const Path& journal_path, const Path& archive_path)
+{
+	entries.clear();
+	units.clear();
+	MappedFile in(journal_path.c_str());
+	if (!in.IsValid()
+		|| in.GetSize() < sizeof(kSignature)
+		|| memcmp(in.GetData(), kSignature, sizeof(kSignature)) != 0)
+	{
+		return false;
+	}
+	std::ifstream archive_file(archive_path.c_str(), std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+	if (!archive_file) {
+		return false;
+	}
+	uint_least64_t archive_size = archive_file.tellg();
+	const uint8_t* pos = reinterpret_cast<const uint8_t*>(in.GetData()) + sizeof(kSignature);
+	const uint8_t* end = reinterpret_cast<const uint8_t*>(in.GetData()) + in.GetSize();
+	while (end - pos >= 8) {
+		RecordReader header(pos, end);
+		size_t body_size = static_cast<size_t>(header.GetNumber(4));
+		const uint8_t* body = pos + 4;
+		if (body_size > static_cast<size_t>(end - body) - 4) {
+			break;
+		}
+		Crc32 crc32;
+		crc32.Add(body, body_size);
+		if (crc32 != RecordReader(body + body_size, end).GetNumber(4)) {
+			break;
+		}
+		RecordReader reader(body, body + body_size);
+		ArchiveReader::Unit unit;
+		unit.pack_pos = reader.GetNumber(8);
+		unit.pack_size = reader.GetNumber(8);
+		unit.unpack_size = reader.GetNumber(8);
+		reader.GetCoder(unit.coder_info);
+		unit.used_bcj = reader.GetNumber(1) != 0;
+		if (unit.used_bcj) {
+			reader.GetCoder(unit.bcj_info);
+		}
+		unit.file_count = reader.GetNumber(8);
+		// Units must follow on from each other and be complete in the archive
+		uint_least64_t unit_end = unit.pack_pos + unit.pack_size;
+		if (!reader.IsOk()
+			|| unit.file_count == 0
+			|| (!units.empty() && unit.pack_pos != units.back().pack_pos + units.back().pack_size)
+			|| unit_end < unit.pack_pos
+			|| unit_end > archive_size)
+		{
+			break;
+		}
+		size_t first_entry = entries.size();
+		uint_least64_t total = 0;
+		for (uint_least64_t i = 0; i < unit.file_count && reader.IsOk(); ++i) {
+			ArchiveReader::Entry entry;
+			size_t name_length = static_cast<size_t>(reader.GetNumber(4));
+			for (size_t j = 0; j < name_length && reader.IsOk(); ++j) {
+				entry.name.push_back(static_cast<_TCHAR>(reader.GetNumber(sizeof(_TCHAR))));
+			}
+			entry.size = reader.GetNumber(8);
+			entry.crc32 = static_cast<uint_fast32_t>(reader.GetNumber(4));
+			unsigned flags = static_cast<unsigned>(reader.GetNumber(1));
+			if (flags & kHasCreatTime) {
+				entry.creat_time.Set(reader.GetNumber(8));
+			}
+			if (flags & kHasModTime) {
+				entry.mod_time.Set(reader.GetNumber(8));
+			}
+			if (flags & kHasAttributes) {
+				entry.attributes.Set(static_cast<uint_fast32_t>(reader.GetNumber(4)));
+			}
+			entry.unit = units.size();
+			total += entry.size;
+			entries.push_back(entry);
+		}
+		if (!reader.IsOk() || !reader.AtEnd() || total != unit.unpack_size) {
+			entries.resize(first_entry);
+			break;
+		}
+		units.push_back(unit);
+		pos = body + body_size + 4;
+	}
+	return !units.empty();
+}
+
+void Journal::Create(const Path& journal_path, OutputFile& archive_, const std::list<ArchiveCompressor::DataUnit>& kept_units)
+{
+	archive = &archive_;
+	unit_count = 0;
+	// The old journal stays in place until the new one is complete
+	path = journal_path;
+	path += _T(".tmp");
+	if (!file.Open(path.c_str(), 0, false) || !file.Write(kSignature, sizeof(kSignature))) {
+		throw IoException(Strings::kCannotWriteJournal, path.c_str());
+	}
+	for (auto& unit : kept_units) {
+		AddUnit(unit);
+	}
+	uint_least64_t size = file.Tell();
+	bool closed = file.Close();
+#ifdef _WIN32
+	bool renamed = MoveFileEx(path.c_str(), journal_path.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+	bool renamed = rename(path.c_str(), journal_path.c_str()) == 0;
+#endif
+	if (!closed || !renamed) {
+		throw IoException(Strings::kCannotWriteJournal, path.c_str());
+	}
+	path = journal_path;
+	if (!file.Reopen(path.c_str(), size, false)) {
+		throw IoException(Strings::kCannotWriteJournal, path.c_str());
+	}
+}
+
+void Journal::AddUnit(const ArchiveCompressor::DataUnit& unit)
+{
+	// The packed data must reach the disk before the record which refers to it
+	archive->Sync();
+	if (archive->fail()) {
+		throw IoException(Strings::kCannotWriteArchive,
+			archive->GetFailedError(),
+			archive->GetFailedName().c_str());
+	}
+	record.clear();
+	// Size of the record body, filled in below
+	PutNumber(0, 4);
+	PutNumber(unit.out_file_pos, 8);
+	PutNumber(unit.pack_size, 8);
+	PutNumber(unit.unpack_size, 8);
+	PutCoder(unit.coder_info);
+	PutNumber(unit.used_bcj, 1);
+	if (unit.used_bcj) {
+		PutCoder(unit.bcj_info);
+	}
+	PutNumber(unit.file_count, 8);
+	// Empty files are not part of the unit
+	auto it = unit.in_file_first;
+	for (uint_least64_t i = 0; i < unit.file_count; ++it) {
+		if (it->size == 0) {
+			continue;
+		}
+		FsString name(it->dir.c_str() + it->root);
+		name += it->name;
+		PutNumber(name.length(), 4);
+		for (auto c : name) {
+			PutNumber(static_cast<std::make_unsigned<_TCHAR>::type>(c), sizeof(_TCHAR));
+		}
+		PutNumber(it->size, 8);
+		PutNumber(it->crc32, 4);
+		PutNumber((it->creat_time.IsSet() ? kHasCreatTime : 0)
+			| (it->mod_time.IsSet() ? kHasModTime : 0)
+			| (it->attributes.IsSet() ? kHasAttributes : 0), 1);
+		if (it->creat_time.IsSet()) {
+			PutNumber(it->creat_time.Get(), 8);
+		}
+		if (it->mod_time.IsSet()) {
+			PutNumber(it->mod_time.Get(), 8);
+		}
+		if (it->attributes.IsSet()) {
+			PutNumber(it->attributes.Get(), 4);
+		}
+		++i;
+	}
+	size_t body_size = record.size() - 4;
+	for (unsigned i = 0; i < 4; ++i) {
+		record[i] = static_cast<uint8_t>(body_size >> (i * 8));
+	}
+	Crc32 crc32;
+	crc32.Add(record.data() + 4, body_size);
+	PutNumber(crc32, 4);
+	Write(record.data(), record.size());
+	++unit_count;
+}
+
+void Journal::Close()
+{
+	file.Close();
+}
+
+void Journal::Remove()
+{
+	if (file.IsOpen()) {
+		file.Close();
+	}
+	if (path.length() != 0) {
+		_tremove(path.c_str());
+	}
+	unit_count = 0;
+}
+
+void Journal::PutNumber(uint_least64_t value, unsigned byte_count)
+{
+	for (unsigned i = 0; i < byte_count; ++i) {
+		record.push_back(static_cast<uint8_t>(value >> (i * 8)));
+	}
+}
+
+void Journal::PutCoder(const CoderInfo& coder)
+{
+	PutNumber(coder.method_id.method_id, 8);
+	PutNumber(coder.num_in_streams, 1);
+	PutNumber(coder.num_out_streams, 1);
+	PutNumber(coder.props.length(), 1);
+	record.insert(record.end(), coder.props.begin(), coder.props.end());
+}
+
+void Journal::Write(const uint8_t* data, size_t size)
+{
+	if (!file.Write(reinterpret_cast<const char*>(data), size) || !file.Sync()) {
+		throw IoException(Strings::kCannotWriteJournal, path.c_str());
+	}
+}
+
+}
@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: Journal
+//        Records completed solid units so an interrupted archive can resume
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_JOURNAL_H
+#define RADYX_JOURNAL_H
+
+#include <list>
+#include <vector>
+#include "common.h"
+#include "CharType.h"
+#include "Path.h"
+#include "OutputFile.h"
+#include "VolumeWriter.h"
+#include "ArchiveReader.h"
+#include "ArchiveCompressor.h"
+
+namespace Radyx {
+
+// One record is appended per unit, holding the unit's position, coders and
+// files. The packed data is synced to disk before the record is written, and
+// each record ends with a CRC, so a record torn by a crash is ignored along
+// with anything after it. The journal is only meaningful on the machine that
+// wrote it.
+class Journal
+{
+public:
+	Journal();
+	static Path GetPath(const Path& archive_path);
+	// Reads the units recorded for archive_path which lie wholly within the
+	// archive file. Returns false if there are none.
+	bool Load(const Path& journal_path, const Path& archive_path);
+	const std::vector<ArchiveReader::Entry>& GetEntries() const { return entries; }
+	const std::vector<ArchiveReader::Unit>& GetUnits() const { return units; }
+	// Starts a new journal for the archive being written, recording the units
+	// kept from before, and replaces any old one. Throws IoException.
+	void Create(const Path& journal_path, OutputFile& archive_, const std::list<ArchiveCompressor::DataUnit>& kept_units);
+	// Called once the unit is complete, and verified if -verify is set.
+	// Throws IoException.
+	void AddUnit(const ArchiveCompressor::DataUnit& unit);
+	// Units recorded since Create, including the kept units passed to it
+	size_t GetUnitCount() const { return unit_count; }
+	void Close();
+	// Closes and deletes the journal
+	void Remove();
+
+private:
+	static const char kSignature[8];
+
+	void PutNumber(uint_least64_t value, unsigned byte_count);
+	void PutCoder(const CoderInfo& coder);
+	void Write(const uint8_t* data, size_t size);
+
+	Path path;
+	VolumeWriter file;
+	OutputFile* archive;
+	size_t unit_count;
+	std::vector<uint8_t> record;
+	std::vector<ArchiveReader::Entry> entries;
+	std::vector<ArchiveReader::Unit> units;
+
+	Journal(const Journal&) = delete;
+	Journal& operator=(const Journal&) = delete;
+};
+
+}
+
+#endif // RADYX_JOURNAL_H
@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: MappedFile
+//        Read-only memory mapping of a whole file
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+#include "MappedFile.h"
+
+namespace Radyx {
+
+const size_t MappedFile::kReadSize;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const _TCHAR* path)
+	: data(nullptr),
+	size(0),
+	valid(false),
+	mapping(NULL)
+{
+	HANDLE handle = CreateFile(path,
+		GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE,
+		NULL,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+		NULL);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	LARGE_INTEGER file_size;
+	if (GetFileType(handle) == FILE_TYPE_DISK
+		&& GetFileSizeEx(handle, &file_size) != FALSE
+		&& uint_least64_t(file_size.QuadPart) <= SIZE_MAX)
+	{
+		size = static_cast<size_t>(file_size.QuadPart);
+		valid = size == 0;
+		if (size != 0) {
+			mapping = CreateFileMapping(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping != NULL) {
+				data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+				valid = data != nullptr;
+			}
+		}
+	}
+	if (!valid) {
+		ReadAll(handle);
+	}
+	// The mapping keeps the file open
+	CloseHandle(handle);
+}
+
+void MappedFile::ReadAll(HANDLE handle)
+{
+	size = 0;
+	for (;;) {
+		buffer.resize(size + kReadSize);
+		DWORD read_count;
+		if (ReadFile(handle, buffer.data() + size, static_cast<DWORD>(kReadSize), &read_count, NULL) == FALSE) {
+			// The write end of a pipe was closed
+			if (GetLastError() != ERROR_BROKEN_PIPE) {
+				return;
+			}
+			read_count = 0;
+		}
+		if (read_count == 0) {
+			break;
+		}
+		size += read_count;
+	}
+	buffer.resize(size);
+	data = size != 0 ? buffer.data() : nullptr;
+	valid = true;
+}
+
+MappedFile::~MappedFile()
+{
+	if (data != nullptr && buffer.empty()) UnmapViewOfFile(data);
+	if (mapping != NULL) CloseHandle(mapping);
+}
+
+#else
+
+MappedFile::MappedFile(const _TCHAR* path)
+	: data(nullptr),
+	size(0),
+	valid(false)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && uint_least64_t(st.st_size) <= SIZE_MAX) {
+		size = static_cast<size_t>(st.st_size);
+		valid = size == 0;
+		if (size != 0) {
+			void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED) {
+				data = static_cast<const char*>(p);
+				valid = true;
+				posix_madvise(p, size, POSIX_MADV_SEQUENTIAL);
+			}
+		}
+	}
+	if (!valid) {
+		ReadAll(fd);
+	}
+	// The mapping keeps the file open
+	close(fd);
+}
+
+void MappedFile::ReadAll(int fd)
+{
+	size = 0;
+	for (;;) {
+		buffer.resize(size + kReadSize);
+		ssize_t read_count = read(fd, buffer.data() + size, kReadSize);
+		if (read_count < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+		if (read_count == 0) {
+			break;
+		}
+		size += static_cast<size_t>(read_count);
+	}
+	buffer.resize(size);
+	data = size != 0 ? buffer.data() : nullptr;
+	valid = true;
+}
+
+MappedFile::~MappedFile()
+{
+	if (data != nullptr && buffer.empty()) munmap(const_cast<char*>(data), size);
+}
+
+#endif // _WIN32
+
+}
@@ -0,0 +1,72 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: MappedFile
+//        Read-only memory mapping of a whole file
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_MAPPED_FILE_H
+#define RADYX_MAPPED_FILE_H
+
+#include <vector>
+#include "common.h"
+#ifdef _WIN32
+#include "winlean.h"
+#endif
+#include "CharType.h"
+
+namespace Radyx {
+
+// Files which can't be mapped, such as pipes, are read into memory instead
+class MappedFile
+{
+public:
+	explicit MappedFile(const _TCHAR* path);
+	~MappedFile();
+	// An empty file is valid but has no data
+	bool IsValid() const { return valid; }
+	const char* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+
+private:
+	static const size_t kReadSize = size_t(1) << 16;
+
+#ifdef _WIN32
+	void ReadAll(HANDLE handle);
+#else
+	void ReadAll(int fd);
+#endif
+
+	const char* data;
+	size_t size;
+	bool valid;
+#ifdef _WIN32
+	HANDLE mapping;
+#endif
+	// Contents of a file which was read rather than mapped
+	std::vector<char> buffer;
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+};
+
+}
+
+#endif // RADYX_MAPPED_FILE_H
@@ -0,0 +1,186 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: MemoryBudget
+//        Fits the encoder configuration within a memory limit
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#ifdef _WIN32
+#include "winlean.h"
+#else
+#include <unistd.h>
+#endif
+#include "MemoryBudget.h"
+#include "Strings.h"
+
+namespace Radyx {
+
+const uint_least64_t MemoryBudget::kMaxReserve;
+const size_t MemoryBudget::kMinDictionary;
+
+uint_least64_t MemoryBudget::GetPhysicalMemory()
+{
+#ifdef _WIN32
+	MEMORYSTATUSEX msx;
+	msx.dwLength = sizeof(msx);
+	if (GlobalMemoryStatusEx(&msx) == TRUE) {
+		return msx.ullTotalPhys;
+	}
+	return 0;
+#else
+	long pages = sysconf(_SC_PHYS_PAGES);
+	long page_size = sysconf(_SC_PAGESIZE);
+	if (pages <= 0 || page_size <= 0) {
+		return 0;
+	}
+	return static_cast<uint_least64_t>(pages) * static_cast<uint_least64_t>(page_size);
+#endif
+}
+
+// Lowest memory.max of the cgroup v2 group this process is in and its
+// ancestors. Returns 0 under cgroup v1 or if no limit is set.
+uint_least64_t MemoryBudget::GetCgroupLimit()
+{
+#ifdef _WIN32
+	return 0;
+#else
+	std::ifstream cgroup("/proc/self/cgroup");
+	std::string line;
+	std::string group;
+	while (std::getline(cgroup, line)) {
+		if (line.compare(0, 3, "0::") == 0) {
+			group = line.substr(3);
+			break;
+		}
+	}
+	if (group.empty() || group[0] != '/') {
+		return 0;
+	}
+	uint_least64_t limit = 0;
+	for (;;) {
+		std::string path = "/sys/fs/cgroup" + group;
+		if (path.back() != '/') {
+			path += '/';
+		}
+		std::ifstream max_file((path + "memory.max").c_str());
+		std::string value;
+		if (max_file >> value && value != "max") {
+			uint_least64_t group_limit = strtoull(value.c_str(), nullptr, 10);
+			if (group_limit != 0 && (limit == 0 || group_limit < limit)) {
+				limit = group_limit;
+			}
+		}
+		if (group == "/") {
+			break;
+		}
+		size_t slash = group.rfind('/');
+		group.resize(slash != 0 ? slash : 1);
+	}
+	return limit;
+#endif
+}
+
+uint_least64_t MemoryBudget::GetLimit(const RadyxOptions& options)
+{
+	uint_least64_t limit = options.memory_limit;
+	if (options.memory_percent != 0) {
+		limit = GetPhysicalMemory() / 100 * options.memory_percent;
+	}
+	uint_least64_t cgroup_limit = GetCgroupLimit();
+	if (cgroup_limit != 0 && (limit == 0 || cgroup_limit < limit)) {
+		limit = cgroup_limit;
+	}
+	if (limit == 0) {
+		return 0;
+	}
+	return limit - std::min(kMaxReserve, limit / 8);
+}
+
+void MemoryBudget::Apply(RadyxOptions& options, uint_least64_t limit)
+{
+	if (limit == 0) {
+		return;
+	}
+	size_t dictionary_size;
+	uint_least64_t usage = FastLzma2::EstimateMemoryUsage(options, dictionary_size);
+	if (usage <= limit) {
+		return;
+	}
+	if (options.async_read) {
+		// Staged reading still overlaps I/O but needs only a few Mb
+		options.async_read = false;
+		options.staged_read = true;
+		usage = FastLzma2::EstimateMemoryUsage(options, dictionary_size);
+	}
+	while (usage > limit && dictionary_size > kMinDictionary) {
+		options.lzma2.dictionary_size = std::max(dictionary_size / 2, kMinDictionary);
+		usage = FastLzma2::EstimateMemoryUsage(options, dictionary_size);
+	}
+	while (usage > limit && options.thread_count > 1) {
+		options.thread_count /= 2;
+		usage = FastLzma2::EstimateMemoryUsage(options, dictionary_size);
+	}
+	Report(options, dictionary_size, usage, limit);
+}
+
+void MemoryBudget::Fit(RadyxOptions& options, FastLzma2& enc, uint_least64_t limit)
+{
+	if (limit == 0) {
+		return;
+	}
+	if (enc.GetMemoryUsage() <= limit) {
+		return;
+	}
+	uint_least64_t usage = Shrink(options.lzma2, enc, limit);
+	Report(options, enc.GetDictionarySize(), usage, limit);
+}
+
+uint_least64_t MemoryBudget::Shrink(Lzma2Options& lzma2, FastLzma2& enc, uint_least64_t limit)
+{
+	uint_least64_t usage = enc.GetMemoryUsage();
+	if (limit == 0) {
+		return usage;
+	}
+	size_t dictionary_size = enc.GetDictionarySize();
+	while (usage > limit && dictionary_size > kMinDictionary) {
+		lzma2.dictionary_size = std::max(dictionary_size / 2, kMinDictionary);
+		enc.SetOptions(lzma2);
+		dictionary_size = enc.GetDictionarySize();
+		usage = enc.GetMemoryUsage();
+	}
+	return usage;
+}
+
+void MemoryBudget::Report(const RadyxOptions& options, size_t dictionary_size, uint_least64_t usage, uint_least64_t limit)
+{
+	Tostream& messages = *options.messages;
+	messages << Strings::kMemoryLimit_ << (limit >> 20) << _T(" Mb: -md")
+		<< (dictionary_size >> 20) << _T("m -mmt") << options.thread_count
+		<< _T(" -ar") << (options.async_read ? _T("+") : (options.staged_read ? _T("s") : _T("-"))) << std::endl;
+	if (usage > limit) {
+		messages << Strings::kMemoryLimitExceeded_ << (usage >> 20) << _T(" Mb") << std::endl;
+	}
+}
+
+}
@@ -0,0 +1,63 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: MemoryBudget
+//        Fits the encoder configuration within a memory limit
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_MEMORY_BUDGET_H
+#define RADYX_MEMORY_BUDGET_H
+
+#include "common.h"
+#include "RadyxOptions.h"
+#include "FastLzma2.h"
+
+namespace Radyx {
+
+class MemoryBudget
+{
+public:
+	// Returns the number of bytes available to the encoder: the smaller of the
+	// -mmemuse setting and the cgroup memory.max, less a reserve for the rest
+	// of the program. Returns 0 if there is no limit.
+	static uint_least64_t GetLimit(const RadyxOptions& options);
+	// Called before the encoder is created. Switches async reading to staged
+	// reading, then halves the dictionary, then reduces threads until the
+	// estimate fits.
+	static void Apply(RadyxOptions& options, uint_least64_t limit);
+	// Called after the encoder is reconfigured. Only the dictionary can be
+	// changed at this point.
+	static void Fit(RadyxOptions& options, FastLzma2& enc, uint_least64_t limit);
+	// Halves the dictionary in lzma2 and applies it to the encoder until the
+	// encoder fits, without reporting. Returns the memory usage.
+	static uint_least64_t Shrink(Lzma2Options& lzma2, FastLzma2& enc, uint_least64_t limit);
+
+private:
+	static const uint_least64_t kMaxReserve = UINT64_C(64) << 20;
+	static const size_t kMinDictionary = size_t(1) << 20;
+
+	static uint_least64_t GetPhysicalMemory();
+	static uint_least64_t GetCgroupLimit();
+	static void Report(const RadyxOptions& options, size_t dictionary_size, uint_least64_t usage, uint_least64_t limit);
+};
+
+}
+
+#endif // RADYX_MEMORY_BUDGET_H
@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: NumaPolicy
+//        Spreads memory allocations across NUMA nodes
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+#include "NumaPolicy.h"
+
+namespace Radyx {
+
+#ifdef __linux__
+
+// From linux/mempolicy.h, which is not always installed
+static const int kMpolInterleave = 3;
+static const size_t kBitsPerLong = sizeof(unsigned long) * CHAR_BIT;
+
+// Reads the online node list, e.g. "0-1" or "0,2-3"
+bool NumaPolicy::GetOnlineNodes(std::vector<unsigned long>& mask, unsigned& count)
+{
+	std::ifstream online("/sys/devices/system/node/online");
+	std::string list;
+	if (!std::getline(online, list)) {
+		return false;
+	}
+	count = 0;
+	const char* p = list.c_str();
+	while (*p != '\0') {
+		char* end;
+		unsigned long first = strtoul(p, &end, 10);
+		if (end == p) {
+			return false;
+		}
+		unsigned long last = first;
+		p = end;
+		if (*p == '-') {
+			last = strtoul(p + 1, &end, 10);
+			if (end == p + 1 || last < first) {
+				return false;
+			}
+			p = end;
+		}
+		for (unsigned long node = first; node <= last; ++node) {
+			if (node / kBitsPerLong >= mask.size()) {
+				mask.resize(node / kBitsPerLong + 1);
+			}
+			mask[node / kBitsPerLong] |= 1UL << (node % kBitsPerLong);
+			++count;
+		}
+		if (*p == ',') {
+			++p;
+		}
+	}
+	return count != 0;
+}
+
+unsigned NumaPolicy::InterleaveAll()
+{
+	std::vector<unsigned long> mask;
+	unsigned count;
+	if (!GetOnlineNodes(mask, count) || count < 2) {
+		return 0;
+	}
+	// maxnode is one more than the number of bits the kernel reads
+	if (syscall(SYS_set_mempolicy, kMpolInterleave, mask.data(), mask.size() * kBitsPerLong + 1) != 0) {
+		return 0;
+	}
+	return count;
+}
+
+#else
+
+bool NumaPolicy::GetOnlineNodes(std::vector<unsigned long>&, unsigned&)
+{
+	return false;
+}
+
+unsigned NumaPolicy::InterleaveAll()
+{
+	return 0;
+}
+
+#endif
+
+}
@@ -1,7 +1,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 //
-// Class: Thread
-//        Simple worker thread class to eliminate extra thread creation overhead
+// Class: NumaPolicy
+//        Spreads memory allocations across NUMA nodes
 //
 // Copyright 2015-present Conor McCarthy
 //
@@ -16,46 +16,34 @@
 // but WITHOUT ANY WARRANTY; without even the implied warranty of
 // MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
 // GNU General Public License for more details.
-// 
+//
 // You should have received a copy of the GNU General Public License
 // along with Radyx. If not, see <http://www.gnu.org/licenses/>.
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-#ifndef RADYX_THREAD_H
-#define RADYX_THREAD_H
+#ifndef RADYX_NUMA_POLICY_H
+#define RADYX_NUMA_POLICY_H
 
-#include <thread>
-#include <mutex>
-#include <condition_variable>
-#include <functional>
+#include <vector>
+#include "common.h"
 
 namespace Radyx {
 
-class Thread
+class NumaPolicy
 {
 public:
-    Thread();
-    ~Thread();
-    void SetWork(std::function<void(void*, int)> fn, void *argp, int argi);
-    void Join();
+	// Sets the memory policy of the calling thread to interleave pages over
+	// all online nodes. Threads created afterwards inherit the policy, so it
+	// must be called before the encoder creates its threads and allocates the
+	// dictionary and match tables. Returns the number of nodes used, or 0 if
+	// there is only one node or the policy could not be set.
+	static unsigned InterleaveAll();
 
 private:
-    void ThreadFn();
-
-    std::thread thread;
-    std::mutex mutex;
-    std::condition_variable cv;
-    volatile bool work_available;
-    volatile bool exit;
-    std::function<void(void*, int)> work_fn;
-    void* argp;
-    int argi;
-
-    Thread(const Thread&) = delete;
-    Thread& operator=(const Thread&) = delete;
+	static bool GetOnlineNodes(std::vector<unsigned long>& mask, unsigned& count);
 };
 
 }
 
-#endif // RADYX_THREAD_H
\ No newline at end of file
+#endif // RADYX_NUMA_POLICY_H
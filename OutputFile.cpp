@@ -30,8 +30,8 @@ namespace Radyx {
 #ifdef _WIN32
 
 OutputFile::OutputFile()
-	: handle(INVALID_HANDLE_VALUE),
-	error_state(std::ios_base::goodbit)
+	: error_state(std::ios_base::goodbit),
+	exception_flags(std::ios_base::goodbit)
 {
 }
 
@@ -42,27 +42,31 @@ OutputFile::~OutputFile()
 }
 
 OutputFile::OutputFile(const _TCHAR* filename)
+	: error_state(std::ios_base::goodbit),
+	exception_flags(std::ios_base::goodbit)
 {
 	open(filename);
 }
 
-void OutputFile::open(const _TCHAR* filename, bool no_caching)
+void OutputFile::open(const _TCHAR* filename, uint_least64_t volume_size, bool no_caching)
 {
-	if (handle != INVALID_HANDLE_VALUE) {
-		CloseHandle(handle);
+	if (!volumes.Open(filename, volume_size, no_caching)) {
+		AddError(std::ios_base::failbit);
 	}
-	handle = CreateFile(filename,
-		GENERIC_WRITE,
-		FILE_SHARE_READ,
-		NULL,
-		CREATE_NEW,
-		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN | (no_caching ? FILE_FLAG_WRITE_THROUGH : 0),
-		NULL);
-	if (handle == INVALID_HANDLE_VALUE) {
+}
+
+void OutputFile::Reopen(const _TCHAR* filename, uint_least64_t pos, bool no_caching)
+{
+	if (!volumes.Reopen(filename, pos, no_caching)) {
 		AddError(std::ios_base::failbit);
 	}
 }
 
+void OutputFile::open(OutputSink& sink)
+{
+	volumes.Open(sink);
+}
+
 OutputFile& OutputFile::put(char c)
 {
 	return write(&c, 1);
@@ -70,35 +74,36 @@ OutputFile& OutputFile::put(char c)
 
 OutputFile& OutputFile::write(const char* s, size_t n)
 {
-	while (!g_break && n != 0) {
-		// Avoid possible errors from large writes over a network in WinXP
-		DWORD to_write = static_cast<DWORD>(std::min(n, size_t(32) * 1024 * 1024 - 32768));
-		DWORD written;
-		if (WriteFile(handle, s, to_write, &written, NULL) == FALSE) {
-			AddError(std::ios_base::badbit);
-			break;
-		}
-		n -= written;
-		s += written;
+	if (!volumes.Write(s, n)) {
+		AddError(std::ios_base::badbit);
 	}
 	return *this;
 }
 
 uint_least64_t OutputFile::tellp()
 {
-	LARGE_INTEGER li;
-	li.QuadPart = 0;
-	if (SetFilePointerEx(handle, li, &li, FILE_CURRENT) == FALSE) {
+	return volumes.Tell();
+}
+
+OutputFile& OutputFile::seekp(uint_least64_t pos)
+{
+	if (!volumes.Seek(pos)) {
 		AddError(std::ios_base::badbit);
 	}
-	return li.QuadPart;
+	return *this;
 }
 
-OutputFile& OutputFile::seekp(uint_least64_t pos)
+OutputFile& OutputFile::CopyFrom(const _TCHAR* source, uint_least64_t pos, uint_least64_t count, const Cancellation& cancel)
 {
-	LARGE_INTEGER li;
-	li.QuadPart = pos;
-	if (SetFilePointerEx(handle, li, NULL, FILE_BEGIN) == FALSE) {
+	if (!volumes.CopyFrom(source, pos, count, cancel)) {
+		AddError(std::ios_base::badbit);
+	}
+	return *this;
+}
+
+OutputFile& OutputFile::Sync()
+{
+	if (!volumes.Sync()) {
 		AddError(std::ios_base::badbit);
 	}
 	return *this;
@@ -106,9 +111,8 @@ OutputFile& OutputFile::seekp(uint_least64_t pos)
 
 void OutputFile::close()
 {
-    if (handle != INVALID_HANDLE_VALUE) {
-        CloseHandle(handle);
-        handle = INVALID_HANDLE_VALUE;
+    if (volumes.IsOpen() && !volumes.Close()) {
+        AddError(std::ios_base::badbit);
     }
 }
 
@@ -136,6 +140,175 @@ void OutputFile::AddError(std::ios_base::iostate error)
 	}
 }
 
+#else
+
+OutputFile::OutputFile()
+	: std::ostream(nullptr)
+{
+	rdbuf(&buffer);
+}
+
+OutputFile::~OutputFile()
+{
+	try {
+		close();
+	}
+	catch (std::ios_base::failure&) {
+	}
+}
+
+void OutputFile::open(const _TCHAR* filename, uint_least64_t volume_size, bool no_caching)
+{
+	clear();
+	if (!buffer.Open(filename, volume_size, no_caching)) {
+		setstate(std::ios_base::failbit);
+	}
+}
+
+void OutputFile::Reopen(const _TCHAR* filename, uint_least64_t pos, bool no_caching)
+{
+	clear();
+	if (!buffer.Reopen(filename, pos, no_caching)) {
+		setstate(std::ios_base::failbit);
+	}
+}
+
+void OutputFile::open(OutputSink& sink)
+{
+	clear();
+	buffer.Open(sink);
+}
+
+void OutputFile::close()
+{
+	if (!buffer.Close()) {
+		setstate(std::ios_base::badbit);
+	}
+}
+
+OutputFile& OutputFile::CopyFrom(const _TCHAR* source, uint_least64_t pos, uint_least64_t count, const Cancellation& cancel)
+{
+	if (!buffer.CopyFrom(source, pos, count, cancel)) {
+		setstate(std::ios_base::badbit);
+	}
+	return *this;
+}
+
+OutputFile& OutputFile::Sync()
+{
+	if (!buffer.Sync()) {
+		setstate(std::ios_base::badbit);
+	}
+	return *this;
+}
+
+OutputFile::Buffer::Buffer()
+	: data(new char[kBufferSize])
+{
+	setp(data.get(), data.get() + kBufferSize);
+}
+
+bool OutputFile::Buffer::Open(const _TCHAR* filename, uint_least64_t volume_size, bool no_caching)
+{
+	setp(data.get(), data.get() + kBufferSize);
+	return volumes.Open(filename, volume_size, no_caching);
+}
+
+bool OutputFile::Buffer::Reopen(const _TCHAR* filename, uint_least64_t pos, bool no_caching)
+{
+	setp(data.get(), data.get() + kBufferSize);
+	return volumes.Reopen(filename, pos, no_caching);
+}
+
+bool OutputFile::Buffer::Open(OutputSink& sink)
+{
+	setp(data.get(), data.get() + kBufferSize);
+	return volumes.Open(sink);
+}
+
+bool OutputFile::Buffer::Close()
+{
+	if (!volumes.IsOpen()) {
+		return true;
+	}
+	bool flushed = FlushBuffer();
+	return volumes.Close() && flushed;
+}
+
+bool OutputFile::Buffer::CopyFrom(const _TCHAR* source, uint_least64_t pos, uint_least64_t count, const Cancellation& cancel)
+{
+	return FlushBuffer() && volumes.CopyFrom(source, pos, count, cancel);
+}
+
+bool OutputFile::Buffer::Sync()
+{
+	return FlushBuffer() && volumes.Sync();
+}
+
+bool OutputFile::Buffer::FlushBuffer()
+{
+	size_t count = pptr() - pbase();
+	setp(data.get(), data.get() + kBufferSize);
+	return count == 0 || volumes.Write(data.get(), count);
+}
+
+OutputFile::Buffer::int_type OutputFile::Buffer::overflow(int_type ch)
+{
+	if (!FlushBuffer()) {
+		return traits_type::eof();
+	}
+	if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+		*pptr() = traits_type::to_char_type(ch);
+		pbump(1);
+	}
+	return traits_type::not_eof(ch);
+}
+
+std::streamsize OutputFile::Buffer::xsputn(const char* s, std::streamsize n)
+{
+	if (static_cast<size_t>(n) <= static_cast<size_t>(epptr() - pptr())) {
+		std::copy(s, s + n, pptr());
+		pbump(static_cast<int>(n));
+		return n;
+	}
+	// Large writes bypass the buffer
+	if (!FlushBuffer() || !volumes.Write(s, static_cast<size_t>(n))) {
+		return 0;
+	}
+	return n;
+}
+
+int OutputFile::Buffer::sync()
+{
+	return FlushBuffer() ? 0 : -1;
+}
+
+OutputFile::Buffer::pos_type OutputFile::Buffer::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+	if (dir == std::ios_base::cur) {
+		return seekpos(pos_type(off_type(volumes.Tell() + (pptr() - pbase())) + off), which);
+	}
+	if (dir == std::ios_base::beg) {
+		return seekpos(pos_type(off), which);
+	}
+	return pos_type(off_type(-1));
+}
+
+OutputFile::Buffer::pos_type OutputFile::Buffer::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+	if ((which & std::ios_base::out) == 0 || pos < 0) {
+		return pos_type(off_type(-1));
+	}
+	uint_least64_t new_pos = static_cast<uint_least64_t>(off_type(pos));
+	if (new_pos == volumes.Tell() + (pptr() - pbase())) {
+		return pos;
+	}
+	if (!FlushBuffer() || !volumes.Seek(new_pos)) {
+		return pos_type(off_type(-1));
+	}
+	return pos;
+}
+
 #endif // _WIN32
 
-}
\ No newline at end of file
+}
@@ -28,11 +28,12 @@
 #include <ios>
 
 #include "common.h"
+#include "CharType.h"
+#include "VolumeWriter.h"
 
 #ifdef _WIN32
 
 #include "winlean.h"
-#include "CharType.h"
 
 namespace Radyx {
 	
@@ -42,11 +43,25 @@ public:
 	OutputFile();
 	explicit OutputFile(const _TCHAR* filename);
 	virtual ~OutputFile();
-	void open(const _TCHAR* filename, bool no_caching = false);
+	void open(const _TCHAR* filename, uint_least64_t volume_size = 0, bool no_caching = false);
+	// Continues an existing file from pos, discarding anything after it
+	void Reopen(const _TCHAR* filename, uint_least64_t pos, bool no_caching = false);
+	// Writes the archive to sink instead of a file
+	void open(OutputSink& sink);
+	size_t GetVolumeCount() const { return volumes.GetVolumeCount(); }
+	// Name of the file where writing failed, and the OS error
+	Path GetFailedName() const { return volumes.GetFailedName(); }
+	int GetFailedError() const { return volumes.GetFailedError(); }
 	OutputFile& put(char c);
 	OutputFile& write(const char* s, size_t n);
 	uint_least64_t tellp();
 	OutputFile& seekp(uint_least64_t pos);
+	// Writes are not buffered
+	OutputFile& flush() { return *this; }
+	// Appends count bytes from pos in another file
+	OutputFile& CopyFrom(const _TCHAR* source, uint_least64_t pos, uint_least64_t count, const Cancellation& cancel);
+	// Writes everything to disk before returning
+	OutputFile& Sync();
     void close();
 	std::ios_base::iostate exceptions() const;
 	void exceptions(std::ios_base::iostate except);
@@ -55,7 +70,7 @@ public:
 private:
 	void AddError(std::ios_base::iostate error);
 
-	HANDLE handle;
+	VolumeWriter volumes;
 	std::ios_base::iostate error_state;
 	std::ios_base::iostate exception_flags;
 };
@@ -67,11 +82,69 @@ typedef OutputFile OutputStream;
 #else 
 
 #include <ostream>
+#include <streambuf>
+#include <memory>
 
 namespace Radyx {
 
 typedef std::ostream OutputStream;
-typedef std::ofstream OutputFile;
+
+class OutputFile : public std::ostream
+{
+public:
+	OutputFile();
+	virtual ~OutputFile();
+	void open(const _TCHAR* filename, uint_least64_t volume_size = 0, bool no_caching = false);
+	// Continues an existing file from pos, discarding anything after it
+	void Reopen(const _TCHAR* filename, uint_least64_t pos, bool no_caching = false);
+	// Writes the archive to sink instead of a file
+	void open(OutputSink& sink);
+	size_t GetVolumeCount() const { return buffer.GetVolumeCount(); }
+	// Name of the file where writing failed, and the OS error
+	Path GetFailedName() const { return buffer.GetFailedName(); }
+	int GetFailedError() const { return buffer.GetFailedError(); }
+	// Appends count bytes from pos in another file
+	OutputFile& CopyFrom(const _TCHAR* source, uint_least64_t pos, uint_least64_t count, const Cancellation& cancel);
+	// Writes everything to disk before returning
+	OutputFile& Sync();
+	void close();
+
+private:
+	class Buffer : public std::streambuf
+	{
+	public:
+		Buffer();
+		bool Open(const _TCHAR* filename, uint_least64_t volume_size, bool no_caching);
+		bool Reopen(const _TCHAR* filename, uint_least64_t pos, bool no_caching);
+		bool Open(OutputSink& sink);
+		bool Close();
+		bool CopyFrom(const _TCHAR* source, uint_least64_t pos, uint_least64_t count, const Cancellation& cancel);
+		bool Sync();
+		size_t GetVolumeCount() const { return volumes.GetVolumeCount(); }
+		Path GetFailedName() const { return volumes.GetFailedName(); }
+		int GetFailedError() const { return volumes.GetFailedError(); }
+
+	protected:
+		int_type overflow(int_type ch);
+		std::streamsize xsputn(const char* s, std::streamsize n);
+		int sync();
+		pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which);
+		pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+
+	private:
+		static const size_t kBufferSize = 1 << 16;
+
+		bool FlushBuffer();
+
+		VolumeWriter volumes;
+		std::unique_ptr<char[]> data;
+	};
+
+	Buffer buffer;
+
+	OutputFile(const OutputFile&) = delete;
+	OutputFile& operator=(const OutputFile&) = delete;
+};
 
 }
 
@@ -0,0 +1,46 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: OutputSink
+//        Receives an archive which is not written to a file
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_OUTPUT_SINK_H
+#define RADYX_OUTPUT_SINK_H
+
+#include "common.h"
+
+namespace Radyx {
+
+// The archive is written sequentially apart from the 32-byte start header at
+// offset 0, which is reserved first and filled in with one Seek back once the
+// rest is complete. A sink which can't seek may buffer that much and write it
+// last. Write and Seek return false on failure.
+class OutputSink
+{
+public:
+	virtual ~OutputSink() {}
+	virtual bool Write(const char* data, size_t size) = 0;
+	virtual bool Seek(uint_least64_t pos) = 0;
+};
+
+}
+
+#endif // RADYX_OUTPUT_SINK_H
@@ -62,14 +62,8 @@ ptrdiff_t Path::FsCompare(size_t pos, size_t end, const Path& second, size_t pos
 	end_2 = std::min(second.length(), end_2);
 	for (; pos < end && pos_2 < end_2; ++pos, ++pos_2) {
 		if (operator[](pos) != second[pos_2]) {
-			_TCHAR ch;
-			if (LCMapString(LOCALE_INVARIANT, LCMAP_UPPERCASE, &operator[](pos), 1, &ch, 1) == 0) {
-				ch = operator[](pos);
-			}
-			_TCHAR ch_2;
-			if (LCMapString(LOCALE_INVARIANT, LCMAP_UPPERCASE, &second[pos_2], 1, &ch_2, 1) == 0) {
-				ch_2 = second[pos_2];
-			}
+			_TCHAR ch = FsFold(operator[](pos));
+			_TCHAR ch_2 = FsFold(second[pos_2]);
 			if (ch != ch_2) {
 				return ptrdiff_t(ch) - ptrdiff_t(ch_2);
 			}
@@ -84,6 +78,15 @@ ptrdiff_t Path::FsCompare(size_t pos, size_t end, const Path& second, size_t pos
 	return 0;
 }
 
+_TCHAR Path::FsFold(_TCHAR ch)
+{
+	_TCHAR upper;
+	if (LCMapString(LOCALE_INVARIANT, LCMAP_UPPERCASE, &ch, 1, &upper, 1) == 0) {
+		return ch;
+	}
+	return upper;
+}
+
 void Path::ConvertSeparators()
 {
 	for (auto& it : *this) {
@@ -105,6 +108,11 @@ ptrdiff_t Path::FsCompare(size_t pos, size_t end, const Path& second, size_t pos
 	return compare(pos, end - pos, second, pos_2, end_2 - pos_2);
 }
 
+_TCHAR Path::FsFold(_TCHAR ch)
+{
+	return ch;
+}
+
 void Path::ConvertSeparators()
 {
 }
@@ -59,6 +59,8 @@ public:
 	ptrdiff_t FsCompare(size_t pos, size_t end, const Path& second, size_t pos_2, size_t end_2) const;
 	inline ptrdiff_t FsCompare(size_t pos, const Path& second, size_t pos_2) const;
 	inline ptrdiff_t FsCompare(const Path& second) const;
+	// Maps a character to the form FsCompare orders by
+	static _TCHAR FsFold(_TCHAR ch);
 	FsString GetName() const;
 	void ConvertSeparators();
 	inline size_t GetNamePos() const;
@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: PathResolver
+//        Resolves directories to full paths with a cache
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef _WIN32
+#include <memory>
+#include "winlean.h"
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <climits>
+#include <cstdlib>
+#endif
+#include "PathResolver.h"
+
+namespace Radyx {
+
+const FsString* PathResolver::Resolve(const FsString& dir)
+{
+	auto it = cache.find(dir);
+	if (it == cache.end()) {
+		FsString full;
+		if (!ResolveUncached(dir, full)) {
+			full.clear();
+		}
+		it = cache.emplace(dir, std::move(full)).first;
+	}
+	return it->second.empty() ? nullptr : &it->second;
+}
+
+#ifdef _WIN32
+
+// GetFullPathName does no I/O so there are no components to share
+bool PathResolver::ResolveUncached(const FsString& dir, FsString& full)
+{
+	static const DWORD kMaxPath = 32767;
+	std::unique_ptr<_TCHAR[]> buffer(new _TCHAR[kMaxPath]);
+	DWORD len = GetFullPathName(dir.c_str(), kMaxPath, buffer.get(), NULL);
+	if (len == 0 || len >= kMaxPath) {
+		return false;
+	}
+	full.assign(buffer.get(), len);
+	return true;
+}
+
+#else
+
+bool PathResolver::ResolveUncached(const FsString& dir, FsString& full)
+{
+	size_t end = dir.find_last_not_of(Path::separator);
+	if (end == FsString::npos) {
+		// The root, or the current directory if empty
+		char buffer[PATH_MAX];
+		if (realpath(dir.empty() ? "." : dir.c_str(), buffer) == NULL) {
+			return false;
+		}
+		full = buffer;
+		return true;
+	}
+	size_t sep = dir.find_last_of(Path::separator, end);
+	FsString name = dir.substr(sep + 1, end - sep);
+	if (sep == FsString::npos && name == ".") {
+		return ResolveUncached(FsString(), full);
+	}
+	const FsString* parent = Resolve(sep == FsString::npos ? FsString(".") : dir.substr(0, sep + 1));
+	if (parent == nullptr) {
+		return false;
+	}
+	if (name == ".") {
+		full = *parent;
+		return true;
+	}
+	if (name == "..") {
+		size_t parent_sep = parent->find_last_of(Path::separator);
+		full = parent->substr(0, parent_sep != 0 ? parent_sep : 1);
+		return true;
+	}
+	full = *parent;
+	if (full.back() != Path::separator) {
+		full.push_back(Path::separator);
+	}
+	full += name;
+	struct stat st;
+	if (lstat(full.c_str(), &st) != 0) {
+		return false;
+	}
+	if (S_ISLNK(st.st_mode)) {
+		char buffer[PATH_MAX];
+		full.append("/.");
+		if (realpath(full.c_str(), buffer) == NULL) {
+			return false;
+		}
+		full = buffer;
+		return true;
+	}
+	return S_ISDIR(st.st_mode);
+}
+
+#endif // _WIN32
+
+}
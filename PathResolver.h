@@ -0,0 +1,58 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: PathResolver
+//        Resolves directories to full paths with a cache
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_PATH_RESOLVER_H
+#define RADYX_PATH_RESOLVER_H
+
+#include <unordered_map>
+#include "common.h"
+#include "CharType.h"
+#include "Path.h"
+
+namespace Radyx {
+
+// Gives the same result as realpath (GetFullPathName on Windows) for a
+// directory. Each directory is resolved once. On POSIX systems a directory
+// is resolved from its resolved parent, so resolving it costs one lstat
+// instead of one per component.
+class PathResolver
+{
+public:
+	PathResolver() {}
+	// Returns nullptr if the directory cannot be resolved
+	const FsString* Resolve(const FsString& dir);
+
+private:
+	bool ResolveUncached(const FsString& dir, FsString& full);
+
+	// An empty string records a failure
+	std::unordered_map<FsString, FsString> cache;
+
+	PathResolver(const PathResolver&) = delete;
+	PathResolver& operator=(const PathResolver&) = delete;
+};
+
+}
+
+#endif // RADYX_PATH_RESOLVER_H
@@ -0,0 +1,202 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: Profiler
+//        Low-overhead per-thread timing of the main processing stages
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include "Profiler.h"
+
+namespace Radyx {
+
+const char* const Profiler::stage_names[kStageCount] = {
+	"File read",
+	"CRC32",
+	"BCJ filter",
+	"Compress / wait",
+	"Write buffers",
+	"Write header",
+	"Volume sync"
+};
+
+const char* const Profiler::counter_names[kCounterCount] = {
+	"Files read",
+	"Bytes read",
+	"Units written",
+	"Tasks run",
+	"Tasks stolen"
+};
+
+const char* const Profiler::timer_names[kTimerCount] = {
+	"Task run",
+	"Worker idle"
+};
+
+const char* const Profiler::interval_names[kIntervalCount] = {
+	"Task queued"
+};
+
+thread_local Profiler::ScopedTimer* Profiler::ScopedTimer::current = nullptr;
+bool Profiler::enabled = false;
+std::mutex Profiler::mtx;
+std::list<Profiler::ThreadCounters> Profiler::threads;
+std::array<std::atomic<uint_least64_t>, Profiler::kIntervalCount> Profiler::intervals;
+// Reset by Enable, but set at startup so that the counters can be reported
+// without -bt
+uint_least64_t Profiler::start_ticks = Profiler::GetTicks();
+std::chrono::steady_clock::time_point Profiler::start_time = std::chrono::steady_clock::now();
+
+Profiler::ThreadCounters::ThreadCounters()
+	: id(std::this_thread::get_id())
+{
+	for (size_t i = 0; i < kStageCount; ++i) {
+		ticks[i].store(0, std::memory_order_relaxed);
+		calls[i].store(0, std::memory_order_relaxed);
+	}
+	for (auto& count : counts) {
+		count.store(0, std::memory_order_relaxed);
+	}
+	for (auto& timer : timers) {
+		timer.store(0, std::memory_order_relaxed);
+	}
+}
+
+void Profiler::Enable()
+{
+	start_time = std::chrono::steady_clock::now();
+	start_ticks = GetTicks();
+	enabled = true;
+}
+
+Profiler::ThreadCounters& Profiler::GetThreadCounters()
+{
+	static thread_local ThreadCounters* counters = nullptr;
+	if (counters == nullptr) {
+		std::unique_lock<std::mutex> lock(mtx);
+		threads.emplace_back();
+		counters = &threads.back();
+	}
+	return *counters;
+}
+
+void Profiler::Add(Stage stage, uint_least64_t ticks)
+{
+	ThreadCounters& counters = GetThreadCounters();
+	counters.ticks[stage].store(counters.ticks[stage].load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+	counters.calls[stage].store(counters.calls[stage].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// Calibrate the tick counter against the wall clock over the whole run
+double Profiler::GetTicksPerSecond()
+{
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	uint_least64_t ticks = GetTicks() - start_ticks;
+	if (seconds <= 0 || ticks == 0) {
+		return 1e9;
+	}
+	return ticks / seconds;
+}
+
+void Profiler::Report()
+{
+	if (!enabled) {
+		return;
+	}
+	double ticks_per_sec = GetTicksPerSecond();
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	std::unique_lock<std::mutex> lock(mtx);
+	std::array<uint_least64_t, kStageCount> totals;
+	totals.fill(0);
+	fprintf(stderr, "\nStage timings (elapsed %.3f s):\n", elapsed);
+	unsigned thread_index = 0;
+	for (const auto& counters : threads) {
+		fprintf(stderr, "  Thread %u\n", thread_index++);
+		for (size_t i = 0; i < kStageCount; ++i) {
+			uint_least64_t ticks = counters.ticks[i].load(std::memory_order_relaxed);
+			uint_least64_t calls = counters.calls[i].load(std::memory_order_relaxed);
+			totals[i] += ticks;
+			if (calls != 0) {
+				fprintf(stderr, "    %-16s %10.3f s %12llu calls\n",
+					stage_names[i],
+					ticks / ticks_per_sec,
+					static_cast<unsigned long long>(calls));
+			}
+		}
+	}
+	fprintf(stderr, "  All threads\n");
+	for (size_t i = 0; i < kStageCount; ++i) {
+		if (totals[i] != 0) {
+			double seconds = totals[i] / ticks_per_sec;
+			fprintf(stderr, "    %-16s %10.3f s %6.1f%%\n",
+				stage_names[i],
+				seconds,
+				elapsed > 0 ? seconds * 100 / elapsed : 0.0);
+		}
+	}
+}
+
+void Profiler::ReportStats()
+{
+	double ticks_per_sec = GetTicksPerSecond();
+	int_least64_t now = static_cast<int_least64_t>(GetTicks());
+	std::unique_lock<std::mutex> lock(mtx);
+	std::array<uint_least64_t, kCounterCount> count_totals;
+	std::array<int_least64_t, kTimerCount> timer_totals;
+	count_totals.fill(0);
+	timer_totals.fill(0);
+	fprintf(stderr, "\nStatistics:\n");
+	unsigned thread_index = 0;
+	for (const auto& counters : threads) {
+		fprintf(stderr, "  Thread %u\n", thread_index++);
+		for (size_t i = 0; i < kCounterCount; ++i) {
+			uint_least64_t count = counters.counts[i].load(std::memory_order_relaxed);
+			count_totals[i] += count;
+			if (count != 0) {
+				fprintf(stderr, "    %-16s %14llu\n", counter_names[i], static_cast<unsigned long long>(count));
+			}
+		}
+		for (size_t i = 0; i < kTimerCount; ++i) {
+			int_least64_t ticks = counters.timers[i].load(std::memory_order_relaxed);
+			// A timer still running, such as an idle worker, is counted up to now
+			if (ticks < 0) {
+				ticks += now;
+			}
+			timer_totals[i] += ticks;
+			if (ticks != 0) {
+				fprintf(stderr, "    %-16s %12.3f s\n", timer_names[i], ticks / ticks_per_sec);
+			}
+		}
+	}
+	fprintf(stderr, "  All threads\n");
+	for (size_t i = 0; i < kCounterCount; ++i) {
+		fprintf(stderr, "    %-16s %14llu\n", counter_names[i], static_cast<unsigned long long>(count_totals[i]));
+	}
+	for (size_t i = 0; i < kTimerCount; ++i) {
+		fprintf(stderr, "    %-16s %12.3f s\n", timer_names[i], timer_totals[i] / ticks_per_sec);
+	}
+	// Only intervals which have ended are included
+	for (size_t i = 0; i < kIntervalCount; ++i) {
+		uint_least64_t ticks = intervals[i].load(std::memory_order_relaxed);
+		fprintf(stderr, "    %-16s %12.3f s\n", interval_names[i], ticks / ticks_per_sec);
+	}
+}
+
+}
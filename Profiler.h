@@ -0,0 +1,215 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: Profiler
+//        Low-overhead per-thread timing of the main processing stages, and
+//        counters for development builds
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_PROFILER_H
+#define RADYX_PROFILER_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <thread>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define RADYX_HAVE_RDTSC
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define RADYX_HAVE_RDTSC
+#endif
+#include "common.h"
+
+namespace Radyx {
+
+// Stage timers are turned on at run time with -bt. The counters and timers
+// below them are for development, and are only called through the
+// RADYX_STATS_* macros, which compile to nothing unless RADYX_STATS is
+// defined.
+class Profiler
+{
+public:
+	enum Stage
+	{
+		kFileRead,
+		kCrc32,
+		kBcj,
+		kCompress,
+		kWriteBuffers,
+		kWriteHeader,
+		kVolumeSync,
+		kStageCount
+	};
+
+	enum Counter
+	{
+		kFilesRead,
+		kBytesRead,
+		kUnitsWritten,
+		kTasksRun,
+		kTasksStolen,
+		kCounterCount
+	};
+
+	// Started and stopped on one thread
+	enum Timer
+	{
+		kTaskRun,
+		kWorkerIdle,
+		kTimerCount
+	};
+
+	// Completed intervals which may start and end on different threads
+	enum Interval
+	{
+		kTaskQueued,
+		kIntervalCount
+	};
+
+	// Time spent in a timer nested inside another on the same thread is
+	// counted only for the inner stage
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(Stage stage_)
+			: stage(stage_),
+			parent(nullptr),
+			nested(0),
+			start(0)
+		{
+			if (enabled) {
+				parent = current;
+				current = this;
+				start = GetTicks();
+			}
+		}
+		~ScopedTimer() {
+			if (start != 0) {
+				uint_least64_t elapsed = GetTicks() - start;
+				current = parent;
+				if (parent != nullptr) {
+					parent->nested += elapsed;
+				}
+				Add(stage, elapsed - std::min(nested, elapsed));
+			}
+		}
+
+	private:
+		Stage stage;
+		ScopedTimer* parent;
+		uint_least64_t nested;
+		uint_least64_t start;
+
+		static thread_local ScopedTimer* current;
+
+		ScopedTimer(const ScopedTimer&) = delete;
+		ScopedTimer& operator=(const ScopedTimer&) = delete;
+	};
+
+	static void Enable();
+	static bool IsEnabled() { return enabled; }
+	static inline uint_least64_t GetTicks();
+	static void Add(Stage stage, uint_least64_t ticks);
+	static void Report();
+
+	static void Count(Counter counter, uint_least64_t n) {
+		Increase(GetThreadCounters().counts[counter], n);
+	}
+	// The tick count is subtracted at the start and added at the end, so a
+	// timer left running is negative
+	static void StartTimer(Timer timer) {
+		std::atomic<int_least64_t>& value = GetThreadCounters().timers[timer];
+		value.store(value.load(std::memory_order_relaxed) - static_cast<int_least64_t>(GetTicks()), std::memory_order_relaxed);
+	}
+	static void StopTimer(Timer timer) {
+		std::atomic<int_least64_t>& value = GetThreadCounters().timers[timer];
+		value.store(value.load(std::memory_order_relaxed) + static_cast<int_least64_t>(GetTicks()), std::memory_order_relaxed);
+	}
+	static void AddInterval(Interval interval, uint_least64_t ticks) {
+		intervals[interval].fetch_add(ticks, std::memory_order_relaxed);
+	}
+	static void ReportStats();
+
+private:
+	// Written only by the owning thread so relaxed access is sufficient
+	struct ThreadCounters
+	{
+		std::thread::id id;
+		std::array<std::atomic<uint_least64_t>, kStageCount> ticks;
+		std::array<std::atomic<uint_least64_t>, kStageCount> calls;
+		std::array<std::atomic<uint_least64_t>, kCounterCount> counts;
+		std::array<std::atomic<int_least64_t>, kTimerCount> timers;
+		ThreadCounters();
+	};
+
+	static void Increase(std::atomic<uint_least64_t>& value, uint_least64_t n) {
+		value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+	static ThreadCounters& GetThreadCounters();
+	static double GetTicksPerSecond();
+
+	static const char* const stage_names[kStageCount];
+	static const char* const counter_names[kCounterCount];
+	static const char* const timer_names[kTimerCount];
+	static const char* const interval_names[kIntervalCount];
+	static bool enabled;
+	static std::mutex mtx;
+	static std::list<ThreadCounters> threads;
+	static std::array<std::atomic<uint_least64_t>, kIntervalCount> intervals;
+	static uint_least64_t start_ticks;
+	static std::chrono::steady_clock::time_point start_time;
+};
+
+uint_least64_t Profiler::GetTicks()
+{
+#ifdef RADYX_HAVE_RDTSC
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+}
+
+#ifdef RADYX_STATS
+
+#define RADYX_STATS_COUNT(counter, n) Radyx::Profiler::Count(Radyx::Profiler::counter, n)
+#define RADYX_STATS_START(timer) Radyx::Profiler::StartTimer(Radyx::Profiler::timer)
+#define RADYX_STATS_STOP(timer) Radyx::Profiler::StopTimer(Radyx::Profiler::timer)
+#define RADYX_STATS_INTERVAL(interval, ticks) Radyx::Profiler::AddInterval(Radyx::Profiler::interval, ticks)
+#define RADYX_STATS_REPORT() Radyx::Profiler::ReportStats()
+
+#else // RADYX_STATS
+
+#define RADYX_STATS_COUNT(counter, n) ((void)0)
+#define RADYX_STATS_START(timer) ((void)0)
+#define RADYX_STATS_STOP(timer) ((void)0)
+#define RADYX_STATS_INTERVAL(interval, ticks) ((void)0)
+#define RADYX_STATS_REPORT() ((void)0)
+
+#endif // RADYX_STATS
+
+#endif // RADYX_PROFILER_H
@@ -32,7 +32,13 @@ Progress::Progress(uint_least64_t total_bytes_)
     prev_done(0),
 	progress_bytes(0),
 	next_update(total_bytes_ / 100),
-	display_length(0)
+	prev_packed(0),
+	packed_bytes(0),
+	wait_ns(0),
+	telemetry(nullptr),
+	listener(nullptr),
+	display_length(0),
+	visible(true)
 {
 }
 
@@ -47,6 +53,12 @@ unsigned Progress::ShowLocked()
 		RewindLocked();
 	}
 	unsigned percent = static_cast<unsigned>(progress_bytes * 100 / (total_bytes + (total_bytes == 0)));
+	if (listener != nullptr) {
+		listener->OnProgress(progress_bytes, total_bytes);
+	}
+	if (!visible) {
+		return percent;
+	}
 #ifdef _UNICODE
     _TCHAR buf[8];
     display_length = swprintf_s(buf, L" %u%%", percent);
@@ -59,13 +71,15 @@ unsigned Progress::ShowLocked()
 
 void Progress::RewindLocked()
 {
-    std::Tcerr << _T('\r');
+    if (visible)
+        std::Tcerr << _T('\r');
     display_length = 0;
 }
 
-void Progress::Update(uint_least64_t bytes_done)
+void Progress::Update(uint_least64_t bytes_done, uint_least64_t packed_done)
 {
     progress_bytes = prev_done + bytes_done;
+    packed_bytes = prev_packed + packed_done;
 	if (progress_bytes >= next_update) {
 		std::unique_lock<std::mutex> lock(mtx);
 		if (progress_bytes >= next_update) {
@@ -73,6 +87,46 @@ void Progress::Update(uint_least64_t bytes_done)
 			next_update = total_bytes * percent / 100;
 		}
 	}
+	if (telemetry != nullptr) {
+		Telemetry::Clock::time_point now = Telemetry::Clock::now();
+		if (telemetry->IsDue(now)) {
+			telemetry->WriteProgress(now, GetTotals(), current_file);
+		}
+	}
+}
+
+Telemetry::Totals Progress::GetTotals() const
+{
+	Telemetry::Totals totals;
+	totals.total_bytes = total_bytes;
+	totals.read_bytes = progress_bytes;
+	totals.packed_bytes = packed_bytes;
+	totals.wait_ns = wait_ns;
+	return totals;
+}
+
+void Progress::SetCurrentFile(const FsString& dir, size_t root, const FsString& name)
+{
+	if (telemetry != nullptr) {
+		current_file.assign(dir, root, FsString::npos);
+		current_file.append(name);
+	}
+}
+
+void Progress::FinishUnit(size_t index, uint_least64_t unpack_size, uint_least64_t pack_size)
+{
+	prev_packed += pack_size;
+	packed_bytes = prev_packed;
+	if (telemetry != nullptr) {
+		telemetry->WriteUnit(index, unpack_size, pack_size);
+	}
+}
+
+void Progress::ReportDone()
+{
+	if (telemetry != nullptr) {
+		telemetry->WriteDone(GetTotals());
+	}
 }
 
 void Progress::AddUnit(uint_least64_t unit_size)
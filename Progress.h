@@ -29,32 +29,58 @@
 #include <mutex>
 #include <iostream>
 #include "CharType.h"
+#include "Telemetry.h"
 
 namespace Radyx {
 
 class Progress
 {
 public:
+	// Receives each change in the percentage done, with the lock held
+	class Listener
+	{
+	public:
+		virtual ~Listener() {}
+		virtual void OnProgress(uint_least64_t done, uint_least64_t total) = 0;
+	};
+
 	Progress(uint_least64_t total_bytes_);
 	~Progress();
 	inline void Show();
 	inline void Rewind();
 	void RewindLocked();
 	inline void Erase();
-    void Update(uint_least64_t bytes_done);
+    void Update(uint_least64_t bytes_done, uint_least64_t packed_done);
     void AddUnit(uint_least64_t unit_size);
     inline void Adjust(int_least64_t size_change);
 	inline std::mutex& GetMutex() { return mtx; }
+	void SetTelemetry(Telemetry* telemetry_) { telemetry = telemetry_; }
+	// Turns the percentage display on the console on or off
+	void SetVisible(bool visible_) { visible = visible_; }
+	void SetListener(Listener* listener_) { listener = listener_; }
+	bool IsTiming() const { return telemetry != nullptr; }
+	void AddWaitTime(uint_least64_t ns) { wait_ns += ns; }
+	void SetCurrentFile(const FsString& dir, size_t root, const FsString& name);
+	void FinishUnit(size_t index, uint_least64_t unpack_size, uint_least64_t pack_size);
+	void ReportDone();
 
 private:
 	unsigned ShowLocked();
+	Telemetry::Totals GetTotals() const;
 
 	uint_least64_t total_bytes;
     uint_least64_t prev_done;
     uint_least64_t progress_bytes;
 	uint_least64_t next_update;
+	uint_least64_t prev_packed;
+	uint_least64_t packed_bytes;
+	uint_least64_t wait_ns;
+	Telemetry* telemetry;
+	Listener* listener;
+	FsString current_file;
 	std::mutex mtx;
 	int display_length;
+	bool visible;
 
 	Progress(const Progress&) = delete;
 	Progress& operator=(const Progress&) = delete;
@@ -81,6 +107,8 @@ void Progress::Rewind()
 
 void Progress::Erase()
 {
+    if (!visible)
+        return;
     Rewind();
     std::Tcerr << "     \b\b\b\b\b";
 }
@@ -29,13 +29,20 @@
 #include <direct.h>
 #endif
 #include <thread>
-#include <fstream>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+#include <future>
+#include <iterator>
 #include "winlean.h"
 #include "common.h"
 #include "RadyxOptions.h"
 #include "ArchiveCompressor.h"
 #include "Path.h"
 #include "DirScanner.h"
+#include "MappedFile.h"
+#include "PathResolver.h"
+#include "ThreadPool.h"
 #include "IoException.h"
 #include "Strings.h"
 #include "fast-lzma2/fast-lzma2.h"
@@ -43,7 +50,12 @@
 namespace Radyx {
 
 RadyxOptions::FileSpec::FileSpec(const _TCHAR* path_, Recurse recurse_)
-	: path(path_),
+	: FileSpec(path_, _tcslen(path_), recurse_)
+{
+}
+
+RadyxOptions::FileSpec::FileSpec(const _TCHAR* path_, size_t length, Recurse recurse_)
+	: path(path_, length),
 	root(0),
 	name(0),
 	recurse(false)
@@ -56,12 +68,15 @@ RadyxOptions::FileSpec::FileSpec(const _TCHAR* path_, Recurse recurse_)
 	recurse = recurse_ == kRecurseAll || (recurse_ == kRecurseWildcard && Path::IsWildcard(path.c_str() + name));
 }
 
-void RadyxOptions::FileSpec::SetFullPath(const _TCHAR* full_path)
+// Replaces the directory with its full path
+void RadyxOptions::FileSpec::SetFullDir(const FsString& full_dir)
 {
+	Path full_path(full_dir);
+	full_path.AppendName(path.c_str() + name);
 	if(path.compare(full_path) != 0) {
 		size_t length = path.length();
 		size_t old_name = name;
-		path = full_path;
+		path = std::move(full_path);
 		name = path.GetNamePos();
 		if (root != old_name) {
 			root += path.length() - length;
@@ -72,27 +87,51 @@ void RadyxOptions::FileSpec::SetFullPath(const _TCHAR* full_path)
 	}
 }
 
-RadyxOptions::RadyxOptions(int argc, _TCHAR* argv[], Path& archive_path)
+RadyxOptions::RadyxOptions()
 	: default_recurse(kRecurseNone),
 	share_deny_none(false),
+	drop_cache(false),
 	store_full_paths(false),
 //	yes_to_all(false),
 	multi_thread(true),
 	thread_count(0),
+	memory_limit(0),
+	memory_percent(0),
 	solid_by_extension(false),
+	group_profiles(false),
+	numa_interleave(false),
+	huge_pages(false),
+	update(false),
+	verify(false),
+	resume(false),
+	batch(false),
+	batch_jobs(0),
 	solid_unit_size(UINT64_C(1) << 31),
 	solid_file_count(UINT32_MAX),
+	auto_tune(kTuneOff),
+	tune_target(0),
 	bcj_filter(true),
 	async_read(true),
+	staged_read(false),
 	store_creation_time(false),
-	quiet_mode(true)
+	quiet_mode(true),
+	show_progress(true),
+	show_timings(false),
+	volume_size(0),
+	telemetry_interval(kTelemetryIntervalDefault),
+	messages(&std::Tcerr)
+{
+}
+
+RadyxOptions::RadyxOptions(int argc, _TCHAR* argv[], Path& archive_path)
+	: RadyxOptions()
 {
 	ParseCommand(argc, argv);
 	int i = 2;
 	for (; i < argc && (argv[i][0] != '-' || argv[i][1] != '-'); ++i) {
 		if (argv[i][0] == '-') {
 			const _TCHAR* arg = argv[i] + 1;
-			if (*arg == 'r') {
+			if (*arg == 'r' && _tcscmp(arg, _T("resume")) != 0) {
 				default_recurse = HandleRecurse(arg);
 				if (*arg != '\0') {
 					std::Tcerr << Strings::kErrorCol_ << Strings::kExtraCharsAfterSwitch_ << _T("'-r'") << std::endl;
@@ -130,7 +169,7 @@ RadyxOptions::RadyxOptions(int argc, _TCHAR* argv[], Path& archive_path)
 			if (archive_path.length() == 0) {
 				archive_path.reserve(_tcslen(argv[i]) + 4);
 				archive_path = argv[i];
-				if (!archive_path.IsDevNull()) {
+				if (!archive_path.IsDevNull() && !batch) {
 					archive_path.AppendExtension(_T(".7z"));
 				}
 			}
@@ -146,11 +185,28 @@ RadyxOptions::RadyxOptions(int argc, _TCHAR* argv[], Path& archive_path)
 		}
 	}
 	if (archive_path.length() == 0) {
-		std::Tcerr << Strings::kErrorCol_ << Strings::kMissingArchiveName << std::endl;
+		std::Tcerr << Strings::kErrorCol_ << (batch ? Strings::kMissingManifestName : Strings::kMissingArchiveName) << std::endl;
 		throw std::invalid_argument("");
 	}
+	if (batch && !file_specs.empty()) {
+		std::Tcerr << Strings::kErrorCol_ << Strings::kBatchFileNames << std::endl;
+		throw std::invalid_argument("");
+	}
+	Prepare();
+}
+
+void RadyxOptions::Prepare()
+{
 	if (lzma2.lc + lzma2.lp > 4) {
-		std::Tcerr << Strings::kLcLpNoGreaterThan4 << std::endl;
+		*messages << Strings::kLcLpNoGreaterThan4 << std::endl;
+		throw std::invalid_argument("");
+	}
+	if (update && volume_size != 0) {
+		*messages << Strings::kErrorCol_ << Strings::kUpdateVolumesUnsupported << std::endl;
+		throw std::invalid_argument("");
+	}
+	if (resume && (update || volume_size != 0)) {
+		*messages << Strings::kErrorCol_ << Strings::kResumeUnsupported << std::endl;
 		throw std::invalid_argument("");
 	}
 	if (!multi_thread) {
@@ -161,6 +217,7 @@ RadyxOptions::RadyxOptions(int argc, _TCHAR* argv[], Path& archive_path)
 		thread_count = (hardware_threads != 0) ? hardware_threads : 2;
 	}
 	LoadFullPaths();
+	CompileExclusions();
 }
 
 void RadyxOptions::ParseCommand(int argc, _TCHAR* argv[])
@@ -173,6 +230,12 @@ void RadyxOptions::ParseCommand(int argc, _TCHAR* argv[])
 		switch (argv[1][0]) {
 		case 'a':
 			return;
+		case 'u':
+			update = true;
+			return;
+		case 'b':
+			batch = true;
+			return;
 		case 'e':
 		case 'x':
 		case 'l':
@@ -187,74 +250,106 @@ void RadyxOptions::ParseCommand(int argc, _TCHAR* argv[])
 	throw std::invalid_argument("");
 }
 
-void RadyxOptions::ReadFileList(const _TCHAR* path, Recurse recurse, std::list<FileSpec>& spec_list)
+void RadyxOptions::ReadFileList(const _TCHAR* path, Recurse recurse, std::vector<FileSpec>& spec_list)
 {
-#ifdef _UNICODE
-	char cpath[kMaxPath + 1];
-	WideCharToMultiByte(CP_UTF8,
-		0,
-		path,
-		-1,
-		cpath,
-		kMaxPath,
-		nullptr,
-		nullptr);
-	std::ifstream in(cpath);
-#else
-	std::ifstream in(path);
-#endif
-	if (in.fail()) {
+	MappedFile in(path);
+	if (!in.IsValid()) {
 		throw IoException(Strings::kCannotOpenList, path);
 	}
+	const char* data = in.GetData();
+	const char* end = data + in.GetSize();
 #ifdef _UNICODE
-	std::array<char, 1024> buffer;
-	in.read(buffer.data(), buffer.size());
-	if (in.bad()) {
-		throw IoException(Strings::kCannotReadList, path);
-	}
-	if (IsTextUnicode(buffer.data(), static_cast<int>(in.gcount()), NULL) != 0) {
-		in.close();
+	if (data != end && IsTextUnicode(data, static_cast<int>(std::min<size_t>(end - data, 1024)), NULL) != 0) {
 		ReadFileListW(path, recurse, spec_list);
 		return;
 	}
-	in.clear();
-	in.seekg(0);
 #endif
-	std::string str;
-	while (!in.eof()) {
-		std::getline(in, str);
-		if (in.bad()) {
-			break;
+	// Large lists are split at line ends and the parts parsed in parallel
+	size_t part_count = 1;
+	if (in.GetSize() >= kParallelListSize) {
+		part_count = ThreadPool::GetShared().GetThreadCount();
+	}
+	std::vector<std::vector<FileSpec>> parts(part_count);
+	std::vector<std::future<const char*>> results;
+	const char* first = data;
+	for (size_t i = 0; i < part_count; ++i) {
+		const char* last = end;
+		if (i + 1 < part_count) {
+			last = std::max(first, data + in.GetSize() / part_count * (i + 1));
+			last = std::find(last, end, '\n');
+			last += last != end;
 		}
-		while (str.length() > 0 && (str.back() == '\r' || str.back() == ' ')) {
-			str.pop_back();
+		std::vector<FileSpec>& part = parts[i];
+		if (part_count == 1) {
+			std::promise<const char*> result;
+			result.set_value(ParseFileList(first, last, recurse, part));
+			results.push_back(result.get_future());
 		}
-		if (str.length() > 0) {
+		else {
+			results.push_back(ThreadPool::GetShared().SubmitFuture([first, last, recurse, &part]() {
+				return ParseFileList(first, last, recurse, part);
+			}));
+		}
+		first = last;
+	}
+	// The parts and the mapping must outlive every task
+	for (auto& result : results) {
+		result.wait();
+	}
+	size_t total = spec_list.size();
+	for (size_t i = 0; i < part_count; ++i) {
+		const char* bad_line = results[i].get();
+		if (bad_line != nullptr) {
+			std::Tcerr << Strings::kErrorCol_;
+			std::cerr << '"' << std::string(bad_line, std::find(bad_line, end, '\n')).c_str() << "\": ";
+			std::Tcerr << Strings::kUnableConvertUtf8to16 << std::endl;
+			throw std::invalid_argument("");
+		}
+		total += parts[i].size();
+	}
+	spec_list.reserve(total);
+	for (auto& part : parts) {
+		std::move(part.begin(), part.end(), std::back_inserter(spec_list));
+	}
+}
+
+// Parses the lines in [first, last). Returns the first line which cannot be
+// converted to a path, or nullptr.
+const char* RadyxOptions::ParseFileList(const char* first, const char* last, Recurse recurse, std::vector<FileSpec>& spec_list)
+{
+	while (first < last) {
+		const char* line_end = static_cast<const char*>(memchr(first, '\n', last - first));
+		if (line_end == nullptr) {
+			line_end = last;
+		}
+		const char* next = line_end + (line_end != last);
+		while (line_end > first && (line_end[-1] == '\r' || line_end[-1] == ' ')) {
+			--line_end;
+		}
+		if (line_end > first) {
 #ifdef _UNICODE
 			_TCHAR wpath[kMaxPath + 1];
 			int len = MultiByteToWideChar(CP_UTF8,
 				0,
-				str.c_str(),
-				static_cast<int>(str.length()),
+				first,
+				static_cast<int>(line_end - first),
 				wpath,
 				kMaxPath);
 			if (len == 0) {
-				std::Tcerr << Strings::kErrorCol_;
-				std::cerr << '"' << str.c_str() << "\": ";
-				std::Tcerr << Strings::kUnableConvertUtf8to16 << std::endl;
-				throw std::invalid_argument("");
+				return first;
 			}
-			wpath[len] = '\0';
-			spec_list.push_back(FileSpec(wpath, recurse));
+			spec_list.emplace_back(wpath, static_cast<size_t>(len), recurse);
 #else
-			spec_list.push_back(FileSpec(str.c_str(), recurse));
+			spec_list.emplace_back(first, static_cast<size_t>(line_end - first), recurse);
 #endif
 		}
+		first = next;
 	}
+	return nullptr;
 }
 
 #ifdef _UNICODE
-void RadyxOptions::ReadFileListW(const _TCHAR* path, Recurse recurse, std::list<FileSpec>& spec_list)
+void RadyxOptions::ReadFileListW(const _TCHAR* path, Recurse recurse, std::vector<FileSpec>& spec_list)
 {
 	// Setting up a wifstream to use UTF-16 is pretty ugly so using a C stream
 	FILE* in;
@@ -286,8 +381,10 @@ void RadyxOptions::ParseArg(const _TCHAR* arg)
 	case 'a':
 		switch (arg[1]) {
 		case 'r': {
-			async_read = !(arg[2] == '-');
-			arg += (arg[2] == '-') + 2;
+			// -ars reads ahead into staging buffers instead of a second dictionary
+			staged_read = arg[2] == 's';
+			async_read = !(arg[2] == '-') && !staged_read;
+			arg += (arg[2] == '-' || staged_read) + 2;
 			if (*arg != 0) {
 				throw InvalidParameter(arg);
 			}
@@ -297,10 +394,19 @@ void RadyxOptions::ParseArg(const _TCHAR* arg)
 			throw InvalidParameter(arg);
 		}
 		break;
+	case 'b':
+		if (arg[1] != 't' || arg[2] != '\0') {
+			throw InvalidParameter(arg);
+		}
+		show_timings = true;
+		break;
 	case 'i': {
 		HandleFilenames(arg, file_specs);
 		break;
 	}
+	case 'j':
+		batch_jobs = ReadSimpleNumericParam(arg + 1, 1, kMaxBatchJobs);
+		break;
 	case 'm':
 		HandleCompressionMethod(arg);
 		break;
@@ -310,7 +416,10 @@ void RadyxOptions::ParseArg(const _TCHAR* arg)
 		quiet_mode = arg[1] != '-';
 		break;
 	case 'r':
-		// Already done
+		if (_tcscmp(arg, _T("resume")) == 0) {
+			resume = true;
+		}
+		// Otherwise already done
 		break;
 	case 's':
 		switch (arg[1]) {
@@ -322,10 +431,47 @@ void RadyxOptions::ParseArg(const _TCHAR* arg)
 				store_full_paths = true;
 				break;
 			}
+			throw InvalidParameter(arg);
+		case 'd':
+			if (arg[2] == 'c' && (arg[3] == '\0' || (arg[3] == '-' && arg[4] == '\0'))) {
+				drop_cache = arg[3] != '-';
+				break;
+			}
+		default:
+			throw InvalidParameter(arg);
+		}
+		break;
+	case 't':
+		switch (arg[1]) {
+		case 'l':
+			if (arg[2] == '\0') {
+				throw InvalidParameter(arg + 2);
+			}
+			telemetry_path = arg + 2;
+			break;
+		case 'i':
+			telemetry_interval = ReadSimpleNumericParam(arg + 2, 1, UINT_MAX);
+			break;
 		default:
 			throw InvalidParameter(arg);
 		}
 		break;
+	case 'v': {
+		if (_tcscmp(arg, _T("verify")) == 0) {
+			verify = true;
+			break;
+		}
+		_TCHAR* end;
+		unsigned long u = ReadDecimal(arg + 1, end);
+		if (end == arg + 1) {
+			throw InvalidParameter(end);
+		}
+		volume_size = (end[0] == '\0') ? u : ApplyMultiplier(end, u);
+		if (volume_size == 0 || (end[0] != '\0' && end[1] != '\0')) {
+			throw InvalidParameter(arg + 1);
+		}
+		break;
+	}
 	case 'w':
 		if (arg[1] == '\0') {
 			throw InvalidParameter(arg + 1);
@@ -344,7 +490,7 @@ void RadyxOptions::ParseArg(const _TCHAR* arg)
 	}
 }
 
-void RadyxOptions::HandleFilenames(const _TCHAR* arg, std::list<FileSpec>& spec_list)
+void RadyxOptions::HandleFilenames(const _TCHAR* arg, std::vector<FileSpec>& spec_list)
 {
 	++arg;
 	Recurse recurse = default_recurse;
@@ -373,7 +519,13 @@ void RadyxOptions::HandleCompressionMethod(const _TCHAR* arg)
 	switch (*arg++) {
 	case 'x':
 		arg += (arg[0] == '=');
-		lzma2.compress_level = ReadSimpleNumericParam(arg, 1, FL2_maxCLevel());
+		if (arg[0] == 'a' && arg[1] == 'u' && arg[2] == 't' && arg[3] == 'o') {
+			HandleAutoTune(arg + 4);
+		}
+		else {
+			auto_tune = kTuneOff;
+			lzma2.compress_level = ReadSimpleNumericParam(arg, 1, FL2_maxCLevel());
+		}
 		break;
 	case 's':
         if (arg[0] == 'd') {
@@ -408,6 +560,37 @@ void RadyxOptions::HandleCompressionMethod(const _TCHAR* arg)
 			lzma2.match_cycles = ReadSimpleNumericParam(arg, 1, FL2_HYBRIDCYCLES_MAX);
 			break;
 		}
+		case 'e':
+		{
+			// -mmemuse as in 7-zip, or the short form -mmem
+			if (arg[1] != 'm') {
+				throw InvalidParameter(arg);
+			}
+			arg += 2;
+			if (arg[0] == 'u' && arg[1] == 's' && arg[2] == 'e') {
+				arg += 3;
+			}
+			arg += (arg[0] == '=');
+			if (arg[0] == 'p') {
+				memory_percent = ReadSimpleNumericParam(arg + 1, 1, 100);
+				memory_limit = 0;
+			}
+			else {
+				// A number without a suffix is in bytes, as for -v
+				_TCHAR* end;
+				unsigned long u = ReadDecimal(arg, end);
+				if (end == arg || u == 0 || u == ULONG_MAX || (end[0] != '\0' && end[1] != '\0')) {
+					throw InvalidParameter(arg);
+				}
+				uint_least64_t scale = (end[0] == '\0') ? 1 : ApplyMultiplier(end, 1);
+				if (u > UINT64_MAX / scale) {
+					throw InvalidParameter(arg);
+				}
+				memory_limit = u * scale;
+				memory_percent = 0;
+			}
+			break;
+		}
 		default:
 			throw InvalidParameter(arg);
 		}
@@ -475,6 +658,32 @@ void RadyxOptions::HandleCompressionMethod(const _TCHAR* arg)
 			break;
 		}
 		break;
+	case 'g':
+		if (arg[0] == 'p') {
+			arg += (arg[1] == '=') + 1;
+			int on_off = arg[0] == '\0' ? 1 : CheckOnOff(arg);
+			if (on_off < 0) {
+				throw InvalidParameter(arg);
+			}
+			group_profiles = on_off != 0;
+		}
+		else {
+			throw InvalidParameter(arg);
+		}
+		break;
+	case 'h':
+		if (arg[0] == 'p') {
+			arg += (arg[1] == '=') + 1;
+			int on_off = arg[0] == '\0' ? 1 : CheckOnOff(arg);
+			if (on_off < 0) {
+				throw InvalidParameter(arg);
+			}
+			huge_pages = on_off != 0;
+		}
+		else {
+			throw InvalidParameter(arg);
+		}
+		break;
 	case 'l':
 		switch (arg[0]) {
 		case 'c':
@@ -489,6 +698,20 @@ void RadyxOptions::HandleCompressionMethod(const _TCHAR* arg)
 			throw InvalidParameter(arg);
 		}
 		break;
+	case 'n':
+		if (arg[0] == 'u' && arg[1] == 'm' && arg[2] == 'a') {
+			arg += 3;
+			arg += (arg[0] == '=');
+			int on_off = arg[0] == '\0' ? 1 : CheckOnOff(arg);
+			if (on_off < 0) {
+				throw InvalidParameter(arg);
+			}
+			numa_interleave = on_off != 0;
+		}
+		else {
+			throw InvalidParameter(arg);
+		}
+		break;
 	case 'o':
 		arg += (arg[0] == '=');
 		lzma2.block_overlap = ReadSimpleNumericParam(arg, 1, FL2_BLOCK_OVERLAP_MAX);
@@ -531,6 +754,29 @@ void RadyxOptions::HandleCompressionMethod(const _TCHAR* arg)
 	}
 }
 
+void RadyxOptions::HandleAutoTune(const _TCHAR* arg)
+{
+	auto_tune = kTuneRatio;
+	tune_target = kTuneRatioDefault;
+	if (arg[0] == '\0') {
+		return;
+	}
+	if (arg[0] != ':') {
+		throw InvalidParameter(arg);
+	}
+	switch (arg[1]) {
+	case 'r':
+		tune_target = ReadSimpleNumericParam(arg + 2, 0, 100);
+		break;
+	case 's':
+		auto_tune = kTuneSpeed;
+		tune_target = ReadSimpleNumericParam(arg + 2, 1, 1000000);
+		break;
+	default:
+		throw InvalidParameter(arg);
+	}
+}
+
 void RadyxOptions::HandleSolidMode(const _TCHAR* arg)
 {
 	arg += (arg[0] == '=');
@@ -645,59 +891,73 @@ uint_least64_t RadyxOptions::ApplyMultiplier(const _TCHAR* arg, unsigned value)
 	}
 }
 
-void RadyxOptions::LoadFullPaths()
+void RadyxOptions::ChangeToWorkingDir() const
 {
 	if (working_dir.length() != 0 && _tchdir(working_dir.c_str()) < 0) {
 		throw IoException(Strings::kCannotChDir, working_dir.c_str());
 	}
-	std::unique_ptr<_TCHAR[]> full_path(new _TCHAR[kMaxPath]);
+}
+
+void RadyxOptions::LoadFullPaths()
+{
+	ChangeToWorkingDir();
+	// Specs from a list file often share a directory or its parents
+	PathResolver resolver;
 	Path temp;
 	for (auto& fs : file_specs) {
-#ifdef _WIN32
-		DWORD len = GetFullPathName(fs.path.c_str(), kMaxPath, full_path.get(), NULL);
-		if (len != 0 && len < kMaxPath) {
-			fs.SetFullPath(full_path.get());
-		}
-#else
 		temp = fs.path;
-		temp.SetName(".");
-		if (realpath(temp.c_str(), full_path.get()) != NULL) {
-			temp = fs.path.c_str() + fs.name;
-			size_t length = fs.path.length();
-			size_t old_name = fs.name;
-			fs.path = full_path.get();
-			fs.path.AppendName(temp.c_str());
-			fs.name = fs.path.GetNamePos();
-			if (fs.root != old_name) {
-				fs.root += fs.path.length() - length;
-			}
-			else {
-				fs.root = fs.name;
-			}
+		temp.SetName(_T("."));
+		const FsString* full_dir = resolver.Resolve(temp);
+		if (full_dir != nullptr) {
+			fs.SetFullDir(*full_dir);
+		}
 	}
-#endif
+}
+
+void RadyxOptions::CompileExclusions()
+{
+	root_exclusions = ExclusionSet();
+	recursive_exclusions = ExclusionSet();
+	for (const auto& it : exclusions) {
+		ExclusionSet& set = it.recurse ? recursive_exclusions : root_exclusions;
+		if (it.name == 0) {
+			set.names.Add(it.path.c_str());
+			continue;
+		}
+		// Exclusion contains a path
+		auto dir = set.dirs.begin();
+		for (; dir != set.dirs.end(); ++dir) {
+			if (dir->first.length() == it.name && it.path.FsCompare(0, it.name, dir->first, 0, it.name) == 0) {
+				break;
+			}
+		}
+		if (dir == set.dirs.end()) {
+			set.dirs.emplace_back(Path(it.path.substr(0, it.name)), SpecMatcher());
+			dir = std::prev(set.dirs.end());
+		}
+		dir->second.Add(it.path.c_str() + it.name);
 	}
 }
 
 bool RadyxOptions::SearchExclusions(const Path& path, size_t root, bool is_root) const
 {
-	for (const auto& it : exclusions ) {
-		if (is_root || it.recurse) {
-			if (it.name != 0) {
-				// Exclusion contains a path
-				if (root + it.name <= path.length() &&
-					path.FsCompare(root, root + it.name, it.path, 0, it.name) == 0 &&
-					Path::MatchFileSpec(path.c_str() + path.GetNamePos(), it.path.c_str() + it.name))
-				{
-					return true;
-				}
-			}
-			else {
-				// Compare only the names
-				if (Path::MatchFileSpec(path.c_str() + path.GetNamePos(), it.path.c_str())) {
-					return true;
-				}
-			}
+	return MatchExclusions(recursive_exclusions, path, root)
+		|| (is_root && MatchExclusions(root_exclusions, path, root));
+}
+
+bool RadyxOptions::MatchExclusions(const ExclusionSet& set, const Path& path, size_t root)
+{
+	const _TCHAR* name = path.c_str() + path.GetNamePos();
+	if (!set.names.IsEmpty() && set.names.Match(name)) {
+		return true;
+	}
+	for (const auto& dir : set.dirs) {
+		size_t length = dir.first.length();
+		if (root + length <= path.length()
+			&& path.FsCompare(root, root + length, dir.first, 0, length) == 0
+			&& dir.second.Match(name))
+		{
+			return true;
 		}
 	}
 	return false;
@@ -705,7 +965,7 @@ bool RadyxOptions::SearchExclusions(const Path& path, size_t root, bool is_root)
 
 void RadyxOptions::GetFiles(ArchiveCompressor& arch_comp)
 {
-	file_specs.sort([](const RadyxOptions::FileSpec& first, const RadyxOptions::FileSpec& second)
+	std::stable_sort(file_specs.begin(), file_specs.end(), [](const RadyxOptions::FileSpec& first, const RadyxOptions::FileSpec& second)
 	{
 		if (first.name != second.name) {
 			return first.name < second.name;
@@ -713,7 +973,7 @@ void RadyxOptions::GetFiles(ArchiveCompressor& arch_comp)
 		return first.path.FsCompare(0, first.name, second.path, 0, first.name) < 0;
 	});
 	for (auto it = file_specs.cbegin(); it != file_specs.cend();) {
-        if (g_break)
+        if (arch_comp.IsCancelled())
             throw std::runtime_error(Strings::kBreakSignaled);
 
 		auto end = it;
@@ -728,14 +988,20 @@ void RadyxOptions::GetFiles(ArchiveCompressor& arch_comp)
 	}
 }
 
-void RadyxOptions::SearchDir(std::list<FileSpec>::const_iterator it_first,
-	std::list<FileSpec>::const_iterator it_end,
+void RadyxOptions::SearchDir(std::vector<FileSpec>::const_iterator it_first,
+	std::vector<FileSpec>::const_iterator it_end,
 	ArchiveCompressor& arch_comp) const
 {
 	Path dir;
 	bool recurse = false;
+	SpecGroup group;
+	group.root = it_first->root;
 	for (auto it = it_first; it != it_end; ++it) {
 		recurse |= it->recurse;
+		group.top.Add(it->path.c_str() + it->name);
+		if (it->recurse) {
+			group.recursive.Add(it->path.c_str() + it->name);
+		}
 	}
 	bool all_match = false;
 #ifdef _WIN32
@@ -753,12 +1019,11 @@ void RadyxOptions::SearchDir(std::list<FileSpec>::const_iterator it_first,
 		dir = ".";
 	}
 #endif
-	SearchDir(dir, it_first, it_end, all_match, recurse, true, arch_comp);
+	SearchDir(dir, group, all_match, recurse, true, arch_comp);
 }
 
 void RadyxOptions::SearchDir(Path& dir,
-	std::list<FileSpec>::const_iterator it_first,
-	std::list<FileSpec>::const_iterator it_end,
+	const SpecGroup& group,
 	bool all_match,
 	bool recurse,
 	bool is_root,
@@ -774,41 +1039,28 @@ void RadyxOptions::SearchDir(Path& dir,
 			continue;
 		}
 		dir.SetName(name);
-		if (exclusions.size() > 0 && SearchExclusions(dir, it_first->root, is_root)) {
+		if (exclusions.size() > 0 && SearchExclusions(dir, group.root, is_root)) {
 			continue;
 		}
 		if (scan.IsDirectory()) {
 			if (recurse) {
 				size_t length = dir.length();
 				dir.AppendName(Path::dir_search_all);
-				SearchDir(dir, it_first, it_end, false, true, false, arch_comp);
+				SearchDir(dir, group, false, true, false, arch_comp);
 				dir.resize(length);
 			}
 		}
 		else {
-			if (all_match || IsMatch(it_first, it_end, name, is_root)) {
+			if (all_match || (is_root ? group.top : group.recursive).Match(name)) {
 #ifdef _WIN32
 				uint_least64_t size = scan.GetFileSize();
 #else
 				uint_least64_t size = 0;
 #endif
-				arch_comp.Add(dir.c_str(), it_first->root, size);
+				arch_comp.Add(dir.c_str(), group.root, size);
 			}
 		}
-	} while (!g_break && scan.Next());
-}
-
-bool RadyxOptions::IsMatch(std::list<FileSpec>::const_iterator it_first,
-	std::list<FileSpec>::const_iterator it_end,
-	const _TCHAR* name,
-	bool is_root) const
-{
-	for (auto it = it_first; it != it_end; ++it) {
-		if ((is_root || it->recurse) && Path::MatchFileSpec(name, it->path.c_str() + it->name)) {
-			return true;
-		}
-	}
-	return false;
+	} while (!arch_comp.IsCancelled() && scan.Next());
 }
 
 }
\ No newline at end of file
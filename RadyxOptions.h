@@ -27,6 +27,7 @@
 
 #include <string>
 #include <list>
+#include <vector>
 #ifndef _WIN32
 #include <limits.h>
 #include <cstdlib>
@@ -35,6 +36,7 @@
 #include "Path.h"
 #include "OptionalSetting.h"
 #include "Lzma2Options.h"
+#include "SpecMatcher.h"
 
 namespace Radyx {
 
@@ -50,6 +52,15 @@ public:
 		kRecurseAll
 	};
 
+	enum AutoTune
+	{
+		kTuneOff,
+		// Fastest configuration within tune_target percent of the best ratio
+		kTuneRatio,
+		// Best ratio at tune_target MB/s or more
+		kTuneSpeed
+	};
+
 	struct FileSpec
 	{
 		Path path;
@@ -58,7 +69,8 @@ public:
 		bool recurse;
 		FileSpec() {}
 		FileSpec(const _TCHAR* path_, Recurse recurse_);
-		void SetFullPath(const _TCHAR* full_path);
+		FileSpec(const _TCHAR* path_, size_t length, Recurse recurse_);
+		void SetFullDir(const FsString& full_dir);
 	};
 
 	class InvalidParameter
@@ -70,43 +82,103 @@ public:
 		const _TCHAR* arg_error;
 	};
 
+	// Default settings, for use without a command line. Specs are added to
+	// file_specs and exclusions before calling Prepare.
+	RadyxOptions();
 	RadyxOptions(int argc, _TCHAR* argv[], Path& archive_path);
+	// Checks the settings, resolves the thread count and the full paths of the
+	// file specs, and compiles the exclusions. Prints to messages and throws
+	// std::invalid_argument if the settings conflict.
+	void Prepare();
 	void GetFiles(ArchiveCompressor& arch_comp);
+	// Changes to the -w directory if one was given. Throws IoException.
+	void ChangeToWorkingDir() const;
 
-	std::list<FileSpec> file_specs;
-	std::list<FileSpec> exclusions;
+	std::vector<FileSpec> file_specs;
+	std::vector<FileSpec> exclusions;
 	FsString working_dir;
 	Recurse default_recurse;
 	bool share_deny_none;
+	bool drop_cache;
 	bool store_full_paths;
 //	bool yes_to_all;
 	bool multi_thread;
 	unsigned thread_count;
+	uint_least64_t memory_limit;
+	unsigned memory_percent;
 	bool solid_by_extension;
+	bool group_profiles;
+	bool numa_interleave;
+	bool huge_pages;
+	bool update;
+	bool verify;
+	bool resume;
+	// The b command: archive_path names a manifest of jobs
+	bool batch;
+	// Jobs run at once in a batch, or 0 to choose from the thread count
+	unsigned batch_jobs;
 	uint_least64_t solid_unit_size;
 	uint_fast32_t solid_file_count;
 	Lzma2Options lzma2;
+	AutoTune auto_tune;
+	unsigned tune_target;
 	bool bcj_filter;
 	bool async_read;
+	bool staged_read;
 	bool store_creation_time;
 	bool quiet_mode;
+	// Off in batch jobs, which share the console
+	bool show_progress;
+	bool show_timings;
+	uint_least64_t volume_size;
+	FsString telemetry_path;
+	unsigned telemetry_interval;
+	// Receives notices, warnings and errors found while archiving
+	Tostream* messages;
 
 private:
+	// Exclusions compiled for matching. Recursive exclusions apply at every
+	// level and the others only in the directories named on the command line.
+	struct ExclusionSet
+	{
+		SpecMatcher names;
+		// Exclusions containing a path, grouped by the path before the name
+		std::vector<std::pair<Path, SpecMatcher>> dirs;
+	};
+
+	// File specs in the same directory compiled for matching. All apply in
+	// that directory and only the recursive ones below it.
+	struct SpecGroup
+	{
+		size_t root;
+		SpecMatcher top;
+		SpecMatcher recursive;
+	};
+
 	static const unsigned kRandomFilterDefault = 10;
+	static const unsigned kTelemetryIntervalDefault = 1000;
+	static const unsigned kTuneRatioDefault = 2;
+	static const unsigned kMaxBatchJobs = 256;
 #ifdef _WIN32 
 	static const unsigned kMaxPath = 32767;
 #else
 	static const unsigned kMaxPath = PATH_MAX;
 #endif
+	// List files at least this large are parsed in parallel
+	static const size_t kParallelListSize = size_t(1) << 20;
 
 	void ParseCommand(int argc, _TCHAR* argv[]);
-	void ReadFileList(const _TCHAR* path, Recurse recurse, std::list<FileSpec>& spec_list);
-	void ReadFileListW(const _TCHAR* path, Recurse recurse, std::list<FileSpec>& spec_list);
+	void ReadFileList(const _TCHAR* path, Recurse recurse, std::vector<FileSpec>& spec_list);
+	void ReadFileListW(const _TCHAR* path, Recurse recurse, std::vector<FileSpec>& spec_list);
+	static const char* ParseFileList(const char* first, const char* last, Recurse recurse, std::vector<FileSpec>& spec_list);
 	void ParseArg(const _TCHAR* arg);
+	void CompileExclusions();
 	bool SearchExclusions(const Path& path, size_t root, bool is_root) const;
-	void HandleFilenames(const _TCHAR* arg, std::list<FileSpec>& spec_list);
+	static bool MatchExclusions(const ExclusionSet& set, const Path& path, size_t root);
+	void HandleFilenames(const _TCHAR* arg, std::vector<FileSpec>& spec_list);
 	void HandleCompressionMethod(const _TCHAR* arg);
 	void HandleSolidMode(const _TCHAR* arg);
+	void HandleAutoTune(const _TCHAR* arg);
 	Recurse HandleRecurse(const _TCHAR*& arg);
 	void Handle_ss(const _TCHAR* arg);
 	int CheckOnOff(const _TCHAR* arg) const;
@@ -114,20 +186,18 @@ private:
 	unsigned ReadSimpleNumericParam(const _TCHAR* arg, unsigned min, unsigned max) const;
 	uint_least64_t ApplyMultiplier(const _TCHAR* arg, unsigned value) const;
 	void LoadFullPaths();
-	void SearchDir(std::list<FileSpec>::const_iterator it_first,
-		std::list<FileSpec>::const_iterator it_end,
+	void SearchDir(std::vector<FileSpec>::const_iterator it_first,
+		std::vector<FileSpec>::const_iterator it_end,
 		ArchiveCompressor& arch_comp) const;
 	void SearchDir(Path& dir,
-		std::list<FileSpec>::const_iterator it_first,
-		std::list<FileSpec>::const_iterator it_end,
+		const SpecGroup& group,
 		bool all_match,
 		bool recurse,
 		bool is_root,
 		ArchiveCompressor& arch_comp) const;
-	bool IsMatch(std::list<FileSpec>::const_iterator it_first,
-		std::list<FileSpec>::const_iterator it_end,
-		const _TCHAR* name,
-		bool is_root) const;
+
+	ExclusionSet root_exclusions;
+	ExclusionSet recursive_exclusions;
 };
 
 unsigned long RadyxOptions::ReadDecimal(const _TCHAR* arg, _TCHAR*& end) const
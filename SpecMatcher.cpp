@@ -0,0 +1,157 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: SpecMatcher
+//        Matches file names against a compiled set of wildcard specs
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include "SpecMatcher.h"
+#include "Path.h"
+
+namespace Radyx {
+
+#ifdef _WIN32
+// PathMatchSpec also splits specs at ';' and trims spaces, and a trailing
+// '.' matches names without an extension. Such specs are never prefiltered.
+static const _TCHAR kSpecialChars[] = _T("*?; ");
+#else
+static const _TCHAR kSpecialChars[] = _T("*?[]\\");
+#endif
+
+void SpecMatcher::Add(const _TCHAR* spec)
+{
+	size_t length = _tcslen(spec);
+	if (IsLiteral(spec)) {
+		literals.insert(Fold(spec, length));
+		return;
+	}
+	if (spec[0] == Path::wildcard_all && IsLiteral(spec + 1)) {
+		if (suffixes.insert(Fold(spec + 1, length - 1)).second
+			&& std::find(suffix_lengths.begin(), suffix_lengths.end(), length - 1) == suffix_lengths.end())
+		{
+			suffix_lengths.push_back(length - 1);
+		}
+		return;
+	}
+	Pattern pattern;
+	pattern.spec = spec;
+	pattern.first = 0;
+#ifdef _WIN32
+	bool prefilter = pattern.spec.find_first_of(_T("; ")) == FsString::npos && spec[length - 1] != '.';
+#else
+	bool prefilter = pattern.spec.find('\\') == FsString::npos;
+#endif
+	if (prefilter) {
+		if (_tcschr(kSpecialChars, spec[0]) == nullptr) {
+			pattern.first = Fold(spec, 1)[0];
+		}
+		size_t tail = pattern.spec.find_last_of(kSpecialChars) + 1;
+		pattern.tail = Fold(spec + tail, length - tail);
+	}
+	size_t index = patterns.size();
+	patterns.push_back(pattern);
+	if (pattern.first != 0) {
+		by_first[pattern.first].push_back(index);
+	}
+	else {
+		any_first.push_back(index);
+	}
+}
+
+bool SpecMatcher::IsEmpty() const
+{
+	return literals.empty() && suffixes.empty() && patterns.empty();
+}
+
+bool SpecMatcher::Match(const _TCHAR* name) const
+{
+	size_t length = _tcslen(name);
+	FsString folded = Fold(name, length);
+	if (literals.count(folded) != 0) {
+		return true;
+	}
+#ifndef _WIN32
+	// With FNM_PERIOD a leading period is not matched by a wildcard
+	if (name[0] != '.')
+#endif
+	{
+		for (size_t suffix_length : suffix_lengths) {
+			if (suffix_length <= length && suffixes.count(folded.substr(length - suffix_length)) != 0) {
+				return true;
+			}
+		}
+	}
+	if (!by_first.empty()) {
+		auto it = by_first.find(folded[0]);
+		if (it != by_first.end() && MatchPatterns(it->second, name, folded)) {
+			return true;
+		}
+	}
+	return MatchPatterns(any_first, name, folded);
+}
+
+bool SpecMatcher::MatchPatterns(const std::vector<size_t>& indices, const _TCHAR* name, const FsString& folded) const
+{
+	for (size_t index : indices) {
+		const Pattern& pattern = patterns[index];
+		size_t tail_length = pattern.tail.length();
+		if (tail_length != 0
+			&& (tail_length > folded.length()
+				|| folded.compare(folded.length() - tail_length, tail_length, pattern.tail) != 0))
+		{
+			continue;
+		}
+		if (Path::MatchFileSpec(name, pattern.spec.c_str())) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool SpecMatcher::IsLiteral(const _TCHAR* spec)
+{
+	for (const _TCHAR* p = spec; *p != '\0'; ++p) {
+		if (_tcschr(kSpecialChars, *p) != nullptr) {
+			return false;
+		}
+	}
+#ifdef _WIN32
+	size_t length = _tcslen(spec);
+	if (length != 0 && spec[length - 1] == '.') {
+		return false;
+	}
+#endif
+	return true;
+}
+
+// File names compare without case on Windows
+FsString SpecMatcher::Fold(const _TCHAR* str, size_t length)
+{
+	FsString folded(str, length);
+#ifdef _WIN32
+	for (auto& c : folded) {
+		c = static_cast<_TCHAR>(_totlower(c));
+	}
+#endif
+	return folded;
+}
+
+}
@@ -0,0 +1,74 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: SpecMatcher
+//        Matches file names against a compiled set of wildcard specs
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_SPEC_MATCHER_H
+#define RADYX_SPEC_MATCHER_H
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "common.h"
+#include "CharType.h"
+
+namespace Radyx {
+
+// Gives the same result as calling Path::MatchFileSpec for each spec, but
+// names without wildcards are found in a hash set and specs of the form
+// *suffix in a table of suffixes. Other specs are only passed to
+// MatchFileSpec if the first and last literal characters of the name fit.
+class SpecMatcher
+{
+public:
+	SpecMatcher() {}
+	void Add(const _TCHAR* spec);
+	bool IsEmpty() const;
+	bool Match(const _TCHAR* name) const;
+
+private:
+	struct Pattern
+	{
+		FsString spec;
+		// Literal first character, or 0 if the spec begins with a wildcard
+		_TCHAR first;
+		// Literal characters after the last wildcard, folded
+		FsString tail;
+	};
+
+	static bool IsLiteral(const _TCHAR* spec);
+	static FsString Fold(const _TCHAR* str, size_t length);
+	bool MatchPatterns(const std::vector<size_t>& indices, const _TCHAR* name, const FsString& folded) const;
+
+	std::unordered_set<FsString> literals;
+	std::unordered_set<FsString> suffixes;
+	// Distinct suffix lengths, so each is looked up once per name
+	std::vector<size_t> suffix_lengths;
+	std::vector<Pattern> patterns;
+	// Patterns by first character, and those beginning with a wildcard
+	std::unordered_map<_TCHAR, std::vector<size_t>> by_first;
+	std::vector<size_t> any_first;
+};
+
+}
+
+#endif // RADYX_SPEC_MATCHER_H
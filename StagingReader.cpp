@@ -0,0 +1,234 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: StagingReader
+//        Reads input files ahead of the compressor on a separate thread
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstring>
+#include "StagingReader.h"
+#include "RadyxOptions.h"
+#include "IoException.h"
+#include "Profiler.h"
+
+namespace Radyx {
+
+const size_t StagingReader::kSlotCount;
+const size_t StagingReader::kSlotSize;
+
+StagingReader::StagingReader(const std::list<ArchiveCompressor::FileInfo>& file_list, const RadyxOptions& options)
+	: share_deny_none(options.share_deny_none),
+	drop_cache(options.drop_cache),
+	store_creation_time(options.store_creation_time),
+	read_index(0),
+	write_index(0),
+	filled(0),
+	exit(false),
+	current(nullptr),
+	current_pos(0)
+{
+	files.reserve(file_list.size());
+	for (auto& fi : file_list) {
+		files.push_back(&fi);
+	}
+	for (auto& slot : slots) {
+		slot.data.resize(kSlotSize);
+	}
+	reader_thread = std::thread(&StagingReader::ReadFiles, this);
+}
+
+StagingReader::~StagingReader()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		exit = true;
+	}
+	cv.notify_all();
+	reader_thread.join();
+}
+
+// Reader thread
+void StagingReader::ReadFiles()
+{
+	for (auto fi : files) {
+		ArchiveCompressor::FileReader reader(*fi, share_deny_none, drop_cache);
+		Slot* slot = AcquireFree();
+		if (slot == nullptr) {
+			return;
+		}
+		slot->fi = fi;
+		slot->first = true;
+		slot->end = false;
+		slot->data_size = 0;
+		if (!reader.IsValid()) {
+			slot->type = kOpenFailed;
+			slot->os_message = IoException::GetOsMessage();
+			Publish();
+			continue;
+		}
+		// The list entry belongs to the compressor thread
+		ArchiveCompressor::FileInfo attributes(*fi);
+		reader.GetAttributes(attributes, store_creation_time);
+		slot->size = attributes.size;
+		slot->creat_time = attributes.creat_time;
+		slot->mod_time = attributes.mod_time;
+		slot->attributes = attributes.attributes;
+		slot->type = kData;
+		for (;;) {
+			unsigned long read_count;
+			bool read_ok;
+			{
+				Profiler::ScopedTimer timer(Profiler::kFileRead);
+				read_ok = reader.Read(slot->data.data() + slot->data_size,
+					static_cast<uint_fast32_t>(kSlotSize - slot->data_size),
+					read_count);
+			}
+			if (!read_ok) {
+				FsString os_msg(IoException::GetOsMessage());
+				if (slot->data_size != 0) {
+					Publish();
+					slot = AcquireFree();
+					if (slot == nullptr) {
+						return;
+					}
+					slot->fi = fi;
+					slot->first = false;
+					slot->end = false;
+					slot->data_size = 0;
+				}
+				slot->type = kReadFailed;
+				slot->os_message = os_msg;
+				Publish();
+				break;
+			}
+			slot->end = read_count == 0;
+			slot->data_size += read_count;
+			if (slot->end || slot->data_size == kSlotSize) {
+				Publish();
+				if (slot->end) {
+					break;
+				}
+				slot = AcquireFree();
+				if (slot == nullptr) {
+					return;
+				}
+				slot->type = kData;
+				slot->fi = fi;
+				slot->first = false;
+				slot->end = false;
+				slot->data_size = 0;
+			}
+		}
+	}
+}
+
+// Waits for an empty slot. Returns nullptr on exit.
+StagingReader::Slot* StagingReader::AcquireFree()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (filled == kSlotCount && !exit) {
+		cv.wait(lock);
+	}
+	if (exit) {
+		return nullptr;
+	}
+	return &slots[write_index];
+}
+
+void StagingReader::Publish()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		write_index = (write_index + 1) % kSlotCount;
+		++filled;
+	}
+	cv.notify_all();
+}
+
+// Compressor thread
+StagingReader::Slot* StagingReader::AcquireFilled()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (filled == 0) {
+		cv.wait(lock);
+	}
+	current_pos = 0;
+	return &slots[read_index];
+}
+
+void StagingReader::Release()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		read_index = (read_index + 1) % kSlotCount;
+		--filled;
+	}
+	cv.notify_all();
+	current = nullptr;
+}
+
+bool StagingReader::Open(ArchiveCompressor::FileInfo& fi)
+{
+	current = AcquireFilled();
+	assert(current->fi == &fi && current->first);
+	if (current->type == kOpenFailed) {
+		os_message = current->os_message;
+		Release();
+		return false;
+	}
+	fi.size = current->size;
+	fi.creat_time = current->creat_time;
+	fi.mod_time = current->mod_time;
+	fi.attributes = current->attributes;
+	return true;
+}
+
+bool StagingReader::Read(void* buffer, uint_fast32_t byte_count, unsigned long& bytes_read)
+{
+	for (;;) {
+		if (current == nullptr) {
+			current = AcquireFilled();
+		}
+		if (current->type == kReadFailed) {
+			os_message = current->os_message;
+			Release();
+			return false;
+		}
+		if (current_pos < current->data_size) {
+			size_t count = std::min<size_t>(byte_count, current->data_size - current_pos);
+			memcpy(buffer, current->data.data() + current_pos, count);
+			current_pos += count;
+			bytes_read = static_cast<unsigned long>(count);
+			if (current_pos == current->data_size && !current->end) {
+				Release();
+			}
+			return true;
+		}
+		bool end = current->end;
+		Release();
+		if (end) {
+			bytes_read = 0;
+			return true;
+		}
+	}
+}
+
+}
@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: StagingReader
+//        Reads input files ahead of the compressor on a separate thread
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_STAGING_READER_H
+#define RADYX_STAGING_READER_H
+
+#include <array>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include "common.h"
+#include "ArchiveCompressor.h"
+
+namespace Radyx {
+
+class StagingReader
+{
+public:
+	// The files are read in list order and must be opened in the same order
+	StagingReader(const std::list<ArchiveCompressor::FileInfo>& file_list, const RadyxOptions& options);
+	~StagingReader();
+	// Waits until the next file is opened and copies its attributes to fi.
+	// Returns false if it could not be opened.
+	bool Open(ArchiveCompressor::FileInfo& fi);
+	// Same as FileReader::Read. Returns 0 bytes at the end of the file.
+	bool Read(void* buffer, uint_fast32_t byte_count, unsigned long& bytes_read);
+	// The OS error message for the last failed Open or Read
+	const _TCHAR* GetOsMessage() const { return os_message.c_str(); }
+
+private:
+	static const size_t kSlotCount = 8;
+	static const size_t kSlotSize = size_t(1) << 20;
+
+	enum SlotType
+	{
+		kOpenFailed,
+		kData,
+		kReadFailed
+	};
+
+	struct Slot
+	{
+		SlotType type;
+		const ArchiveCompressor::FileInfo* fi;
+		// Attributes read when the file was opened
+		uint_least64_t size;
+		OptionalSetting<uint_least64_t> creat_time;
+		OptionalSetting<uint_least64_t> mod_time;
+		OptionalSetting<uint_fast32_t> attributes;
+		bool first;
+		bool end;
+		size_t data_size;
+		FsString os_message;
+		std::vector<uint8_t> data;
+		Slot()
+			: type(kData),
+			fi(nullptr),
+			size(0),
+			creat_time(0),
+			mod_time(0),
+			attributes(0),
+			first(false),
+			end(false),
+			data_size(0) {}
+	};
+
+	void ReadFiles();
+	Slot* AcquireFree();
+	void Publish();
+	Slot* AcquireFilled();
+	void Release();
+
+	std::vector<const ArchiveCompressor::FileInfo*> files;
+	bool share_deny_none;
+	bool drop_cache;
+	bool store_creation_time;
+	std::array<Slot, kSlotCount> slots;
+	// Ring positions. Slots from read_index to write_index hold data.
+	size_t read_index;
+	size_t write_index;
+	size_t filled;
+	bool exit;
+	std::mutex mutex;
+	std::condition_variable cv;
+	// Consumer state
+	Slot* current;
+	size_t current_pos;
+	FsString os_message;
+	// The reader blocks on I/O and on free slots, so it has its own thread
+	// rather than holding a worker of the shared pool
+	std::thread reader_thread;
+
+	StagingReader(const StagingReader&) = delete;
+	StagingReader& operator=(const StagingReader&) = delete;
+};
+
+}
+
+#endif // RADYX_STAGING_READER_H
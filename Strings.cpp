@@ -32,26 +32,45 @@ const _TCHAR Strings::kHelpString[] = _T(
 "\n"
 "<Commands>\n"
 "  a : Add files to archive\n"
+"  u : Update files in archive\n"
+"  b : Run the archive jobs listed in a manifest file\n"
 "\n"
 "<Switches>\n"
 "  -- : Stop switches parsing\n"
 "  @listfile : set path to listfile that contains file names\n"
 "  -ar[-] : Read more input while compressing (default: on)\n"
+"  -ars : Read ahead into small staging buffers instead\n"
+"  -bt : show execution time statistics\n"
 "  -q[-] : disable input filename display\n"
 "  -i[r[-|0]]{@listfile|!wildcard} : Include filenames\n"
+"  -j{N} : set number of batch jobs run at once\n"
 "  -m{Parameters} : set compression method\n"
+"    -mgp[=on|off] : use settings suited to text, media and executables\n"
+"    -mhp[=on|off] : use huge pages for the dictionary\n"
 "    -mmt[N] : set number of CPU threads\n"
+"    -mmemuse={N}[b|k|m|g]|p{N} : set memory usage limit\n"
+"    -mnuma[=on|off] : interleave memory across NUMA nodes\n"
 "    -mx[N] : set compression level: -mx1 (fastest) ... -mx12 (ultra)\n"
+"    -mx=auto[:r{N}|:s{N}] : choose parameters by trial compression of a sample\n"
 "  -r[-|0] : Recurse subdirectories\n"
+"  -resume : journal each solid block and resume an interrupted archive\n"
+"  -tl{file} : write JSON progress records to file (- for stdout)\n"
+"  -ti{N} : set interval of progress records in milliseconds\n"
 "  -ssw : compress shared files\n"
+"  -v{Size}[b|k|m|g] : Create volumes\n"
+"  -verify : decode each solid block after compressing it and check the CRCs\n"
 "  -w[{path}] : assign work directory\n"
 "  -x[r[-|0]]{@listfile|!wildcard} : exclude filenames\n");
 const char Strings::kBreakSignaled[] = "Break signaled.";
+const char Strings::kVerifyFailed[] = "Archive verification failed.";
 const _TCHAR Strings::kExtractionUnsupported[] = _T("This version of Radyx does not support extraction.\nUse 7-zip or a compatible program.");
 const _TCHAR Strings::kNoCommandSpecified[] = _T("No command specified");
 const _TCHAR Strings::kLcLpNoGreaterThan4[] = _T("Literal context bits (-mlc) + literal position bits (-mlp) must be no greater than 4.");
 const _TCHAR Strings::kSearching[] = _T("Searching...");
+const _TCHAR Strings::kTuning[] = _T("Tuning...");
 const _TCHAR Strings::kCreatingArchive_[] = _T("Creating archive ");
+const _TCHAR Strings::kUpdatingArchive_[] = _T("Updating archive ");
+const _TCHAR Strings::kResumingArchive_[] = _T("Resuming archive ");
 const _TCHAR Strings::kNameCollision_[] = _T("Duplicate filenames: ");
 const _TCHAR Strings::kAdding_[] = _T("Adding ");
 const _TCHAR Strings::kCannotOpen_[] = _T("Cannot open ");
@@ -67,8 +86,28 @@ const _TCHAR Strings::k_file[] = _T(" file.");
 const _TCHAR Strings::k_files[] = _T(" files.");
 const _TCHAR Strings::kUnableConvertUtf8to16[] = _T("Unable to convert filename from UTF-8 to UTF-16.");
 const _TCHAR Strings::kCannotWriteArchive[] = _T("Cannot write archive file");
-const _TCHAR Strings::kArchiveFileExists[] = _T("Archive file exists. This version of Radyx does not support updating.");
+const _TCHAR Strings::kArchiveFileExists[] = _T("Archive file exists. Use the u command to update it.");
 const _TCHAR Strings::kCannotCreateArchive[] = _T("Cannot create archive file");
+const _TCHAR Strings::kCannotReplaceArchive[] = _T("Cannot replace archive file");
+const _TCHAR Strings::kUnsupportedArchive[] = _T("Archive was not created by Radyx or cannot be updated");
+const _TCHAR Strings::kUpdateVolumesUnsupported[] = _T("Archives split into volumes cannot be updated.");
+const _TCHAR Strings::kKeptUnits_[] = _T("Unchanged solid blocks kept: ");
+const _TCHAR Strings::kRemoving_[] = _T("Not found, removing ");
+const _TCHAR Strings::kResumeUnsupported[] = _T("-resume cannot be used with volumes or the u command.");
+const _TCHAR Strings::kResumedUnits_[] = _T("Completed solid blocks resumed: ");
+const _TCHAR Strings::kPartialArchiveKept[] = _T("The partial archive was kept. Run the same command again to resume.");
+const _TCHAR Strings::kCannotWriteJournal[] = _T("Cannot write journal file");
+const _TCHAR Strings::kIgnoringJournal_[] = _T("Journal does not match the archive and is ignored: ");
+const _TCHAR Strings::kMissingManifestName[] = _T("Missing manifest file name.");
+const _TCHAR Strings::kBatchFileNames[] = _T("File names for a batch belong in the manifest.");
+const _TCHAR Strings::kCannotOpenManifest[] = _T("Cannot open manifest file");
+const _TCHAR Strings::kBadManifestLine_[] = _T("Unterminated quote or invalid UTF-8 in manifest line ");
+const _TCHAR Strings::kBatchJobUnsupported[] = _T("Batch jobs cannot use the b command or -w.");
+const _TCHAR Strings::kNoJobsFound[] = _T("No jobs found.");
+const _TCHAR Strings::kJob_[] = _T("Job ");
+const _TCHAR Strings::kFailed[] = _T("Failed.");
+const _TCHAR Strings::kSourceUnsupported[] = _T("Files from a source cannot be used with update, resume or auto-tuning.");
+const _TCHAR Strings::kSinkUnsupported[] = _T("An output sink cannot be used with update, resume or volumes.");
 const _TCHAR Strings::kErrorCol_[] = _T("\rError: ");
 const _TCHAR Strings::kErrorNotEnoughMem[] = _T("Error: Not enough memory. Try decreasing the dictionary size.");
 const _TCHAR Strings::kExtraCharsAfterSwitch_[] = _T("Extra characters after switch ");
@@ -80,7 +119,14 @@ const _TCHAR Strings::k_at_[] = _T(" at ");
 const _TCHAR Strings::kMissingListFileName[] = _T("Missing list file name.");
 const _TCHAR Strings::kMissingArchiveName[] = _T("Missing archive name.");
 const _TCHAR Strings::kCannotOpenList[] = _T("Cannot open list file");
-const _TCHAR Strings::kCannotReadList[] = _T("Cannot read list file");
+const _TCHAR Strings::kCannotOpenTelemetry[] = _T("Cannot open telemetry file");
+const _TCHAR Strings::kCannotReadArchive[] = _T("Cannot read archive file");
+const _TCHAR Strings::kDataErrorInUnit_[] = _T("Data error in solid block ");
+const _TCHAR Strings::kCrcFailed_[] = _T("CRC failed: ");
+const _TCHAR Strings::kVerified_[] = _T("Solid blocks verified: ");
+const _TCHAR Strings::kMemoryLimit_[] = _T("Memory limit ");
+const _TCHAR Strings::kMemoryLimitExceeded_[] = _T("Warning: Memory limit exceeded. Estimated usage is ");
+const _TCHAR Strings::kNumaUnavailable[] = _T("Warning: NUMA interleaving is not available. Memory will be allocated normally.");
 const _TCHAR Strings::kUnknownError[] = _T("Unknown error.");
 const _TCHAR Strings::kDone[] = _T("Done.");
 }
\ No newline at end of file
@@ -32,11 +32,15 @@ class Strings
 public:
 	static const _TCHAR kHelpString[];
     static const char kBreakSignaled[];
+	static const char kVerifyFailed[];
     static const _TCHAR kExtractionUnsupported[];
 	static const _TCHAR kNoCommandSpecified[];
 	static const _TCHAR kLcLpNoGreaterThan4[];
 	static const _TCHAR kSearching[];
+	static const _TCHAR kTuning[];
 	static const _TCHAR kCreatingArchive_[];
+	static const _TCHAR kUpdatingArchive_[];
+	static const _TCHAR kResumingArchive_[];
 	static const _TCHAR kNameCollision_[];
 	static const _TCHAR kAdding_[];
 	static const _TCHAR kCannotOpen_[];
@@ -54,6 +58,26 @@ public:
 	static const _TCHAR kCannotWriteArchive[];
 	static const _TCHAR kArchiveFileExists[];
 	static const _TCHAR kCannotCreateArchive[];
+	static const _TCHAR kCannotReplaceArchive[];
+	static const _TCHAR kUnsupportedArchive[];
+	static const _TCHAR kUpdateVolumesUnsupported[];
+	static const _TCHAR kKeptUnits_[];
+	static const _TCHAR kRemoving_[];
+	static const _TCHAR kResumeUnsupported[];
+	static const _TCHAR kResumedUnits_[];
+	static const _TCHAR kPartialArchiveKept[];
+	static const _TCHAR kCannotWriteJournal[];
+	static const _TCHAR kIgnoringJournal_[];
+	static const _TCHAR kMissingManifestName[];
+	static const _TCHAR kBatchFileNames[];
+	static const _TCHAR kCannotOpenManifest[];
+	static const _TCHAR kBadManifestLine_[];
+	static const _TCHAR kBatchJobUnsupported[];
+	static const _TCHAR kNoJobsFound[];
+	static const _TCHAR kJob_[];
+	static const _TCHAR kFailed[];
+	static const _TCHAR kSourceUnsupported[];
+	static const _TCHAR kSinkUnsupported[];
 	static const _TCHAR kErrorCol_[];
 	static const _TCHAR kErrorNotEnoughMem[];
 	static const _TCHAR kExtraCharsAfterSwitch_[];
@@ -65,7 +89,14 @@ public:
 	static const _TCHAR kMissingListFileName[];
 	static const _TCHAR kMissingArchiveName[];
 	static const _TCHAR kCannotOpenList[];
-	static const _TCHAR kCannotReadList[];
+	static const _TCHAR kCannotOpenTelemetry[];
+	static const _TCHAR kCannotReadArchive[];
+	static const _TCHAR kDataErrorInUnit_[];
+	static const _TCHAR kCrcFailed_[];
+	static const _TCHAR kVerified_[];
+	static const _TCHAR kMemoryLimit_[];
+	static const _TCHAR kMemoryLimitExceeded_[];
+	static const _TCHAR kNumaUnavailable[];
 	static const _TCHAR kUnknownError[];
 	static const _TCHAR kDone[];
 };
@@ -0,0 +1,217 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: Telemetry
+//        Machine-readable progress records written as JSON lines
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "winlean.h"
+#include "Telemetry.h"
+
+namespace Radyx {
+
+Telemetry::Telemetry()
+	: out(nullptr),
+	interval(0)
+{
+	prev.total_bytes = 0;
+	prev.read_bytes = 0;
+	prev.packed_bytes = 0;
+	prev.wait_ns = 0;
+}
+
+Telemetry::~Telemetry()
+{
+	if (out != nullptr && out != stdout && out != stderr) {
+		fclose(out);
+	}
+}
+
+// A path of "-" writes the records to stdout
+bool Telemetry::Open(const _TCHAR* path, unsigned interval_ms)
+{
+	if (path[0] == '-' && path[1] == '\0') {
+		out = stdout;
+	}
+	else {
+		out = _tfopen(path, _T("w"));
+		if (out == nullptr) {
+			return false;
+		}
+	}
+	interval = std::chrono::milliseconds(interval_ms);
+	start = Clock::now();
+	prev_time = start;
+	next_report = start + interval;
+	return true;
+}
+
+double Telemetry::GetElapsed(Clock::time_point now) const
+{
+	return std::chrono::duration<double>(now - start).count();
+}
+
+void Telemetry::WriteProgress(Clock::time_point now, const Totals& totals, const FsString& file)
+{
+	double seconds = std::chrono::duration<double>(now - prev_time).count();
+	if (seconds <= 0) {
+		seconds = 1e-9;
+	}
+	fprintf(out, "{\"event\":\"progress\",\"time\":%.3f,\"total\":%llu,\"read\":%llu,\"packed\":%llu"
+		",\"read_rate\":%.0f,\"pack_rate\":%.0f,\"wait\":%.3f,\"file\":",
+		GetElapsed(now),
+		static_cast<unsigned long long>(totals.total_bytes),
+		static_cast<unsigned long long>(totals.read_bytes),
+		static_cast<unsigned long long>(totals.packed_bytes),
+		(totals.read_bytes - prev.read_bytes) / seconds,
+		(totals.packed_bytes - prev.packed_bytes) / seconds,
+		totals.wait_ns / 1e9);
+	WriteString(file);
+	fputs("}\n", out);
+	fflush(out);
+	prev = totals;
+	prev_time = now;
+	next_report = now + interval;
+}
+
+void Telemetry::WriteUnit(size_t index, uint_least64_t unpack_size, uint_least64_t pack_size)
+{
+	fprintf(out, "{\"event\":\"unit\",\"time\":%.3f,\"index\":%llu,\"unpack\":%llu,\"pack\":%llu,\"ratio\":%.4f}\n",
+		GetElapsed(Clock::now()),
+		static_cast<unsigned long long>(index),
+		static_cast<unsigned long long>(unpack_size),
+		static_cast<unsigned long long>(pack_size),
+		unpack_size != 0 ? double(pack_size) / unpack_size : 0.0);
+	fflush(out);
+}
+
+void Telemetry::WriteDone(const Totals& totals)
+{
+	Clock::time_point now = Clock::now();
+	double seconds = GetElapsed(now);
+	if (seconds <= 0) {
+		seconds = 1e-9;
+	}
+	fprintf(out, "{\"event\":\"done\",\"time\":%.3f,\"read\":%llu,\"packed\":%llu"
+		",\"read_rate\":%.0f,\"pack_rate\":%.0f,\"wait\":%.3f}\n",
+		seconds,
+		static_cast<unsigned long long>(totals.read_bytes),
+		static_cast<unsigned long long>(totals.packed_bytes),
+		totals.read_bytes / seconds,
+		totals.packed_bytes / seconds,
+		totals.wait_ns / 1e9);
+	fflush(out);
+}
+
+// Length of the valid UTF-8 sequence at pos, or 0 if it is not valid
+static size_t GetUtf8Length(const std::string& str, size_t pos)
+{
+	unsigned c = static_cast<unsigned char>(str[pos]);
+	if (c < 0x80) {
+		return 1;
+	}
+	size_t length;
+	unsigned code;
+	unsigned min_code;
+	if (c >= 0xC2 && c < 0xE0) {
+		length = 2;
+		code = c & 0x1F;
+		min_code = 0x80;
+	}
+	else if (c >= 0xE0 && c < 0xF0) {
+		length = 3;
+		code = c & 0x0F;
+		min_code = 0x800;
+	}
+	else if (c >= 0xF0 && c < 0xF5) {
+		length = 4;
+		code = c & 0x07;
+		min_code = 0x10000;
+	}
+	else {
+		return 0;
+	}
+	if (str.length() - pos < length) {
+		return 0;
+	}
+	for (size_t i = 1; i < length; ++i) {
+		unsigned next = static_cast<unsigned char>(str[pos + i]);
+		if ((next & 0xC0) != 0x80) {
+			return 0;
+		}
+		code = (code << 6) | (next & 0x3F);
+	}
+	// Overlong forms, surrogates and values past U+10FFFF are invalid
+	if (code < min_code || (code >= 0xD800 && code < 0xE000) || code > 0x10FFFF) {
+		return 0;
+	}
+	return length;
+}
+
+// Write a quoted, escaped UTF-8 JSON string. Bytes which are not valid UTF-8,
+// as POSIX file names may contain, are written as \u00XX.
+void Telemetry::WriteString(const FsString& str)
+{
+#ifdef _UNICODE
+	std::string utf8;
+	int len = WideCharToMultiByte(CP_UTF8, 0, str.c_str(), static_cast<int>(str.length()), nullptr, 0, nullptr, nullptr);
+	if (len > 0) {
+		utf8.resize(len);
+		WideCharToMultiByte(CP_UTF8, 0, str.c_str(), static_cast<int>(str.length()), &utf8[0], len, nullptr, nullptr);
+	}
+#else
+	const std::string& utf8 = str;
+#endif
+	fputc('"', out);
+	for (size_t i = 0; i < utf8.length();) {
+		char c = utf8[i];
+		size_t length = GetUtf8Length(utf8, i);
+		if (length == 0) {
+			fprintf(out, "\\u%04x", static_cast<unsigned char>(c));
+			++i;
+			continue;
+		}
+		if (length > 1) {
+			fwrite(utf8.data() + i, 1, length, out);
+			i += length;
+			continue;
+		}
+		switch (c) {
+		case '"':
+			fputs("\\\"", out);
+			break;
+		case '\\':
+			fputs("\\\\", out);
+			break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				fprintf(out, "\\u%04x", static_cast<unsigned>(c));
+			}
+			else {
+				fputc(c, out);
+			}
+			break;
+		}
+		++i;
+	}
+	fputc('"', out);
+}
+
+}
@@ -0,0 +1,74 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: Telemetry
+//        Machine-readable progress records written as JSON lines
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_TELEMETRY_H
+#define RADYX_TELEMETRY_H
+
+#include <cstdio>
+#include <chrono>
+#include "common.h"
+#include "CharType.h"
+
+namespace Radyx {
+
+class Telemetry
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Totals
+	{
+		uint_least64_t total_bytes;
+		uint_least64_t read_bytes;
+		uint_least64_t packed_bytes;
+		uint_least64_t wait_ns;
+	};
+
+	Telemetry();
+	~Telemetry();
+	bool Open(const _TCHAR* path, unsigned interval_ms);
+	bool IsOpen() const { return out != nullptr; }
+	inline bool IsDue(Clock::time_point now) const { return now >= next_report; }
+	void WriteProgress(Clock::time_point now, const Totals& totals, const FsString& file);
+	void WriteUnit(size_t index, uint_least64_t unpack_size, uint_least64_t pack_size);
+	void WriteDone(const Totals& totals);
+
+private:
+	void WriteString(const FsString& str);
+	double GetElapsed(Clock::time_point now) const;
+
+	FILE* out;
+	Clock::duration interval;
+	Clock::time_point start;
+	Clock::time_point next_report;
+	Clock::time_point prev_time;
+	Totals prev;
+
+	Telemetry(const Telemetry&) = delete;
+	Telemetry& operator=(const Telemetry&) = delete;
+};
+
+}
+
+#endif // RADYX_TELEMETRY_H
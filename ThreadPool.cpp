@@ -0,0 +1,264 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: ThreadPool
+//        Work-stealing pool for Radyx-side parallel work
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#ifdef _WIN32
+#include "winlean.h"
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+namespace Radyx {
+
+void Latch::CountDown()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	assert(count != 0);
+	if (--count == 0) {
+		cv.notify_all();
+	}
+}
+
+void Latch::CountDown(std::exception_ptr error_)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (!error) {
+			error = error_;
+		}
+	}
+	CountDown();
+}
+
+void Latch::Wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (count != 0) {
+		cv.wait(lock);
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+bool Latch::IsReleased()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return count == 0;
+}
+
+thread_local ThreadPool* ThreadPool::current_pool = nullptr;
+thread_local size_t ThreadPool::current_index = 0;
+
+ThreadPool::ThreadPool(unsigned thread_count, bool pin_threads)
+	: next_worker(0),
+	pending(0),
+	exit(false)
+{
+	if (thread_count == 0) {
+		thread_count = std::max(std::thread::hardware_concurrency(), 1U);
+	}
+	workers.reserve(thread_count);
+	for (unsigned i = 0; i < thread_count; ++i) {
+		workers.emplace_back(new Worker);
+	}
+	// Start the threads only when all deques exist, as they steal from each other
+	for (unsigned i = 0; i < thread_count; ++i) {
+		workers[i]->thread = std::thread(&ThreadPool::WorkerFn, this, i);
+		if (pin_threads) {
+			SetAffinity(workers[i]->thread, i);
+		}
+#ifdef _WIN32
+		SetThreadPriority(HANDLE(workers[i]->thread.native_handle()), THREAD_PRIORITY_BELOW_NORMAL);
+#endif
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		exit = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers) {
+		worker->thread.join();
+	}
+}
+
+ThreadPool& ThreadPool::GetShared()
+{
+	static ThreadPool pool(0, false);
+	return pool;
+}
+
+void ThreadPool::SetAffinity(std::thread& thread, unsigned cpu)
+{
+#ifdef _WIN32
+	if (cpu < sizeof(DWORD_PTR) * 8) {
+		SetThreadAffinityMask(HANDLE(thread.native_handle()), DWORD_PTR(1) << cpu);
+	}
+#elif defined(__linux__)
+	if (cpu < CPU_SETSIZE) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+	}
+#else
+	(void)thread;
+	(void)cpu;
+#endif
+}
+
+void ThreadPool::Submit(Task task)
+{
+	size_t index;
+	if (current_pool == this) {
+		index = current_index;
+	}
+	else {
+		index = next_worker++ % workers.size();
+	}
+#ifdef RADYX_STATS
+	// Timed from here to when a worker takes it, so only tasks which have
+	// left the queue are counted
+	uint_least64_t queued = Profiler::GetTicks();
+	Task timed_task(std::move(task));
+	task = [timed_task, queued]() {
+		RADYX_STATS_INTERVAL(kTaskQueued, Profiler::GetTicks() - queued);
+		timed_task();
+	};
+#endif
+	{
+		std::unique_lock<std::mutex> lock(workers[index]->mutex);
+		workers[index]->tasks.push_back(std::move(task));
+	}
+	{
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		++pending;
+	}
+	wake.notify_one();
+}
+
+void ThreadPool::Submit(Task task, Latch& latch)
+{
+	Submit([task, &latch]() {
+		try {
+			task();
+		}
+		catch (...) {
+			latch.CountDown(std::current_exception());
+			return;
+		}
+		latch.CountDown();
+	});
+}
+
+void ThreadPool::Wait(Latch& latch)
+{
+	if (current_pool == this) {
+		// Help until there is nothing left to do; the remaining tasks are
+		// then running elsewhere
+		while (!latch.IsReleased() && RunPendingTask(current_index)) {
+		}
+	}
+	latch.Wait();
+}
+
+// The owner takes the newest task, which is most likely still in cache
+bool ThreadPool::PopTask(size_t index, Task& task)
+{
+	Worker& worker = *workers[index];
+	std::unique_lock<std::mutex> lock(worker.mutex);
+	if (worker.tasks.empty()) {
+		return false;
+	}
+	task = std::move(worker.tasks.back());
+	worker.tasks.pop_back();
+	return true;
+}
+
+// Thieves take the oldest task from the other workers in turn
+bool ThreadPool::StealTask(size_t index, Task& task)
+{
+	for (size_t i = 1; i < workers.size(); ++i) {
+		Worker& victim = *workers[(index + i) % workers.size()];
+		std::unique_lock<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			RADYX_STATS_COUNT(kTasksStolen, 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ThreadPool::RunPendingTask(size_t index)
+{
+	Task task;
+	if (!PopTask(index, task) && !StealTask(index, task)) {
+		return false;
+	}
+	--pending;
+	RADYX_STATS_COUNT(kTasksRun, 1);
+	try {
+		task();
+	}
+	catch (...) {
+		// SubmitFuture and latch tasks keep their exceptions, so this came
+		// from a plain Submit with nowhere to report it
+		std::terminate();
+	}
+	return true;
+}
+
+void ThreadPool::WorkerFn(size_t index)
+{
+	current_pool = this;
+	current_index = index;
+	for (;;) {
+		RADYX_STATS_START(kTaskRun);
+		bool ran = RunPendingTask(index);
+		RADYX_STATS_STOP(kTaskRun);
+		if (ran) {
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		RADYX_STATS_START(kWorkerIdle);
+		while (pending == 0 && !exit) {
+			wake.wait(lock);
+		}
+		RADYX_STATS_STOP(kWorkerIdle);
+		if (exit && pending == 0) {
+			break;
+		}
+	}
+}
+
+}
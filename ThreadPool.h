@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: ThreadPool
+//        Work-stealing pool for Radyx-side parallel work
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_THREAD_POOL_H
+#define RADYX_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "common.h"
+
+namespace Radyx {
+
+// Counts down completed tasks. Wait() blocks until the count reaches zero,
+// then rethrows the first exception a task failed with.
+class Latch
+{
+public:
+	explicit Latch(size_t count_) : count(count_) {}
+	void CountDown();
+	void CountDown(std::exception_ptr error_);
+	void Wait();
+	bool IsReleased();
+
+private:
+	size_t count;
+	std::exception_ptr error;
+	std::mutex mutex;
+	std::condition_variable cv;
+
+	Latch(const Latch&) = delete;
+	Latch& operator=(const Latch&) = delete;
+};
+
+class ThreadPool
+{
+public:
+	typedef std::function<void()> Task;
+
+	// A thread_count of 0 uses one thread per hardware thread. If pin_threads
+	// is set, worker N is bound to logical CPU N.
+	explicit ThreadPool(unsigned thread_count, bool pin_threads);
+	~ThreadPool();
+	// Pool shared by all Radyx-side parallel work, created on first use. It
+	// is for short CPU-bound tasks only: anything that blocks waiting for
+	// I/O or for another thread needs a thread of its own, or it can hold
+	// the worker a task it waits on is queued behind.
+	static ThreadPool& GetShared();
+	unsigned GetThreadCount() const { return static_cast<unsigned>(workers.size()); }
+	// Queue a task. Tasks queued from a worker go to that worker's own deque;
+	// others are spread between workers. Idle workers steal from the others.
+	// The task has nowhere to report an exception, so one ends the program
+	// as it would on a std::thread.
+	void Submit(Task task);
+	// Queue a task and get a future for its result or exception
+	template<class F>
+	std::future<typename std::result_of<F()>::type> SubmitFuture(F fn);
+	// Queue a task which counts down the latch when it finishes or throws
+	void Submit(Task task, Latch& latch);
+	// Waits for the latch, running queued tasks in the meantime if called
+	// from a worker so that nested waits cannot starve the pool
+	void Wait(Latch& latch);
+
+private:
+	struct Worker
+	{
+		std::deque<Task> tasks;
+		std::mutex mutex;
+		std::thread thread;
+	};
+
+	void WorkerFn(size_t index);
+	bool PopTask(size_t index, Task& task);
+	bool StealTask(size_t index, Task& task);
+	bool RunPendingTask(size_t index);
+	static void SetAffinity(std::thread& thread, unsigned cpu);
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<size_t> next_worker;
+	// Tasks queued and not yet taken. Incremented under sleep_mutex so that
+	// a worker about to sleep cannot miss a wakeup.
+	std::atomic<size_t> pending;
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	bool exit;
+
+	static thread_local ThreadPool* current_pool;
+	static thread_local size_t current_index;
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+};
+
+template<class F>
+std::future<typename std::result_of<F()>::type> ThreadPool::SubmitFuture(F fn)
+{
+	typedef typename std::result_of<F()>::type Result;
+	auto task = std::make_shared<std::packaged_task<Result()>>(std::move(fn));
+	std::future<Result> future = task->get_future();
+	Submit([task]() { (*task)(); });
+	return future;
+}
+
+}
+
+#endif // RADYX_THREAD_POOL_H
@@ -0,0 +1,478 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: VolumeWriter
+//        Writes an archive as a single file or a set of fixed-size volumes
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <fstream>
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#endif
+#include "VolumeWriter.h"
+#include "Profiler.h"
+
+namespace Radyx {
+
+#ifdef _WIN32
+const VolumeWriter::Handle VolumeWriter::kInvalidHandle = INVALID_HANDLE_VALUE;
+#endif
+const size_t VolumeWriter::kCopyBufferSize;
+
+VolumeWriter::VolumeWriter()
+	: volume_size(0),
+	position(0),
+	current(0),
+	sink(nullptr),
+	no_caching(false),
+	sync_handle(kInvalidHandle),
+	sync_volume(0),
+	sync_ok(true),
+	sync_error(0),
+	sync_failed(false),
+	failed(false),
+	failed_volume(0),
+	failed_error(0)
+{
+}
+
+VolumeWriter::~VolumeWriter()
+{
+	Close();
+}
+
+// Volumes are named in the 7-zip style: archive.7z.001, archive.7z.002 ...
+Path VolumeWriter::GetVolumeName(const Path& base_name, uint_least64_t volume_size, size_t index)
+{
+	if (volume_size == 0) {
+		return base_name;
+	}
+	Path name(base_name);
+	name.push_back('.');
+	_TCHAR digits[24];
+	size_t count = 0;
+	for (size_t number = index + 1; number != 0 || count < 3; number /= 10) {
+		digits[count++] = static_cast<_TCHAR>('0' + number % 10);
+	}
+	while (count > 0) {
+		name.push_back(digits[--count]);
+	}
+	return name;
+}
+
+bool VolumeWriter::Open(const _TCHAR* filename, uint_least64_t volume_size_, bool no_caching_)
+{
+	Close();
+	base_name = filename;
+	volume_size = volume_size_;
+	no_caching = no_caching_;
+	position = 0;
+	current = 0;
+	sync_failed = false;
+	failed = false;
+	failed_volume = 0;
+	failed_error = 0;
+	volumes.clear();
+	Handle handle = CreateVolume(0);
+	if (handle == kInvalidHandle) {
+		return false;
+	}
+	volumes.push_back(handle);
+	return true;
+}
+
+bool VolumeWriter::Reopen(const _TCHAR* filename, uint_least64_t pos, bool no_caching_)
+{
+	Close();
+	base_name = filename;
+	volume_size = 0;
+	no_caching = no_caching_;
+	current = 0;
+	sync_failed = false;
+	failed = false;
+	failed_volume = 0;
+	failed_error = 0;
+	volumes.clear();
+	Handle handle = ReopenVolume(0);
+	if (handle == kInvalidHandle) {
+		return false;
+	}
+	volumes.push_back(handle);
+	if (!TruncateHandle(handle, pos) || !SeekHandle(handle, pos)) {
+		return false;
+	}
+	position = pos;
+	return true;
+}
+
+bool VolumeWriter::Open(OutputSink& sink_)
+{
+	Close();
+	volume_size = 0;
+	position = 0;
+	current = 0;
+	sync_failed = false;
+	failed = false;
+	failed_volume = 0;
+	failed_error = 0;
+	volumes.clear();
+	sink = &sink_;
+	return true;
+}
+
+bool VolumeWriter::Write(const char* s, size_t n)
+{
+	if (sink != nullptr) {
+		if (!sink->Write(s, n)) {
+			return false;
+		}
+		position += n;
+		return true;
+	}
+	while (n != 0) {
+		size_t chunk = n;
+		if (volume_size != 0) {
+			uint_least64_t room = volume_size * (current + 1) - position;
+			if (room == 0) {
+				// Roll over to the next volume
+				size_t next = current + 1;
+				if (next == volumes.size()) {
+					Handle handle = CreateVolume(next);
+					if (handle == kInvalidHandle) {
+						SetFailed(next, GetOsError());
+						return false;
+					}
+					volumes.push_back(handle);
+				}
+				else if (volumes[next] == kInvalidHandle) {
+					volumes[next] = ReopenVolume(next);
+					if (volumes[next] == kInvalidHandle || !SeekHandle(volumes[next], 0)) {
+						SetFailed(next, GetOsError());
+						return false;
+					}
+				}
+				// The first volume stays open because the signature header is written last
+				if (current != 0) {
+					CompleteVolume(current);
+				}
+				current = next;
+				room = volume_size;
+			}
+			chunk = static_cast<size_t>(std::min<uint_least64_t>(room, n));
+		}
+		if (!WriteHandle(volumes[current], s, chunk)) {
+			SetFailed(current, GetOsError());
+			return false;
+		}
+		s += chunk;
+		n -= chunk;
+		position += chunk;
+	}
+	return true;
+}
+
+bool VolumeWriter::Seek(uint_least64_t pos)
+{
+	if (sink != nullptr) {
+		if (!sink->Seek(pos)) {
+			return false;
+		}
+		position = pos;
+		return true;
+	}
+	if (volumes.empty()) {
+		return false;
+	}
+	size_t index = 0;
+	if (volume_size != 0) {
+		index = static_cast<size_t>(std::min<uint_least64_t>(pos / volume_size, volumes.size() - 1));
+	}
+	if (volumes[index] == kInvalidHandle) {
+		volumes[index] = ReopenVolume(index);
+		if (volumes[index] == kInvalidHandle) {
+			return false;
+		}
+	}
+	if (!SeekHandle(volumes[index], pos - volume_size * index)) {
+		return false;
+	}
+	current = index;
+	position = pos;
+	return true;
+}
+
+bool VolumeWriter::CopyFrom(const _TCHAR* source, uint_least64_t pos, uint_least64_t count, const Cancellation& cancel)
+{
+	if (volume_size == 0 && sink == nullptr && IsOpen()) {
+		uint_least64_t copied = CopyRange(source, pos, count, cancel);
+		pos += copied;
+		count -= copied;
+		position += copied;
+	}
+	if (count == 0) {
+		return true;
+	}
+	// Anything the OS could not copy directly goes through a buffer
+	std::ifstream in(source, std::ios_base::in | std::ios_base::binary);
+	in.seekg(pos);
+	std::vector<char> buffer(static_cast<size_t>(std::min<uint_least64_t>(count, kCopyBufferSize)));
+	while (!cancel.IsSet() && count != 0) {
+		size_t chunk = static_cast<size_t>(std::min<uint_least64_t>(count, buffer.size()));
+		if (!in.read(buffer.data(), chunk) || !Write(buffer.data(), chunk)) {
+			return false;
+		}
+		count -= chunk;
+	}
+	return count == 0;
+}
+
+bool VolumeWriter::Sync()
+{
+	if (sink != nullptr) {
+		return true;
+	}
+	return IsOpen() && SyncHandle(volumes[current]);
+}
+
+bool VolumeWriter::Close()
+{
+	sink = nullptr;
+	WaitForSync();
+	for (auto& handle : volumes) {
+		if (handle != kInvalidHandle) {
+			CloseVolumeHandle(handle);
+			handle = kInvalidHandle;
+		}
+	}
+	return !sync_failed;
+}
+
+// Hand a finished volume to the sync thread so writing can continue
+void VolumeWriter::CompleteVolume(size_t index)
+{
+	WaitForSync();
+	sync_handle = volumes[index];
+	sync_volume = index;
+	sync_ok = true;
+	volumes[index] = kInvalidHandle;
+	sync_thread = std::thread(&VolumeWriter::SyncAndClose, this);
+}
+
+void VolumeWriter::SyncAndClose()
+{
+	Profiler::ScopedTimer timer(Profiler::kVolumeSync);
+	if (!SyncHandle(sync_handle)) {
+		sync_ok = false;
+		sync_error = GetOsError();
+	}
+	CloseVolumeHandle(sync_handle);
+	sync_handle = kInvalidHandle;
+}
+
+int VolumeWriter::GetOsError()
+{
+#ifdef _WIN32
+	return static_cast<int>(GetLastError());
+#else
+	return errno;
+#endif
+}
+
+void VolumeWriter::SetFailed(size_t index, int error)
+{
+	if (!failed) {
+		failed = true;
+		failed_volume = index;
+		failed_error = error;
+	}
+}
+
+void VolumeWriter::WaitForSync()
+{
+	if (sync_thread.joinable()) {
+		sync_thread.join();
+		if (!sync_ok) {
+			sync_failed = true;
+			SetFailed(sync_volume, sync_error);
+		}
+	}
+}
+
+#ifdef _WIN32
+
+VolumeWriter::Handle VolumeWriter::CreateVolume(size_t index)
+{
+	return CreateFile(GetVolumeName(base_name, volume_size, index).c_str(),
+		GENERIC_WRITE,
+		FILE_SHARE_READ,
+		NULL,
+		CREATE_NEW,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN | (no_caching ? FILE_FLAG_WRITE_THROUGH : 0),
+		NULL);
+}
+
+VolumeWriter::Handle VolumeWriter::ReopenVolume(size_t index)
+{
+	WaitForSync();
+	return CreateFile(GetVolumeName(base_name, volume_size, index).c_str(),
+		GENERIC_WRITE,
+		FILE_SHARE_READ,
+		NULL,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | (no_caching ? FILE_FLAG_WRITE_THROUGH : 0),
+		NULL);
+}
+
+bool VolumeWriter::WriteHandle(Handle handle, const char* s, size_t n)
+{
+	while (n != 0) {
+		// Avoid possible errors from large writes over a network in WinXP
+		DWORD to_write = static_cast<DWORD>(std::min(n, size_t(32) * 1024 * 1024 - 32768));
+		DWORD written;
+		if (WriteFile(handle, s, to_write, &written, NULL) == FALSE) {
+			return false;
+		}
+		n -= written;
+		s += written;
+	}
+	return true;
+}
+
+bool VolumeWriter::SeekHandle(Handle handle, uint_least64_t pos)
+{
+	LARGE_INTEGER li;
+	li.QuadPart = pos;
+	return SetFilePointerEx(handle, li, NULL, FILE_BEGIN) != FALSE;
+}
+
+bool VolumeWriter::TruncateHandle(Handle handle, uint_least64_t pos)
+{
+	return SeekHandle(handle, pos) && SetEndOfFile(handle) != FALSE;
+}
+
+bool VolumeWriter::SyncHandle(Handle handle)
+{
+	return FlushFileBuffers(handle) != FALSE;
+}
+
+void VolumeWriter::CloseVolumeHandle(Handle handle)
+{
+	::CloseHandle(handle);
+}
+
+uint_least64_t VolumeWriter::CopyRange(const _TCHAR*, uint_least64_t, uint_least64_t, const Cancellation&)
+{
+	return 0;
+}
+
+#else
+
+VolumeWriter::Handle VolumeWriter::CreateVolume(size_t index)
+{
+	return open(GetVolumeName(base_name, volume_size, index).c_str(),
+		O_WRONLY | O_CREAT | O_TRUNC | (volume_size != 0 ? O_EXCL : 0) | (no_caching ? O_DSYNC : 0),
+		0666);
+}
+
+VolumeWriter::Handle VolumeWriter::ReopenVolume(size_t index)
+{
+	WaitForSync();
+	return open(GetVolumeName(base_name, volume_size, index).c_str(),
+		O_WRONLY | (no_caching ? O_DSYNC : 0));
+}
+
+bool VolumeWriter::WriteHandle(Handle handle, const char* s, size_t n)
+{
+	while (n != 0) {
+		ssize_t written = write(handle, s, n);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		n -= written;
+		s += written;
+	}
+	return true;
+}
+
+bool VolumeWriter::SeekHandle(Handle handle, uint_least64_t pos)
+{
+	return lseek(handle, static_cast<off_t>(pos), SEEK_SET) >= 0;
+}
+
+bool VolumeWriter::TruncateHandle(Handle handle, uint_least64_t pos)
+{
+	return ftruncate(handle, static_cast<off_t>(pos)) == 0;
+}
+
+bool VolumeWriter::SyncHandle(Handle handle)
+{
+	return fsync(handle) == 0;
+}
+
+void VolumeWriter::CloseVolumeHandle(Handle handle)
+{
+	close(handle);
+}
+
+// Copies in the kernel where possible. Filesystems with shared extents such
+// as Btrfs and XFS can clone the range instead of copying the data. Returns
+// the number of bytes copied.
+uint_least64_t VolumeWriter::CopyRange(const _TCHAR* source, uint_least64_t pos, uint_least64_t count, const Cancellation& cancel)
+{
+	uint_least64_t copied = 0;
+#if defined(__linux__) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+	int in = open(source, O_RDONLY);
+	if (in < 0) {
+		return 0;
+	}
+	loff_t in_pos = static_cast<loff_t>(pos);
+	while (!cancel.IsSet() && copied < count) {
+		size_t chunk = static_cast<size_t>(std::min<uint_least64_t>(count - copied, UINT64_C(1) << 30));
+		ssize_t result = copy_file_range(in, &in_pos, volumes[current], nullptr, chunk, 0);
+		if (result < 0 && errno == EINTR) {
+			continue;
+		}
+		if (result <= 0) {
+			// Not supported between these files. The rest is copied normally.
+			break;
+		}
+		copied += result;
+	}
+	close(in);
+#else
+	(void)source;
+	(void)pos;
+	(void)count;
+	(void)cancel;
+#endif
+	return copied;
+}
+
+#endif // _WIN32
+
+}
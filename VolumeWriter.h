@@ -0,0 +1,119 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Class: VolumeWriter
+//        Writes an archive as a single file or a set of fixed-size volumes
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RADYX_VOLUME_WRITER_H
+#define RADYX_VOLUME_WRITER_H
+
+#include <thread>
+#include <vector>
+#include "winlean.h"
+#include "common.h"
+#include "CharType.h"
+#include "Path.h"
+#include "Cancellation.h"
+#include "OutputSink.h"
+
+namespace Radyx {
+
+class VolumeWriter
+{
+public:
+	VolumeWriter();
+	~VolumeWriter();
+	bool Open(const _TCHAR* filename, uint_least64_t volume_size_, bool no_caching_);
+	// Opens an existing single-volume file, truncated to pos, for appending
+	bool Reopen(const _TCHAR* filename, uint_least64_t pos, bool no_caching_);
+	// Writes to sink instead of a file. The sink must outlive Close.
+	bool Open(OutputSink& sink_);
+	bool Write(const char* s, size_t n);
+	bool Seek(uint_least64_t pos);
+	// Appends count bytes from pos in another file. Returns false if
+	// cancelled before the copy is done.
+	bool CopyFrom(const _TCHAR* source, uint_least64_t pos, uint_least64_t count, const Cancellation& cancel);
+	uint_least64_t Tell() const { return position; }
+	// Waits until the current volume is on disk
+	bool Sync();
+	bool Close();
+	bool IsOpen() const { return sink != nullptr || (!volumes.empty() && volumes[0] != kInvalidHandle); }
+	size_t GetVolumeCount() const { return volumes.size(); }
+	// Name of the volume where writing or syncing last failed, and the OS
+	// error code at the time
+	Path GetFailedName() const { return GetVolumeName(base_name, volume_size, failed_volume); }
+	int GetFailedError() const { return failed_error; }
+	static Path GetVolumeName(const Path& base_name, uint_least64_t volume_size, size_t index);
+
+private:
+#ifdef _WIN32
+	typedef HANDLE Handle;
+	static const Handle kInvalidHandle;
+#else
+	typedef int Handle;
+	static const Handle kInvalidHandle = -1;
+#endif
+
+	static const size_t kCopyBufferSize = size_t(1) << 20;
+
+	Handle CreateVolume(size_t index);
+	Handle ReopenVolume(size_t index);
+	void CompleteVolume(size_t index);
+	uint_least64_t CopyRange(const _TCHAR* source, uint_least64_t pos, uint_least64_t count, const Cancellation& cancel);
+	static bool WriteHandle(Handle handle, const char* s, size_t n);
+	static bool SeekHandle(Handle handle, uint_least64_t pos);
+	static bool TruncateHandle(Handle handle, uint_least64_t pos);
+	static bool SyncHandle(Handle handle);
+	static void CloseVolumeHandle(Handle handle);
+	void SyncAndClose();
+	static int GetOsError();
+	// Records the first failure only
+	void SetFailed(size_t index, int error);
+	// Joins the sync thread and takes its result
+	void WaitForSync();
+
+	Path base_name;
+	uint_least64_t volume_size;
+	uint_least64_t position;
+	std::vector<Handle> volumes;
+	size_t current;
+	OutputSink* sink;
+	bool no_caching;
+	// Completed volumes are synced and closed in the background, on a thread
+	// of their own because the sync can block for a long time. The thread
+	// sets only sync_ok and sync_error, which are read once it is joined.
+	std::thread sync_thread;
+	Handle sync_handle;
+	size_t sync_volume;
+	bool sync_ok;
+	int sync_error;
+	bool sync_failed;
+	bool failed;
+	size_t failed_volume;
+	int failed_error;
+
+	VolumeWriter(const VolumeWriter&) = delete;
+	VolumeWriter& operator=(const VolumeWriter&) = delete;
+};
+
+}
+
+#endif // RADYX_VOLUME_WRITER_H
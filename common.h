@@ -33,8 +33,6 @@
 #define noexcept
 #endif
 
-extern volatile bool g_break;
-
 namespace Radyx {
 
 #ifdef USE_64BIT_FAST_INT
@@ -43,38 +41,6 @@ typedef uint_fast64_t UintFast32;
 typedef uint_least32_t UintFast32;
 #endif
 
-#if defined(RADYX_STATS) && defined(InterlockedAdd64)
-
-inline void SubPerformanceCounter(volatile LONGLONG& counter)
-{
-	LARGE_INTEGER li;
-	QueryPerformanceCounter(&li);
-	counter -= li.QuadPart;
-}
-
-inline void AddPerformanceCounter(volatile LONGLONG& counter)
-{
-	LARGE_INTEGER li;
-	QueryPerformanceCounter(&li);
-	counter += li.QuadPart;
-}
-
-inline void AsyncSubPerformanceCounter(volatile LONGLONG& counter)
-{
-	LARGE_INTEGER li;
-	QueryPerformanceCounter(&li);
-	InterlockedAdd64(&counter, -li.QuadPart);
-}
-
-inline void AsyncAddPerformanceCounter(volatile LONGLONG& counter)
-{
-	LARGE_INTEGER li;
-	QueryPerformanceCounter(&li);
-	InterlockedAdd64(&counter, li.QuadPart);
-}
-
-#endif // RADYX_STATS
-
 }
 
 #endif // RADYX_COMMON_H_
\ No newline at end of file
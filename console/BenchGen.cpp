@@ -0,0 +1,414 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Program: BenchGen
+//          Generates the deterministic corpora used by the benchmark suite
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Usage: benchgen <dir> [size_mb]
+//
+// Creates these subdirectories of <dir>, each of which is archived separately:
+//   text   - C-like source files, size_mb in total
+//   elf    - x86-64 ELF-like executables (.out, so BCJ is applied), size_mb
+//   random - incompressible data, size_mb
+//   small  - 20000 files of 64 bytes to 8 kb in 100 directories
+//   huge   - one file of 8 * size_mb mixing the three kinds of content
+//
+// All content comes from fixed-seed generators so every run and every machine
+// produces identical files.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+namespace {
+
+const size_t kMb = 1024 * 1024;
+
+// xorshift64*: fast and identical on every platform
+class Random
+{
+public:
+	explicit Random(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ULL + 1) {}
+	uint64_t Next() {
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return state * 0x2545F4914F6CDD1DULL;
+	}
+	unsigned Below(unsigned n) { return static_cast<unsigned>((Next() >> 32) % n); }
+
+private:
+	uint64_t state;
+};
+
+bool MakeDir(const std::string& path)
+{
+#ifdef _WIN32
+	int res = _mkdir(path.c_str());
+#else
+	int res = mkdir(path.c_str(), 0755);
+#endif
+	struct stat st;
+	return res == 0 || (stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFDIR));
+}
+
+class TextGenerator
+{
+public:
+	explicit TextGenerator(uint64_t seed);
+	void Generate(std::string& out, size_t size);
+
+private:
+	const std::string& Ident() { return idents[Skewed(idents.size())]; }
+	size_t Skewed(size_t n) {
+		// Favour low indices so some identifiers are far more common than others
+		unsigned a = rnd.Below(static_cast<unsigned>(n));
+		unsigned b = rnd.Below(static_cast<unsigned>(n));
+		return a < b ? a : b;
+	}
+	void Statement(std::string& out, unsigned depth);
+
+	Random rnd;
+	std::vector<std::string> idents;
+};
+
+const char* const kSyllables[] = {
+	"get", "set", "buf", "len", "pos", "size", "count", "node", "list", "item",
+	"data", "next", "prev", "head", "tail", "key", "val", "ptr", "index", "flag",
+	"state", "init", "free", "read", "write", "block", "hash", "table", "entry", "match"
+};
+
+const char* const kTypes[] = {
+	"int", "unsigned", "size_t", "char*", "const char*", "uint32_t", "uint64_t", "void*", "bool", "double"
+};
+
+const char* const kOperators[] = {
+	" + ", " - ", " * ", " / ", " & ", " | ", " << ", " >> ", " == ", " != ", " < ", " >= "
+};
+
+TextGenerator::TextGenerator(uint64_t seed)
+	: rnd(seed)
+{
+	const size_t syllable_count = sizeof(kSyllables) / sizeof(kSyllables[0]);
+	for (unsigned i = 0; i < 2000; ++i) {
+		std::string name = kSyllables[rnd.Below(syllable_count)];
+		unsigned parts = 1 + rnd.Below(3);
+		for (unsigned j = 0; j < parts; ++j) {
+			std::string s = kSyllables[rnd.Below(syllable_count)];
+			if (rnd.Below(2)) {
+				name += '_';
+			}
+			else {
+				s[0] = static_cast<char>(s[0] - 'a' + 'A');
+			}
+			name += s;
+		}
+		idents.push_back(name);
+	}
+}
+
+void TextGenerator::Statement(std::string& out, unsigned depth)
+{
+	out.append(depth, '\t');
+	switch (rnd.Below(depth < 4 ? 8 : 5)) {
+	case 0:
+		out += "// ";
+		for (unsigned i = 2 + rnd.Below(8); i > 0; --i) {
+			out += Ident();
+			out += ' ';
+		}
+		out += '\n';
+		break;
+	case 1:
+		out += kTypes[rnd.Below(sizeof(kTypes) / sizeof(kTypes[0]))];
+		out += ' ';
+		out += Ident();
+		out += " = ";
+		out += std::to_string(rnd.Below(rnd.Below(2) ? 16 : 65536));
+		out += ";\n";
+		break;
+	case 2:
+	case 3:
+		out += Ident();
+		out += " = ";
+		out += Ident();
+		out += kOperators[rnd.Below(8)];
+		out += Ident();
+		out += ";\n";
+		break;
+	case 4:
+		out += Ident();
+		out += '(';
+		for (unsigned i = rnd.Below(4); i > 0; --i) {
+			out += Ident();
+			if (i > 1)
+				out += ", ";
+		}
+		out += ");\n";
+		break;
+	case 5:
+	case 6: {
+		out += rnd.Below(3) ? "if (" : "while (";
+		out += Ident();
+		out += kOperators[8 + rnd.Below(4)];
+		out += Ident();
+		out += ") {\n";
+		for (unsigned i = 1 + rnd.Below(5); i > 0; --i) {
+			Statement(out, depth + 1);
+		}
+		out.append(depth, '\t');
+		out += "}\n";
+		break;
+	}
+	default:
+		out += "for (size_t i = 0; i < ";
+		out += Ident();
+		out += "; ++i) {\n";
+		for (unsigned i = 1 + rnd.Below(4); i > 0; --i) {
+			Statement(out, depth + 1);
+		}
+		out.append(depth, '\t');
+		out += "}\n";
+		break;
+	}
+}
+
+void TextGenerator::Generate(std::string& out, size_t size)
+{
+	out.clear();
+	out += "#include \"";
+	out += Ident();
+	out += ".h\"\n\n";
+	while (out.size() < size) {
+		out += "static ";
+		out += kTypes[rnd.Below(sizeof(kTypes) / sizeof(kTypes[0]))];
+		out += ' ';
+		out += Ident();
+		out += '(';
+		out += Ident();
+		out += ")\n{\n";
+		for (unsigned i = 3 + rnd.Below(12); i > 0; --i) {
+			Statement(out, 1);
+		}
+		out += "}\n\n";
+	}
+	out.resize(size);
+}
+
+// Emits an ELF64 header followed by code built from common x86-64 instruction
+// patterns. Calls use rel32 targets drawn from a table of function addresses,
+// which is the redundancy the BCJ filter exposes.
+void GenerateElf(Random& rnd, std::string& out, size_t size)
+{
+	static const unsigned char kElfHeader[64] = {
+		0x7F, 'E', 'L', 'F', 2, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		2, 0, 0x3E, 0, 1, 0, 0, 0, 0x00, 0x10, 0x40, 0, 0, 0, 0, 0,
+		0x40, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0x40, 0, 0x38, 0, 1, 0, 0x40, 0, 0, 0, 0, 0
+	};
+	static const unsigned char kPrologue[] = { 0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC };
+	static const unsigned char kEpilogue[] = { 0xC9, 0xC3 };
+	static const unsigned char kMoves[][3] = {
+		{ 0x48, 0x8B, 0x45 }, { 0x48, 0x89, 0x45 }, { 0x8B, 0x45, 0x00 },
+		{ 0x48, 0x8B, 0x7D }, { 0x48, 0x8B, 0x75 }, { 0x89, 0x55, 0x00 }
+	};
+	out.assign(reinterpret_cast<const char*>(kElfHeader), sizeof(kElfHeader));
+	std::vector<uint32_t> functions;
+	for (unsigned i = 0; i < 4096; ++i) {
+		functions.push_back(static_cast<uint32_t>(rnd.Next() % size) & ~15U);
+	}
+	size_t code_end = size - size / 8;
+	while (out.size() < code_end) {
+		out.append(reinterpret_cast<const char*>(kPrologue), sizeof(kPrologue));
+		out += static_cast<char>(8 * (1 + rnd.Below(8)));
+		for (unsigned i = 4 + rnd.Below(24); i > 0; --i) {
+			if (rnd.Below(4) == 0) {
+				uint32_t target = functions[rnd.Below(rnd.Below(2) ? 64 : 4096)];
+				uint32_t rel = target - static_cast<uint32_t>(out.size() + 5);
+				out += static_cast<char>(0xE8);
+				for (unsigned j = 0; j < 4; ++j) {
+					out += static_cast<char>(rel >> (j * 8));
+				}
+			}
+			else {
+				const unsigned char* mv = kMoves[rnd.Below(6)];
+				out.append(reinterpret_cast<const char*>(mv), mv[2] ? 3 : 2);
+				out += static_cast<char>(0x100 - 8 * (1 + rnd.Below(8)));
+			}
+		}
+		out.append(reinterpret_cast<const char*>(kEpilogue), sizeof(kEpilogue));
+		// Align functions to 16 bytes with nop padding
+		while (out.size() & 15) {
+			out += static_cast<char>(0x90);
+		}
+	}
+	// String and symbol tables
+	TextGenerator text(rnd.Next());
+	std::string strings;
+	text.Generate(strings, size - out.size());
+	for (auto& c : strings) {
+		if (c == ' ' || c == '\n' || c == '\t')
+			c = '\0';
+	}
+	out += strings;
+	out.resize(size);
+}
+
+void GenerateRandom(Random& rnd, std::string& out, size_t size)
+{
+	out.resize(size);
+	for (size_t i = 0; i < size; i += 8) {
+		uint64_t v = rnd.Next();
+		for (size_t j = 0; j < 8 && i + j < size; ++j) {
+			out[i + j] = static_cast<char>(v >> (j * 8));
+		}
+	}
+}
+
+bool WriteFile(const std::string& path, const std::string& data)
+{
+	std::ofstream file(path.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+	file.write(data.data(), data.size());
+	file.close();
+	if (!file) {
+		fprintf(stderr, "Cannot write %s\n", path.c_str());
+		return false;
+	}
+	return true;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: benchgen <dir> [size_mb]\n");
+		return EXIT_FAILURE;
+	}
+	std::string root = argv[1];
+	size_t size_mb = 64;
+	if (argc > 2) {
+		size_mb = strtoul(argv[2], nullptr, 10);
+		if (size_mb == 0) {
+			fprintf(stderr, "Invalid size: %s\n", argv[2]);
+			return EXIT_FAILURE;
+		}
+	}
+	const size_t total = size_mb * kMb;
+	if (!MakeDir(root)
+		|| !MakeDir(root + "/text")
+		|| !MakeDir(root + "/elf")
+		|| !MakeDir(root + "/random")
+		|| !MakeDir(root + "/small")
+		|| !MakeDir(root + "/huge")) {
+		fprintf(stderr, "Cannot create directories in %s\n", root.c_str());
+		return EXIT_FAILURE;
+	}
+	std::string buf;
+	char name[64];
+
+	TextGenerator text(1);
+	for (size_t done = 0, i = 0; done < total; ++i) {
+		size_t size = std::min<size_t>(total - done, 16 * 1024 + (i * 7919 % 509) * 1024);
+		text.Generate(buf, size);
+		snprintf(name, sizeof(name), "/text/src%04u.c", static_cast<unsigned>(i));
+		if (!WriteFile(root + name, buf))
+			return EXIT_FAILURE;
+		done += size;
+	}
+
+	Random rnd(2);
+	for (size_t done = 0, i = 0; done < total; ++i) {
+		size_t size = std::min<size_t>(total - done, (1 + i % 8) * kMb);
+		GenerateElf(rnd, buf, size);
+		snprintf(name, sizeof(name), "/elf/prog%02u.out", static_cast<unsigned>(i));
+		if (!WriteFile(root + name, buf))
+			return EXIT_FAILURE;
+		done += size;
+	}
+
+	rnd = Random(3);
+	for (size_t done = 0, i = 0; done < total; ++i) {
+		size_t size = std::min<size_t>(total - done, 8 * kMb);
+		GenerateRandom(rnd, buf, size);
+		snprintf(name, sizeof(name), "/random/rand%02u.bin", static_cast<unsigned>(i));
+		if (!WriteFile(root + name, buf))
+			return EXIT_FAILURE;
+		done += size;
+	}
+
+	rnd = Random(4);
+	TextGenerator small_text(5);
+	for (unsigned d = 0; d < 100; ++d) {
+		snprintf(name, sizeof(name), "/small/dir%02u", d);
+		std::string dir = root + name;
+		if (!MakeDir(dir)) {
+			fprintf(stderr, "Cannot create directory %s\n", dir.c_str());
+			return EXIT_FAILURE;
+		}
+		for (unsigned f = 0; f < 200; ++f) {
+			size_t size = 64 + rnd.Below(rnd.Below(2) ? 1024 : 8 * 1024);
+			static const char* const kExtensions[] = { "c", "h", "txt", "dat" };
+			unsigned kind = rnd.Below(4);
+			if (kind == 3)
+				GenerateRandom(rnd, buf, size);
+			else
+				small_text.Generate(buf, size);
+			snprintf(name, sizeof(name), "/file%03u.%s", f, kExtensions[kind]);
+			if (!WriteFile(dir + name, buf))
+				return EXIT_FAILURE;
+		}
+	}
+
+	// The huge file is written in pieces to keep memory use down
+	rnd = Random(6);
+	TextGenerator huge_text(7);
+	std::ofstream huge((root + "/huge/huge.dat").c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+	for (size_t done = 0; done < 8 * total; done += 4 * kMb) {
+		switch (rnd.Below(4)) {
+		case 0:
+			GenerateRandom(rnd, buf, 4 * kMb);
+			break;
+		case 1:
+			GenerateElf(rnd, buf, 4 * kMb);
+			break;
+		default:
+			huge_text.Generate(buf, 4 * kMb);
+			break;
+		}
+		huge.write(buf.data(), buf.size());
+	}
+	huge.close();
+	if (!huge) {
+		fprintf(stderr, "Cannot write %s/huge/huge.dat\n", root.c_str());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -22,22 +22,30 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #ifndef _WIN32
-#include <fstream>
-#include <sys/types.h>
-#include <sys/stat.h>
 #include <unistd.h>
-#include <cstring>
 #endif
 #include <csignal>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
 #include "../winlean.h"
 #include "../common.h"
-#include "../OutputFile.h"
 #include "../CharType.h"
-#include "../ArchiveCompressor.h"
-#include "../Container7z.h"
+#include "../Archiver.h"
+#include "../Cancellation.h"
 #include "../RadyxOptions.h"
 #include "../IoException.h"
 #include "../Strings.h"
+#include "../Profiler.h"
+#include "../MemoryBudget.h"
+#include "../NumaPolicy.h"
+#include "../BatchManifest.h"
+#include "../ThreadPool.h"
 
 #if defined _WIN32 && !defined _WIN64
 #define RADYX_CDECL __cdecl
@@ -53,13 +61,12 @@ static const char kCopyright[] = "  Copyright 2018 Conor McCarthy";
 static const char kReleaseDate[] = "  2018-02-28";
 static const char kLicense[] = "This software has NO WARRANTY and is released under the\nGNU General Public License: www.gnu.org/licenses/gpl.html\n";
 
-static const uint_least64_t kMinMemory = 512 * 1024 * 1024;
-
-volatile bool g_break = false;
+// Set on Ctrl-C. Every archiver is cancelled with it.
+static Cancellation g_break;
 
 void RADYX_CDECL SignalHandler(int)
 {
-	g_break = true;
+	g_break.Set();
 }
 
 static void PrintBanner()
@@ -74,149 +81,233 @@ static void PrintBanner()
 		<< std::endl;
 }
 
-static bool OpenOutputStream(const Path& archive_path, const RadyxOptions& options, OutputFile& file_stream, uint_least64_t avail_mem)
+// Prints the exception being handled
+static void ReportError(Tostream& messages)
 {
-	bool is_dev_null = archive_path.IsDevNull();
-#ifdef _WIN32
-	if (!is_dev_null
-		&& GetFileAttributes(archive_path.c_str()) != INVALID_FILE_ATTRIBUTES)
-#else
-	struct stat s;
-	if (!is_dev_null && stat(archive_path.c_str(), &s) == 0)
-#endif
-	{
-		std::Tcerr << Strings::kErrorCol_ << Strings::kArchiveFileExists << std::endl;
-		throw std::invalid_argument("");
+	try {
+		throw;
 	}
-	std::Tcerr << Strings::kCreatingArchive_ << archive_path.c_str() << std::endl;
-#ifdef _WIN32
-	bool no_caching = false;
-	if (avail_mem != 0) {
-		no_caching = (avail_mem < options.lzma2.dictionary_size ||
-			(avail_mem - options.lzma2.dictionary_size < kMinMemory));
+	catch (std::invalid_argument& ex) {
+		if (*ex.what() != '\0') {
+			messages << Strings::kErrorCol_ << ex.what() << std::endl;
+		}
+	}
+	catch (std::bad_alloc&) {
+		messages << Strings::kErrorNotEnoughMem << std::endl;
+	}
+	catch (IoException& ex) {
+		messages << Strings::kErrorCol_ << ex.Twhat() << std::endl;
 	}
-	file_stream.open(archive_path.c_str(), no_caching);
+	catch (std::exception& ex) {
+		if (*ex.what() != '\0') {
+			messages << Strings::kErrorCol_ << ex.what() << std::endl;
+		}
+	}
+}
+
+static void LowerPriority()
+{
+#ifdef _WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
 #else
-	file_stream.open(archive_path.c_str(), std::ios_base::trunc | std::ios_base::binary);
+	if (nice(1) < 0) {
+	}
 #endif
-	if (file_stream.fail()) {
-		throw IoException(Strings::kCannotCreateArchive, archive_path.c_str());
+}
+
+// Creates or updates one archive, printing any error
+static int CompressArchive(Archiver& archiver, RadyxOptions& options, const Path& archive_path)
+{
+	try {
+		archiver.Create(options, archive_path);
+		return EXIT_SUCCESS;
 	}
-	return !is_dev_null;
+	catch (...) {
+		ReportError(archiver.GetMessages());
+	}
+	return EXIT_FAILURE;
 }
 
-#ifdef RADYX_RANDOM_TEST
+// Prints the messages of a batch slot whole lines at a time, each starting
+// with the job they belong to
+class JobListener : public Archiver::Listener
+{
+public:
+	explicit JobListener(std::mutex& report_mtx_) : report_mtx(report_mtx_) {}
+	void SetJob(const FsString& prefix_) { prefix = prefix_; }
+	void OnMessage(const _TCHAR* line)
+	{
+		std::lock_guard<std::mutex> lock(report_mtx);
+		if (*line != '\0') {
+			std::Tcerr << prefix;
+		}
+		std::Tcerr << line << std::endl;
+	}
+	bool OnProgress(uint_least64_t, uint_least64_t) { return true; }
 
-static bool TestAndDeleteArchive(Path& archive_path)
+private:
+	std::mutex& report_mtx;
+	FsString prefix;
+};
+
+// A telemetry file already written by another job gets the job's manifest
+// line number before its extension
+static void MakeTelemetryPathUnique(FsString& path, size_t line, std::set<FsString>& used)
 {
-    _TCHAR cmd[MAX_PATH];
-    swprintf_s(cmd, _T("e:\\7z.exe t -mmt=1 %s"), archive_path.c_str());
-    PROCESS_INFORMATION pi;
-    STARTUPINFO si;
-    ZeroMemory(&si, sizeof(si));
-    si.cb = sizeof(si);
-    si.lpReserved = 0;
-    si.lpDesktop = 0;
-    si.lpTitle = 0;
-    si.cbReserved2 = 0;
-    si.lpReserved2 = 0;
-    CreateProcess(0, cmd,
-        0, 0, 0, 0, 0, 0, &si, &pi);
-    WaitForSingleObject(pi.hProcess, 30 * 60000);
-    DWORD exit_code;
-    GetExitCodeProcess(pi.hProcess, &exit_code);
-    if (exit_code != 0) {
-        std::Tcerr << _T("Error") << std::endl;
-        return false;
-    }
-    _tremove(archive_path.c_str());
-    return true;
+	if (path.length() == 0 || used.insert(path).second) {
+		return;
+	}
+	size_t ext = path.rfind('.');
+	if (ext == FsString::npos || ext < Path::GetNamePos(path.c_str())) {
+		ext = path.length();
+	}
+	std::basic_ostringstream<_TCHAR> suffix;
+	suffix << _T('.') << line;
+	path.insert(ext, suffix.str());
+	used.insert(path);
 }
 
-#endif
+// Runs the jobs in a manifest a few at a time. Each slot owns an archiver
+// with an encoder sized to its share of the threads and memory, and keeps it
+// from one job to the next. Switches given with the b command apply to every job, ahead of
+// the job's own. Messages from each job are prefixed with its line number
+// and archive name.
+static int RunBatch(const RadyxOptions& options,
+	const Path& manifest_path,
+	int argc,
+	_TCHAR* argv[],
+	uint_least64_t memory_limit,
+	uint_least64_t avail_mem)
+{
+	// A working directory applies to the manifest and all jobs
+	options.ChangeToWorkingDir();
+	BatchManifest manifest(manifest_path.c_str());
+	const std::vector<BatchManifest::Job>& jobs = manifest.GetJobs();
+	if (jobs.empty()) {
+		std::Tcerr << Strings::kNoJobsFound << std::endl;
+		return EXIT_SUCCESS;
+	}
+	std::vector<const _TCHAR*> batch_switches;
+	for (int i = 2; i < argc && _tcscmp(argv[i], _T("--")) != 0; ++i) {
+		if (argv[i][0] == '-' && argv[i][1] != 'w' && argv[i][1] != 'j') {
+			batch_switches.push_back(argv[i]);
+		}
+	}
+	size_t slot_count = options.batch_jobs;
+	if (slot_count == 0) {
+		slot_count = std::max(options.thread_count / 4, 1U);
+	}
+	slot_count = std::min(slot_count, jobs.size());
+	// Slots wait on the tasks they queue on the shared pool, so there are
+	// fewer slots than its workers
+	unsigned pool_threads = ThreadPool::GetShared().GetThreadCount();
+	slot_count = std::min<size_t>(slot_count, std::max(pool_threads, 2U) - 1);
+	RadyxOptions slot_options(options);
+	slot_options.thread_count = std::max(options.thread_count / static_cast<unsigned>(slot_count), 1U);
+	std::mutex report_mtx;
+	std::vector<std::unique_ptr<JobListener>> listeners;
+	std::vector<std::unique_ptr<Archiver>> archivers;
+	for (size_t i = 0; i < slot_count; ++i) {
+		listeners.emplace_back(new JobListener(report_mtx));
+		archivers.emplace_back(new Archiver(slot_options,
+			memory_limit / slot_count,
+			avail_mem / slot_count,
+			listeners.back().get(),
+			&g_break));
+	}
+	std::atomic<size_t> next_job(0);
+	std::atomic<bool> failed(false);
+	std::set<FsString> telemetry_paths;
+	auto run_slot = [&](Archiver& archiver, JobListener& listener) {
+		LowerPriority();
+		for (size_t index = next_job++; index < jobs.size() && !g_break.IsSet(); index = next_job++) {
+			const BatchManifest::Job& job = jobs[index];
+			std::vector<FsString> args;
+			args.push_back(argv[0]);
+			args.push_back(job.args[0]);
+			args.insert(args.end(), batch_switches.begin(), batch_switches.end());
+			args.insert(args.end(), job.args.begin() + 1, job.args.end());
+			std::vector<_TCHAR*> job_argv;
+			for (auto& arg : args) {
+				job_argv.push_back(&arg[0]);
+			}
+			Path archive_path;
+			std::basic_ostringstream<_TCHAR> job_name;
+			job_name << Strings::kJob_ << job.line << _T(": ");
+			listener.SetJob(job_name.str());
+			Tostream& messages = archiver.GetMessages();
+			int result = EXIT_FAILURE;
+			try {
+				RadyxOptions job_options(static_cast<int>(job_argv.size()), job_argv.data(), archive_path);
+				if (job_options.batch || job_options.working_dir.length() != 0) {
+					messages << Strings::kErrorCol_ << Strings::kBatchJobUnsupported << std::endl;
+					throw std::invalid_argument("");
+				}
+				job_name.str(FsString());
+				job_name << Strings::kJob_ << job.line << _T(' ') << archive_path.c_str() << _T(": ");
+				listener.SetJob(job_name.str());
+				{
+					std::lock_guard<std::mutex> lock(report_mtx);
+					MakeTelemetryPathUnique(job_options.telemetry_path, job.line, telemetry_paths);
+				}
+				job_options.show_progress = false;
+				result = CompressArchive(archiver, job_options, archive_path);
+			}
+			catch (...) {
+				ReportError(messages);
+			}
+			if (result != EXIT_SUCCESS) {
+				failed = true;
+			}
+			std::lock_guard<std::mutex> lock(report_mtx);
+			std::Tcerr << Strings::kJob_ << job.line << _T(' ') << archive_path.c_str() << _T(": ")
+				<< (result == EXIT_SUCCESS ? Strings::kDone : Strings::kFailed) << std::endl;
+		}
+	};
+	std::vector<std::thread> slots;
+	for (size_t i = 1; i < slot_count; ++i) {
+		slots.emplace_back(run_slot, std::ref(*archivers[i]), std::ref(*listeners[i]));
+	}
+	run_slot(*archivers[0], *listeners[0]);
+	for (auto& slot : slots) {
+		slot.join();
+	}
+	return (failed || g_break.IsSet()) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
 
 int RADYX_CDECL _tmain(int argc, _TCHAR* argv[])
 {
 	signal(SIGINT, SignalHandler);
 	PrintBanner();
-	bool created_file = false;
-	Path archive_path;
 	try {
+		Path archive_path;
 		RadyxOptions options(argc, argv, archive_path);
-		uint_least64_t avail_mem = 0;
-#ifdef _WIN32
-		MEMORYSTATUSEX msx;
-		msx.dwLength = sizeof(msx);
-		if (GlobalMemoryStatusEx(&msx) == TRUE) {
-			avail_mem = msx.ullAvailPhys;
+		if (options.show_timings) {
+			Profiler::Enable();
 		}
-#endif
-		FastLzma2 unit_comp(options);
-		ArchiveCompressor ar_comp;
-		std::Tcerr << Strings::kSearching;
-		options.GetFiles(ar_comp);
-		for (size_t i = _tcslen(Strings::kSearching); i > 0; --i) {
-			std::Tcerr << '\b';
+		uint_least64_t avail_mem = Archiver::GetAvailableMemory();
+		// Must precede creation of the encoder threads and tables
+		if (options.numa_interleave && NumaPolicy::InterleaveAll() == 0) {
+			std::Tcerr << Strings::kNumaUnavailable << std::endl;
 		}
-		if (ar_comp.GetFileList().size() == 0) {
-			std::Tcerr << Strings::kNoFilesFound << std::endl;
-			return EXIT_SUCCESS;
+		uint_least64_t memory_limit = MemoryBudget::GetLimit(options);
+		int result;
+		if (options.batch) {
+			result = RunBatch(options, archive_path, argc, argv, memory_limit, avail_mem);
 		}
-		avail_mem -= unit_comp.GetMemoryUsage();
-        ar_comp.PrepareFileList(options);
-#ifdef _WIN32
-        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
-#else
-        if (nice(1) < 0) {
-        }
-#endif
-#ifdef RADYX_RANDOM_TEST
-        std::Tcerr << _T("Random file selector/tester") << std::endl;
-        for(int i = 0; i < 1000; ++i)
-#endif
-        {
-            OutputFile out_stream;
-            created_file = OpenOutputStream(archive_path, options, out_stream, avail_mem);
-            Container7z::ReserveSignatureHeader(out_stream);
-            uint_least64_t packed = ar_comp.Compress(unit_comp, options, out_stream);
-            if (ar_comp.GetFileList().size() != 0) {
-                packed += Container7z::WriteDatabase(ar_comp, unit_comp, out_stream);
-                if (!created_file) {
-                    std::Tcerr << "Compressed size: " << packed << " bytes" << std::endl;
-                }
-                std::Tcerr << Strings::kDone << std::endl;
-#ifdef RADYX_RANDOM_TEST
-                out_stream.close();
-                if(!TestAndDeleteArchive(archive_path))
-                    return EXIT_FAILURE;
-                ar_comp.RestoreFileList();
-#else
-                return EXIT_SUCCESS;
-#endif
-            }
-        }
-#ifdef RADYX_RANDOM_TEST
-        return EXIT_SUCCESS;
-#endif
-    }
-	catch (std::invalid_argument& ex) {
-		if (*ex.what() != '\0') {
-			std::Tcerr << Strings::kErrorCol_ << ex.what() << std::endl;
+		else {
+			Archiver archiver(options, memory_limit, avail_mem, nullptr, &g_break);
+			LowerPriority();
+			result = CompressArchive(archiver, options, archive_path);
 		}
-	}
-	catch (std::bad_alloc&) {
-		std::Tcerr << Strings::kErrorNotEnoughMem << std::endl;
-	}
-	catch (IoException& ex) {
-		std::Tcerr << Strings::kErrorCol_ << ex.Twhat() << std::endl;
-	}
-	catch (std::exception& ex) {
-		if (*ex.what() != '\0') {
-			std::Tcerr << Strings::kErrorCol_ << ex.what() << std::endl;
+		if (result == EXIT_SUCCESS) {
+			Profiler::Report();
+			RADYX_STATS_REPORT();
 		}
+		return result;
 	}
-	if (created_file) {
-		_tremove(archive_path.c_str());
+	catch (...) {
+		ReportError(std::Tcerr);
 	}
 	return EXIT_FAILURE;
 }
@@ -0,0 +1,98 @@
+#!/bin/sh
+#
+# Radyx benchmark harness. Run through 'make bench'.
+#
+# Compresses each corpus created by benchgen at every combination of level,
+# thread count and read mode and appends one CSV row per run:
+#   corpus,level,threads,input_bytes,archive_bytes,ratio,seconds,mb_per_s,
+#   peak_rss_kb,header_seconds,read_mode
+#
+# Environment:
+#   RADYX     radyx binary (default ./radyx)
+#   BENCHGEN  corpus generator (default ./benchgen)
+#   DATA      corpus directory (default bench-data), generated if missing
+#   SIZE_MB   corpus size passed to benchgen (default 64)
+#   CORPORA   corpora to run (default "text elf random small huge")
+#   LEVELS    compression levels (default "1 5 9")
+#   THREADS   thread counts (default "1 <number of cores>")
+#   READ      read mode switches (default "-ar"). Use "-ar -ars -ar-" to
+#             compare async, staged and plain reading, with DATA on each
+#             device of interest (HDD, NVMe, NFS).
+#   EXTRA     switches added to every run, e.g. "-mhp" with LEVELS="6 7 8 9"
+#             and a separate OUT to compare huge pages against a plain run
+#   OUT       CSV file (default bench.csv)
+#
+# Peak RSS is read from GNU time (/usr/bin/time) and is reported as NA if it is
+# not installed. Header time is taken from the -bt summary.
+
+RADYX=${RADYX:-./radyx}
+BENCHGEN=${BENCHGEN:-./benchgen}
+DATA=${DATA:-bench-data}
+SIZE_MB=${SIZE_MB:-64}
+CORPORA=${CORPORA:-"text elf random small huge"}
+LEVELS=${LEVELS:-"1 5 9"}
+CORES=$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)
+THREADS=${THREADS:-"1 $CORES"}
+READ=${READ:-"-ar"}
+EXTRA=${EXTRA:-}
+OUT=${OUT:-bench.csv}
+
+case $RADYX in /*) ;; *) RADYX=$(pwd)/$RADYX ;; esac
+case $DATA in /*) ;; *) DATA=$(pwd)/$DATA ;; esac
+
+if [ ! -d "$DATA" ]; then
+	echo "Generating $SIZE_MB Mb corpora in $DATA"
+	"$BENCHGEN" "$DATA" "$SIZE_MB" || exit 1
+fi
+
+if [ -x /usr/bin/time ] && /usr/bin/time -f %M true >/dev/null 2>&1; then
+	GNU_TIME=1
+else
+	GNU_TIME=0
+fi
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/radyx-bench.XXXXXX") || exit 1
+trap 'rm -rf "$WORK"' EXIT INT TERM
+ARCHIVE=$WORK/bench.7z
+
+if [ ! -f "$OUT" ]; then
+	echo "corpus,level,threads,input_bytes,archive_bytes,ratio,seconds,mb_per_s,peak_rss_kb,header_seconds,read_mode" > "$OUT"
+fi
+
+for corpus in $CORPORA; do
+	input=$(find "$DATA/$corpus" -type f -printf '%s\n' | awk '{ s += $1 } END { printf "%.0f", s }')
+	for level in $LEVELS; do
+		for threads in $THREADS; do
+			for read in $READ; do
+				rm -f "$ARCHIVE"
+				start=$(date +%s.%N)
+				if [ $GNU_TIME -eq 1 ]; then
+					(cd "$DATA/$corpus" && /usr/bin/time -f %M -o "$WORK/rss" \
+						"$RADYX" a -bt -r -mx=$level -mmt=$threads $read $EXTRA "$ARCHIVE" '*' 2>"$WORK/log" >/dev/null)
+				else
+					(cd "$DATA/$corpus" && \
+						"$RADYX" a -bt -r -mx=$level -mmt=$threads $read $EXTRA "$ARCHIVE" '*' 2>"$WORK/log" >/dev/null)
+				fi
+				status=$?
+				end=$(date +%s.%N)
+				if [ $status -ne 0 ] || [ ! -f "$ARCHIVE" ]; then
+					echo "$corpus level $level threads $threads $read failed:" >&2
+					cat "$WORK/log" >&2
+					exit 1
+				fi
+				packed=$(wc -c < "$ARCHIVE" | tr -d ' ')
+				if [ $GNU_TIME -eq 1 ]; then
+					rss=$(tail -n 1 "$WORK/rss")
+				else
+					rss=NA
+				fi
+				header=$(awk '/All threads/ { all = 1 } all && /Write header/ { print $3 }' "$WORK/log")
+				echo "$corpus $level $threads $input $packed $start $end $rss ${header:-0} $read" | awk '{
+					secs = $7 - $6
+					mbs = secs > 0 ? $4 / 1048576 / secs : 0
+					printf "%s,%s,%s,%s,%s,%.3f,%.3f,%.2f,%s,%s,%s\n", $1, $2, $3, $4, $5, $4 / $5, secs, mbs, $8, $9, $10
+				}' | tee -a "$OUT"
+			done
+		done
+	done
+done
@@ -0,0 +1,413 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// libradyx
+//        C interface for creating 7-zip archives from another program
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <ios>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "winlean.h"
+#include "libradyx.h"
+#include "common.h"
+#include "CharType.h"
+#include "Archiver.h"
+#include "RadyxOptions.h"
+#include "MemoryBudget.h"
+#include "IoException.h"
+#include "Strings.h"
+#include "fast-lzma2/fast-lzma2.h"
+
+using namespace Radyx;
+
+namespace {
+
+#ifdef _UNICODE
+
+FsString FromUtf8(const char* str)
+{
+	FsString wide;
+	int len = MultiByteToWideChar(CP_UTF8, 0, str, -1, nullptr, 0);
+	if (len > 1) {
+		wide.resize(len);
+		MultiByteToWideChar(CP_UTF8, 0, str, -1, &wide[0], len);
+		wide.resize(len - 1);
+	}
+	return wide;
+}
+
+std::string ToUtf8(const _TCHAR* str)
+{
+	std::string utf8;
+	int len = WideCharToMultiByte(CP_UTF8, 0, str, -1, nullptr, 0, nullptr, nullptr);
+	if (len > 1) {
+		utf8.resize(len);
+		WideCharToMultiByte(CP_UTF8, 0, str, -1, &utf8[0], len, nullptr, nullptr);
+		utf8.resize(len - 1);
+	}
+	return utf8;
+}
+
+#else
+
+FsString FromUtf8(const char* str)
+{
+	return str;
+}
+
+std::string ToUtf8(const char* str)
+{
+	return str;
+}
+
+#endif
+
+RadyxOptions::Recurse ToRecurse(radyx_recurse recurse)
+{
+	switch (recurse) {
+	case RADYX_RECURSE_WILDCARD:
+		return RadyxOptions::kRecurseWildcard;
+	case RADYX_RECURSE_ALL:
+		return RadyxOptions::kRecurseAll;
+	default:
+		return RadyxOptions::kRecurseNone;
+	}
+}
+
+class SourceAdapter : public FileSource
+{
+public:
+	explicit SourceAdapter(const radyx_source& source_) : source(source_) {}
+	bool Next(Entry& entry);
+	std::unique_ptr<Reader> Open(const FsString& name);
+
+private:
+	class FileReader : public Reader
+	{
+	public:
+		FileReader(const radyx_source& source_, void* file_) : source(source_), file(file_) {}
+		~FileReader() { source.close(source.opaque, file); }
+		bool Read(void* buffer, size_t byte_count, size_t& bytes_read)
+		{
+			return source.read(source.opaque, file, buffer, byte_count, &bytes_read) != 0;
+		}
+
+	private:
+		const radyx_source& source;
+		void* file;
+	};
+
+	radyx_source source;
+};
+
+bool SourceAdapter::Next(Entry& entry)
+{
+	const char* name = nullptr;
+	uint64_t size = 0;
+	uint64_t mod_time = 0;
+	if (source.next(source.opaque, &name, &size, &mod_time) == 0) {
+		return false;
+	}
+	entry.name = FromUtf8(name != nullptr ? name : "");
+	entry.size = size;
+	entry.mod_time = mod_time;
+	return true;
+}
+
+std::unique_ptr<FileSource::Reader> SourceAdapter::Open(const FsString& name)
+{
+	void* file = source.open(source.opaque, ToUtf8(name.c_str()).c_str());
+	if (file == nullptr) {
+		return nullptr;
+	}
+	return std::unique_ptr<Reader>(new FileReader(source, file));
+}
+
+class SinkAdapter : public OutputSink
+{
+public:
+	explicit SinkAdapter(const radyx_sink& sink_) : sink(sink_) {}
+	bool Write(const char* data, size_t size) { return sink.write(sink.opaque, data, size) != 0; }
+	bool Seek(uint_least64_t pos) { return sink.seek(sink.opaque, pos) != 0; }
+
+private:
+	radyx_sink sink;
+};
+
+}
+
+struct radyx_archiver : public Archiver::Listener
+{
+	radyx_archiver(const radyx_callbacks* callbacks_)
+	{
+		if (callbacks_ != nullptr) {
+			callbacks = *callbacks_;
+		}
+		else {
+			callbacks.opaque = nullptr;
+			callbacks.message = nullptr;
+			callbacks.progress = nullptr;
+		}
+	}
+	void OnMessage(const _TCHAR* line);
+	bool OnProgress(uint_least64_t done, uint_least64_t total);
+	radyx_result Archive(const Path& path, OutputSink* sink);
+	radyx_result SetError();
+
+	radyx_callbacks callbacks;
+	RadyxOptions options;
+	std::unique_ptr<Archiver> archiver;
+	std::unique_ptr<SourceAdapter> source;
+	std::vector<RadyxOptions::FileSpec> file_specs;
+	std::vector<RadyxOptions::FileSpec> exclusions;
+	// Errors are printed before std::invalid_argument is thrown, so the last
+	// line describes them
+	std::string last_message;
+	std::string error;
+};
+
+void radyx_archiver::OnMessage(const _TCHAR* line)
+{
+	last_message = ToUtf8(line);
+	if (callbacks.message != nullptr) {
+		callbacks.message(callbacks.opaque, last_message.c_str());
+	}
+}
+
+bool radyx_archiver::OnProgress(uint_least64_t done, uint_least64_t total)
+{
+	return callbacks.progress == nullptr || callbacks.progress(callbacks.opaque, done, total) != 0;
+}
+
+// Records the exception being handled
+radyx_result radyx_archiver::SetError()
+{
+	try {
+		throw;
+	}
+	catch (std::invalid_argument& ex) {
+		error = *ex.what() != '\0' ? ex.what() : last_message;
+		return RADYX_ERROR_PARAMETER;
+	}
+	catch (std::bad_alloc&) {
+		error = ToUtf8(Strings::kErrorNotEnoughMem);
+		return RADYX_ERROR_MEMORY;
+	}
+	catch (IoException& ex) {
+		error = ToUtf8(ex.Twhat());
+		return RADYX_ERROR_IO;
+	}
+	catch (std::ios_base::failure& ex) {
+		error = ex.what();
+		return RADYX_ERROR_IO;
+	}
+	catch (std::exception& ex) {
+		error = *ex.what() != '\0' ? ex.what() : last_message;
+		return (archiver && archiver->IsCancelled()) ? RADYX_ERROR_CANCELLED : RADYX_ERROR_GENERIC;
+	}
+}
+
+radyx_result radyx_archiver::Archive(const Path& path, OutputSink* sink)
+{
+	error.clear();
+	last_message.clear();
+	radyx_result result;
+	try {
+		RadyxOptions job_options(options);
+		job_options.file_specs.swap(file_specs);
+		job_options.exclusions.swap(exclusions);
+		if (source) {
+			archiver->SetSource(source.get());
+		}
+		else {
+			job_options.Prepare();
+			archiver->SetSource(nullptr);
+		}
+		bool created = sink != nullptr ? archiver->Create(job_options, *sink) : archiver->Create(job_options, path);
+		result = created ? RADYX_OK : RADYX_NO_FILES;
+	}
+	catch (...) {
+		result = SetError();
+	}
+	file_specs.clear();
+	exclusions.clear();
+	archiver->ClearCancel();
+	return result;
+}
+
+extern "C" {
+
+void radyx_options_init(radyx_options* options)
+{
+	RadyxOptions defaults;
+	options->level = defaults.lzma2.compress_level;
+	options->dictionary_size = 0;
+	options->threads = 0;
+	options->memory_limit = 0;
+	options->solid_unit_size = defaults.solid_unit_size;
+	options->solid_file_count = static_cast<uint32_t>(defaults.solid_file_count);
+	options->bcj_filter = defaults.bcj_filter;
+	options->store_full_paths = defaults.store_full_paths;
+	options->store_creation_time = defaults.store_creation_time;
+	options->verify = defaults.verify;
+	options->list_files = !defaults.quiet_mode;
+	options->update = defaults.update;
+	options->resume = defaults.resume;
+	options->volume_size = defaults.volume_size;
+}
+
+radyx_result radyx_create(radyx_archiver** archiver,
+	const radyx_options* options,
+	const radyx_callbacks* callbacks)
+{
+	*archiver = nullptr;
+	if (options->level < 1 || options->level > static_cast<unsigned>(FL2_maxCLevel())
+		|| (options->dictionary_size != 0 && (options->dictionary_size < (UINT64_C(1) << FL2_DICTLOG_MIN)
+			|| options->dictionary_size > (UINT64_C(1) << FL2_DICTLOG_MAX)))
+		|| options->threads > FL2_MAXTHREADS
+		|| options->solid_unit_size == 0
+		|| options->solid_file_count == 0)
+	{
+		return RADYX_ERROR_PARAMETER;
+	}
+	std::unique_ptr<radyx_archiver> arc;
+	try {
+		arc.reset(new radyx_archiver(callbacks));
+	}
+	catch (std::bad_alloc&) {
+		return RADYX_ERROR_MEMORY;
+	}
+	RadyxOptions& opt = arc->options;
+	opt.lzma2.compress_level = options->level;
+	if (options->dictionary_size != 0) {
+		opt.lzma2.dictionary_size = static_cast<size_t>(options->dictionary_size);
+	}
+	opt.thread_count = options->threads;
+	opt.memory_limit = options->memory_limit;
+	opt.solid_unit_size = options->solid_unit_size;
+	opt.solid_file_count = options->solid_file_count;
+	opt.bcj_filter = options->bcj_filter != 0;
+	opt.store_full_paths = options->store_full_paths != 0;
+	opt.store_creation_time = options->store_creation_time != 0;
+	opt.verify = options->verify != 0;
+	opt.quiet_mode = options->list_files == 0;
+	opt.update = options->update != 0;
+	opt.resume = options->resume != 0;
+	opt.volume_size = options->volume_size;
+	opt.show_progress = false;
+	// Settings are checked before the archiver exists to take the messages
+	std::basic_ostringstream<_TCHAR> prepare_messages;
+	opt.messages = &prepare_messages;
+	try {
+		opt.Prepare();
+		arc->archiver.reset(new Archiver(opt, MemoryBudget::GetLimit(opt), Archiver::GetAvailableMemory(), arc.get()));
+	}
+	catch (std::invalid_argument&) {
+		std::basic_istringstream<_TCHAR> lines(prepare_messages.str());
+		FsString line;
+		while (std::getline(lines, line)) {
+			if (!line.empty() && line[0] == '\r') {
+				line.erase(0, 1);
+			}
+			arc->OnMessage(line.c_str());
+		}
+		return RADYX_ERROR_PARAMETER;
+	}
+	catch (std::bad_alloc&) {
+		return RADYX_ERROR_MEMORY;
+	}
+	opt.messages = &arc->archiver->GetMessages();
+	*archiver = arc.release();
+	return RADYX_OK;
+}
+
+void radyx_free(radyx_archiver* archiver)
+{
+	delete archiver;
+}
+
+radyx_result radyx_add_files(radyx_archiver* archiver, const char* spec, radyx_recurse recurse)
+{
+	try {
+		archiver->file_specs.push_back(RadyxOptions::FileSpec(FromUtf8(spec).c_str(), ToRecurse(recurse)));
+	}
+	catch (std::bad_alloc&) {
+		return RADYX_ERROR_MEMORY;
+	}
+	return RADYX_OK;
+}
+
+radyx_result radyx_exclude_files(radyx_archiver* archiver, const char* spec, radyx_recurse recurse)
+{
+	try {
+		archiver->exclusions.push_back(RadyxOptions::FileSpec(FromUtf8(spec).c_str(), ToRecurse(recurse)));
+	}
+	catch (std::bad_alloc&) {
+		return RADYX_ERROR_MEMORY;
+	}
+	return RADYX_OK;
+}
+
+radyx_result radyx_set_source(radyx_archiver* archiver, const radyx_source* source)
+{
+	try {
+		archiver->source.reset(source != nullptr ? new SourceAdapter(*source) : nullptr);
+	}
+	catch (std::bad_alloc&) {
+		return RADYX_ERROR_MEMORY;
+	}
+	return RADYX_OK;
+}
+
+radyx_result radyx_archive_to_file(radyx_archiver* archiver, const char* path)
+{
+	Path archive_path;
+	try {
+		archive_path = FromUtf8(path);
+		archive_path.ConvertSeparators();
+	}
+	catch (std::bad_alloc&) {
+		return RADYX_ERROR_MEMORY;
+	}
+	return archiver->Archive(archive_path, nullptr);
+}
+
+radyx_result radyx_archive_to_sink(radyx_archiver* archiver, const radyx_sink* sink)
+{
+	SinkAdapter adapter(*sink);
+	return archiver->Archive(Path(), &adapter);
+}
+
+void radyx_cancel(radyx_archiver* archiver)
+{
+	archiver->archiver->Cancel();
+}
+
+const char* radyx_error_message(const radyx_archiver* archiver)
+{
+	return archiver->error.c_str();
+}
+
+}
@@ -0,0 +1,162 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// libradyx
+//        C interface for creating 7-zip archives from another program
+//
+// Copyright 2015-present Conor McCarthy
+//
+// This file is part of Radyx.
+//
+// Radyx is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Radyx is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Radyx. If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef LIBRADYX_H
+#define LIBRADYX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* All strings are UTF-8. An archiver creates one archive at a time, but
+ * separate archivers may run on separate threads. C++ programs may use the
+ * Radyx::Archiver class directly. */
+
+typedef struct radyx_archiver radyx_archiver;
+
+typedef enum
+{
+	RADYX_OK = 0,
+	/* No files matched, so no archive was written */
+	RADYX_NO_FILES,
+	RADYX_ERROR_PARAMETER,
+	RADYX_ERROR_MEMORY,
+	RADYX_ERROR_IO,
+	RADYX_ERROR_CANCELLED,
+	RADYX_ERROR_GENERIC
+} radyx_result;
+
+typedef enum
+{
+	RADYX_RECURSE_NONE,
+	/* Subdirectories are searched for names containing wildcards */
+	RADYX_RECURSE_WILDCARD,
+	RADYX_RECURSE_ALL
+} radyx_recurse;
+
+/* Set the defaults with radyx_options_init before changing any field */
+typedef struct
+{
+	/* 1 to 9 */
+	unsigned level;
+	/* Bytes, or 0 for the level's default */
+	uint64_t dictionary_size;
+	/* 0 uses every hardware thread */
+	unsigned threads;
+	/* Bytes the encoder may use, or 0 for no limit */
+	uint64_t memory_limit;
+	/* Largest solid unit in bytes */
+	uint64_t solid_unit_size;
+	/* Most files in a solid unit */
+	uint32_t solid_file_count;
+	int bcj_filter;
+	int store_full_paths;
+	int store_creation_time;
+	/* Decode each unit after it is written and compare the file CRCs */
+	int verify;
+	/* Report each file added as a message */
+	int list_files;
+	/* The following apply to archives written to a file */
+	/* Keep unchanged units of an existing archive */
+	int update;
+	/* Continue an interrupted archive from its journal */
+	int resume;
+	/* Split into volumes of this many bytes, or 0 */
+	uint64_t volume_size;
+} radyx_options;
+
+typedef struct
+{
+	void* opaque;
+	/* One line of text, such as a warning about a file which can't be read.
+	 * May be NULL. */
+	void (*message)(void* opaque, const char* line);
+	/* Called as each percent is done. Return 0 to cancel. May be NULL. */
+	int (*progress)(void* opaque, uint64_t done, uint64_t total);
+} radyx_callbacks;
+
+/* Supplies files in place of searching the disk. Every entry is listed
+ * before any is opened, and files are opened one at a time in the order
+ * they are stored, which is not the order they were listed. */
+typedef struct
+{
+	void* opaque;
+	/* Sets the next entry and returns 1, or returns 0 after the last. The
+	 * name, which may contain '/', must stay valid until next is called
+	 * again. mod_time is a Windows FILETIME, or 0 if unknown. */
+	int (*next)(void* opaque, const char** name, uint64_t* size, uint64_t* mod_time);
+	/* Returns NULL if the file can't be opened. Directories in the name are
+	 * separated in the native form. */
+	void* (*open)(void* opaque, const char* name);
+	/* Sets bytes_read to 0 at the end of the file. Returns 0 on error. */
+	int (*read)(void* opaque, void* file, void* buffer, size_t size, size_t* bytes_read);
+	void (*close)(void* opaque, void* file);
+} radyx_source;
+
+/* Receives an archive written sequentially, except for a 32-byte header at
+ * the start which is written last after a seek to 0 */
+typedef struct
+{
+	void* opaque;
+	/* Return 0 on error */
+	int (*write)(void* opaque, const void* data, size_t size);
+	int (*seek)(void* opaque, uint64_t pos);
+} radyx_sink;
+
+void radyx_options_init(radyx_options* options);
+
+/* The encoder and its threads are created here and kept until
+ * radyx_free. callbacks may be NULL. */
+radyx_result radyx_create(radyx_archiver** archiver,
+	const radyx_options* options,
+	const radyx_callbacks* callbacks);
+void radyx_free(radyx_archiver* archiver);
+
+/* Adds a file name or wildcard for the next archive */
+radyx_result radyx_add_files(radyx_archiver* archiver, const char* spec, radyx_recurse recurse);
+radyx_result radyx_exclude_files(radyx_archiver* archiver, const char* spec, radyx_recurse recurse);
+/* Reads the next archives from source instead, or from the disk again if
+ * source is NULL. update and resume can't be used with a source. */
+radyx_result radyx_set_source(radyx_archiver* archiver, const radyx_source* source);
+
+/* Each creates one archive. File names and exclusions are cleared
+ * afterwards. */
+radyx_result radyx_archive_to_file(radyx_archiver* archiver, const char* path);
+/* update, resume and volume_size can't be used with a sink */
+radyx_result radyx_archive_to_sink(radyx_archiver* archiver, const radyx_sink* sink);
+
+/* Stops the archive in progress, or the next one if none is. Safe to call
+ * from any thread. */
+void radyx_cancel(radyx_archiver* archiver);
+/* Description of the last error, or an empty string */
+const char* radyx_error_message(const radyx_archiver* archiver);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBRADYX_H */